@@ -0,0 +1,1125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <byteswap.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <libchdr/chd.h>
+#include <libchdr/cdrom.h>
+#include <dr_libs/dr_flac.h>
+
+#include "cd.h"
+#include "file_io.h"
+#include "cfg.h"
+#include "offload.h"
+#include "miniz.h"
+#include "support/chd/mister_chd.h"
+
+int cd_sgets(char *out, int sz, char **in)
+{
+	*out = 0;
+	do
+	{
+		char *instr = *in;
+		int cnt = 0;
+
+		while (*instr && *instr != 10)
+		{
+			if (*instr == 13)
+			{
+				instr++;
+				continue;
+			}
+
+			if (cnt < sz - 1)
+			{
+				out[cnt++] = *instr;
+				out[cnt] = 0;
+			}
+
+			instr++;
+		}
+
+		if (*instr == 10) instr++;
+		*in = instr;
+	} while (!*out && **in);
+
+	return *out;
+}
+
+// path holds name of CUE (or previous track file) and gets the file name
+// of FILE command argument in the same folder. Returns the rest of the line.
+const char *cd_cue_file(char *path, int size, const char *arg)
+{
+	char *ptr = path + strlen(path) - 1;
+	while ((ptr - path) && (*ptr != '/') && (*ptr != '\\')) ptr--;
+	if (ptr - path) ptr++;
+
+	while (*arg == 0x20) arg++;
+
+	if (*arg == '\"')
+	{
+		arg++;
+		while (*arg && (*arg != '\"') && (ptr < (path + size - 1))) *ptr++ = *arg++;
+	}
+	else
+	{
+		while (*arg && (*arg != 0x20) && (ptr < (path + size - 1))) *ptr++ = *arg++;
+	}
+	*ptr = 0;
+
+	return arg;
+}
+
+int cd_data_offset(int sector_size, int mode2)
+{
+	if (sector_size == 2048) return 0;
+	if (sector_size == 2336) return 8;
+	return mode2 ? 24 : 16;
+}
+
+// decompressed hunks of one CHD, least recently used one is replaced
+struct chd_cache_t
+{
+	chd_file *chd_f;
+	uint8_t  *buf;
+	int      *hunknum;
+	uint32_t *used;
+	uint8_t  *loading;   // CHD_SLOT_*
+	int       slots;
+	int       last;
+	int       hunkbytes;
+	int       sectors_per_hunk;
+	int       totalhunks;
+	uint32_t  stamp;
+	int       cur_hunk;
+	int       inflight;
+	uint64_t  hits;
+	uint64_t  misses;
+	uint64_t  prefetched;
+
+	pthread_mutex_t lock;      // slot state
+	pthread_cond_t  cond;      // hunk loaded
+	pthread_mutex_t read_lock; // chd_read of the same file must not run concurrently
+};
+
+// slot loading state
+#define CHD_SLOT_READY  0
+#define CHD_SLOT_BUSY   1 // hunk is being decompressed
+#define CHD_SLOT_QUEUED 2 // prefetch is queued but not started, a reader may take it over
+
+// one per mounted image: MegaCD/PCECD/Saturn/PSX + 4 ATAPI drives
+#define CD_CHD_MAX 8
+
+// hunks decompressed ahead of sequential reads (8 sectors per hunk on CD images)
+#define CD_CHD_PREFETCH 4
+
+static chd_cache_t chd_cache[CD_CHD_MAX] = {};
+static pthread_mutex_t chd_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static chd_cache_t *chd_cache_get(chd_file *chd_f)
+{
+	chd_cache_t *cache = NULL;
+
+	pthread_mutex_lock(&chd_cache_lock);
+	for (int i = 0; i < CD_CHD_MAX; i++)
+	{
+		if (chd_cache[i].chd_f == chd_f)
+		{
+			cache = &chd_cache[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&chd_cache_lock);
+
+	return cache;
+}
+
+static void chd_cache_free(chd_cache_t *cache)
+{
+	if (cache->slots)
+	{
+		pthread_mutex_destroy(&cache->lock);
+		pthread_cond_destroy(&cache->cond);
+		pthread_mutex_destroy(&cache->read_lock);
+	}
+
+	free(cache->buf);
+	free(cache->hunknum);
+	free(cache->used);
+	free(cache->loading);
+	memset(cache, 0, sizeof(chd_cache_t));
+}
+
+static bool chd_cache_alloc(chd_cache_t *cache, const chd_header *header)
+{
+	int slots = (int)(((uint64_t)cfg.chd_cache_size * 1024) / header->hunkbytes);
+	if (slots > (int)header->totalhunks) slots = header->totalhunks;
+	if (slots < 1) slots = 1;
+
+	cache->buf = (uint8_t *)malloc((size_t)slots * header->hunkbytes);
+	cache->hunknum = (int *)malloc(slots * sizeof(int));
+	cache->used = (uint32_t *)calloc(slots, sizeof(uint32_t));
+	cache->loading = (uint8_t *)calloc(slots, sizeof(uint8_t));
+	if (!cache->buf || !cache->hunknum || !cache->used || !cache->loading)
+	{
+		chd_cache_free(cache);
+		return false;
+	}
+
+	for (int i = 0; i < slots; i++) cache->hunknum[i] = -1;
+	cache->slots = slots;
+	cache->hunkbytes = header->hunkbytes;
+	cache->sectors_per_hunk = header->hunkbytes / header->unitbytes;
+	cache->totalhunks = header->totalhunks;
+	cache->cur_hunk = -1;
+
+	pthread_mutex_init(&cache->lock, NULL);
+	pthread_cond_init(&cache->cond, NULL);
+	pthread_mutex_init(&cache->read_lock, NULL);
+
+	printf("\x1b[32mCHD cache: %d hunks of %d bytes\n\x1b[0m", slots, cache->hunkbytes);
+	return true;
+}
+
+// cache->lock must be held
+static int chd_cache_find(chd_cache_t *cache, int hunknum)
+{
+	if (cache->hunknum[cache->last] == hunknum) return cache->last;
+
+	for (int slot = 0; slot < cache->slots; slot++)
+	{
+		if (cache->hunknum[slot] == hunknum) return slot;
+	}
+
+	return -1;
+}
+
+// cache->lock must be held. With steal, a queued prefetch is cancelled when no other slot is free.
+static int chd_cache_victim(chd_cache_t *cache, bool steal)
+{
+	int victim = -1;
+	int queued = -1;
+	for (int slot = 0; slot < cache->slots; slot++)
+	{
+		if (cache->loading[slot] == CHD_SLOT_QUEUED && queued < 0) queued = slot;
+		if (cache->loading[slot]) continue;
+		if (victim < 0 || cache->used[slot] < cache->used[victim]) victim = slot;
+	}
+
+	return (victim < 0 && steal) ? queued : victim;
+}
+
+// slot is marked as loading by caller, so nobody else touches its buffer
+static bool chd_cache_load(chd_cache_t *cache, int slot, int hunknum)
+{
+	pthread_mutex_lock(&cache->read_lock);
+	chd_error err = chd_read(cache->chd_f, hunknum, cache->buf + (size_t)slot * cache->hunkbytes);
+	pthread_mutex_unlock(&cache->read_lock);
+
+	if (err != CHDERR_NONE) printf("\x1b[32mCHD read error: %s\n\x1b[0m", chd_error_string(err));
+
+	pthread_mutex_lock(&cache->lock);
+	cache->loading[slot] = CHD_SLOT_READY;
+	if (err != CHDERR_NONE)
+	{
+		cache->hunknum[slot] = -1;
+		cache->used[slot] = 0;
+	}
+	pthread_cond_broadcast(&cache->cond);
+	pthread_mutex_unlock(&cache->lock);
+
+	return err == CHDERR_NONE;
+}
+
+// cache->lock must be held, drops queued prefetch that never started
+static void chd_cache_cancel(chd_cache_t *cache, int slot, int hunknum)
+{
+	if (cache->loading[slot] == CHD_SLOT_QUEUED && cache->hunknum[slot] == hunknum)
+	{
+		cache->loading[slot] = CHD_SLOT_READY;
+		cache->hunknum[slot] = -1;
+		cache->used[slot] = 0;
+	}
+}
+
+// decompress hunk on the offload core, so it's ready when the read arrives
+static void chd_cache_prefetch(chd_cache_t *cache, int hunknum)
+{
+	if (hunknum >= cache->totalhunks) return;
+
+	pthread_mutex_lock(&cache->lock);
+
+	int slot = -1;
+	if (cache->inflight < CD_CHD_PREFETCH && chd_cache_find(cache, hunknum) < 0)
+	{
+		slot = chd_cache_victim(cache, false);
+		if (slot == cache->last) slot = -1;
+	}
+
+	if (slot >= 0)
+	{
+		cache->hunknum[slot] = hunknum;
+		cache->used[slot] = cache->stamp;
+		cache->loading[slot] = CHD_SLOT_QUEUED;
+		cache->inflight++;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+
+	if (slot < 0) return;
+
+	// reads also come from offload work (readahead, CDDA stream), so never wait for a free work slot
+	bool queued = offload_try_add_work([cache, slot, hunknum]()
+	{
+		pthread_mutex_lock(&cache->lock);
+		bool start = (cache->loading[slot] == CHD_SLOT_QUEUED && cache->hunknum[slot] == hunknum);
+		if (start) cache->loading[slot] = CHD_SLOT_BUSY;
+		pthread_mutex_unlock(&cache->lock);
+
+		// reader took the hunk over meanwhile
+		bool ok = start && chd_cache_load(cache, slot, hunknum);
+
+		pthread_mutex_lock(&cache->lock);
+		if (ok) cache->prefetched++;
+		cache->inflight--;
+		pthread_cond_broadcast(&cache->cond);
+		pthread_mutex_unlock(&cache->lock);
+	}, OFFLOAD_PRIO_HIGH);
+
+	if (!queued)
+	{
+		pthread_mutex_lock(&cache->lock);
+		chd_cache_cancel(cache, slot, hunknum);
+		cache->inflight--;
+		pthread_cond_broadcast(&cache->cond);
+		pthread_mutex_unlock(&cache->lock);
+	}
+}
+
+chd_error cd_chd_open(const char *filename, toc_t *toc)
+{
+	chd_error err;
+	if (cd_toc_load(filename, "CHD", toc))
+	{
+		err = mister_open_chd(filename, toc);
+	}
+	else
+	{
+		err = mister_load_chd(filename, toc);
+		if (err == CHDERR_NONE) cd_toc_save(filename, "CHD", toc);
+	}
+	if (err != CHDERR_NONE) return err;
+
+	const chd_header *header = chd_get_header(toc->chd_f);
+
+	pthread_mutex_lock(&chd_cache_lock);
+	chd_cache_t *cache = NULL;
+	for (int i = 0; i < CD_CHD_MAX; i++)
+	{
+		if (!chd_cache[i].chd_f)
+		{
+			cache = &chd_cache[i];
+			break;
+		}
+	}
+
+	if (cache && chd_cache_alloc(cache, header)) cache->chd_f = toc->chd_f;
+	else cache = NULL;
+	pthread_mutex_unlock(&chd_cache_lock);
+
+	if (!cache)
+	{
+		chd_close(toc->chd_f);
+		toc->chd_f = NULL;
+		return CHDERR_OUT_OF_MEMORY;
+	}
+
+	return CHDERR_NONE;
+}
+
+void cd_chd_close(chd_file *chd_f)
+{
+	if (!chd_f) return;
+
+	pthread_mutex_lock(&chd_cache_lock);
+	for (int i = 0; i < CD_CHD_MAX; i++)
+	{
+		chd_cache_t *cache = &chd_cache[i];
+		if (cache->chd_f == chd_f)
+		{
+			// prefetch work references the cache
+			pthread_mutex_lock(&cache->lock);
+			while (cache->inflight) pthread_cond_wait(&cache->cond, &cache->lock);
+			pthread_mutex_unlock(&cache->lock);
+
+			uint64_t total = cache->hits + cache->misses;
+			printf("\x1b[32mCHD cache: %llu hits, %llu misses (%llu%% hit rate), %llu hunks prefetched\n\x1b[0m",
+				(unsigned long long)cache->hits, (unsigned long long)cache->misses,
+				total ? (unsigned long long)(cache->hits * 100 / total) : 0ULL,
+				(unsigned long long)cache->prefetched);
+
+			chd_cache_free(cache);
+		}
+	}
+	pthread_mutex_unlock(&chd_cache_lock);
+
+	chd_close(chd_f);
+}
+
+// cache->lock must be held, returns slot holding the hunk or -1 on read error
+static int chd_cache_lookup(chd_cache_t *cache, int hunknum)
+{
+	cache->stamp++;
+
+	bool counted = false;
+	int slot;
+	while (true)
+	{
+		slot = chd_cache_find(cache, hunknum);
+		if (slot >= 0 && cache->loading[slot] == CHD_SLOT_READY) break;
+
+		// Hunk is being decompressed, or all slots are. Queued prefetch is taken over instead of
+		// waiting for it: the caller may be the worker that would run it.
+		if (slot >= 0 && cache->loading[slot] == CHD_SLOT_QUEUED) chd_cache_cancel(cache, slot, hunknum);
+		else if (slot >= 0 || (slot = chd_cache_victim(cache, true)) < 0)
+		{
+			pthread_cond_wait(&cache->cond, &cache->lock);
+			continue;
+		}
+
+		cache->misses++;
+		counted = true;
+
+		cache->hunknum[slot] = hunknum;
+		cache->used[slot] = cache->stamp;
+		cache->loading[slot] = CHD_SLOT_BUSY;
+		pthread_mutex_unlock(&cache->lock);
+
+		bool ok = chd_cache_load(cache, slot, hunknum);
+
+		pthread_mutex_lock(&cache->lock);
+		if (!ok) return -1;
+	}
+
+	if (!counted) cache->hits++;
+	cache->last = slot;
+	cache->used[slot] = cache->stamp;
+	return slot;
+}
+
+// cache->lock must be held, returns number of hunks to prefetch after hunknum
+static int chd_cache_stream(chd_cache_t *cache, int hunknum)
+{
+	// reads are mostly sequential: keep next hunk ready, more of them once a stream is seen
+	int prefetch = 0;
+	if (hunknum != cache->cur_hunk && cache->slots > CD_CHD_PREFETCH + 1)
+	{
+		prefetch = (hunknum == cache->cur_hunk + 1) ? CD_CHD_PREFETCH : 1;
+		cache->cur_hunk = hunknum;
+	}
+
+	return prefetch;
+}
+
+// copy count frames starting from lba, taking every hunk once
+static chd_error chd_cache_read(chd_file *chd_f, int lba, int count, int offset, int length, uint8_t *buf, int stride)
+{
+	chd_cache_t *cache = chd_cache_get(chd_f);
+	if (!cache || lba < 0) return CHDERR_INVALID_PARAMETER;
+
+	while (count > 0)
+	{
+		int hunknum = lba / cache->sectors_per_hunk;
+		int frame = lba % cache->sectors_per_hunk;
+		int n = cache->sectors_per_hunk - frame;
+		if (n > count) n = count;
+
+		pthread_mutex_lock(&cache->lock);
+
+		int slot = chd_cache_lookup(cache, hunknum);
+		if (slot < 0)
+		{
+			pthread_mutex_unlock(&cache->lock);
+			return CHDERR_DECOMPRESSION_ERROR;
+		}
+
+		const uint8_t *src = cache->buf + (size_t)slot * cache->hunkbytes + (frame * CD_FRAME_SIZE) + offset;
+		for (int i = 0; i < n; i++, src += CD_FRAME_SIZE, buf += stride) memcpy(buf, src, length);
+
+		int prefetch = chd_cache_stream(cache, hunknum);
+		pthread_mutex_unlock(&cache->lock);
+
+		for (int i = 1; i <= prefetch; i++) chd_cache_prefetch(cache, hunknum + i);
+
+		lba += n;
+		count -= n;
+	}
+
+	return CHDERR_NONE;
+}
+
+chd_error cd_chd_read(chd_file *chd_f, int lba, int offset, int length, uint8_t *buf)
+{
+	return chd_cache_read(chd_f, lba, 1, offset, length, buf, length);
+}
+
+chd_error cd_chd_read_sectors(chd_file *chd_f, int lba, int count, bool cdda, uint8_t *buf)
+{
+	chd_error err = chd_cache_read(chd_f, lba, count, 0, CD_MAX_SECTOR_DATA, buf, CD_MAX_SECTOR_DATA);
+
+	// CHD keeps audio big endian
+	if (err == CHDERR_NONE && cdda) cd_cdda_mix((int16_t *)buf, count * CD_MAX_SECTOR_DATA / 2, 256, 256, true);
+	return err;
+}
+
+chd_error cd_chd_read_sector(chd_file *chd_f, int lba, cd_read_t mode, int data_offset, uint8_t *buf)
+{
+	switch (mode)
+	{
+	case CD_READ_COOKED:
+		return cd_chd_read(chd_f, lba, data_offset, 2048, buf);
+
+	case CD_READ_SUBCODE:
+		return cd_chd_read(chd_f, lba, CD_MAX_SECTOR_DATA, 96, buf);
+
+	case CD_READ_CDDA:
+	{
+		chd_error err = cd_chd_read(chd_f, lba, 0, CD_MAX_SECTOR_DATA, buf);
+
+		// CHD keeps audio big endian
+		if (err == CHDERR_NONE) cd_cdda_mix((int16_t *)buf, CD_MAX_SECTOR_DATA / 2, 256, 256, true);
+		return err;
+	}
+
+	default:
+		return cd_chd_read(chd_f, lba, 0, CD_MAX_SECTOR_DATA, buf);
+	}
+}
+
+// Decoded FLAC audio is kept in a few blocks per track. Sequential reads
+// decode the following block on the offload core.
+#define CD_FLAC_BLOCK_SECTORS 16
+#define CD_FLAC_BLOCK         (CD_FLAC_BLOCK_SECTORS * CD_MAX_SECTOR_DATA)
+#define CD_FLAC_BLOCKS        4
+
+struct cd_flac_t
+{
+	fileTYPE  f;
+	__off64_t fpos;
+	drflac   *dec;
+	uint64_t  dec_frame;    // next PCM frame the decoder outputs
+	__off64_t size;         // decoded bytes
+	uint8_t  *buf;          // allocated on first read
+	int       block[CD_FLAC_BLOCKS];
+	int       len[CD_FLAC_BLOCKS];
+	uint32_t  used[CD_FLAC_BLOCKS];
+	uint32_t  stamp;
+	int       inflight;
+
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+};
+
+static size_t cd_flac_on_read(void *user, void *buf, size_t bytes)
+{
+	cd_flac_t *fl = (cd_flac_t*)user;
+	int res = FileReadAdv(&fl->f, buf, bytes);
+	if (res > 0) fl->fpos += res;
+	return (res > 0) ? res : 0;
+}
+
+static drflac_bool32 cd_flac_on_seek(void *user, int offset, drflac_seek_origin origin)
+{
+	cd_flac_t *fl = (cd_flac_t*)user;
+	__off64_t pos = (origin == drflac_seek_origin_start) ? offset : fl->fpos + offset;
+
+	// decoder relies on failing seek past the end
+	if (pos < 0 || pos > fl->f.size || !FileSeek(&fl->f, pos, SEEK_SET)) return DRFLAC_FALSE;
+
+	fl->fpos = pos;
+	return DRFLAC_TRUE;
+}
+
+static void cd_flac_close(cd_flac_t *fl)
+{
+	if (!fl) return;
+
+	pthread_mutex_lock(&fl->lock);
+	while (fl->inflight) pthread_cond_wait(&fl->cond, &fl->lock);
+	pthread_mutex_unlock(&fl->lock);
+
+	drflac_close(fl->dec);
+	FileClose(&fl->f);
+	free(fl->buf);
+	pthread_mutex_destroy(&fl->lock);
+	pthread_cond_destroy(&fl->cond);
+	delete fl;
+}
+
+static cd_flac_t *cd_flac_open(const char *path)
+{
+	cd_flac_t *fl = new cd_flac_t();
+
+	// own file, so decoding on the offload core doesn't share the position with the driver
+	if (!FileOpen(&fl->f, path))
+	{
+		delete fl;
+		return NULL;
+	}
+
+	pthread_mutex_init(&fl->lock, NULL);
+	pthread_cond_init(&fl->cond, NULL);
+	for (int i = 0; i < CD_FLAC_BLOCKS; i++) fl->block[i] = -1;
+
+	fl->dec = drflac_open(cd_flac_on_read, cd_flac_on_seek, fl, NULL);
+	if (!fl->dec || fl->dec->channels != 2 || fl->dec->sampleRate != 44100)
+	{
+		printf("\x1b[32mCD: unsupported FLAC (need 44.1kHz stereo): %s\n\x1b[0m", path);
+		cd_flac_close(fl);
+		return NULL;
+	}
+
+	fl->size = (__off64_t)fl->dec->totalPCMFrameCount * 4;
+	return fl;
+}
+
+// fl->lock must be held, returns slot with decoded block or -1
+static int cd_flac_block(cd_flac_t *fl, int block)
+{
+	int slot = 0;
+	for (int i = 0; i < CD_FLAC_BLOCKS; i++)
+	{
+		if (fl->block[i] == block)
+		{
+			fl->used[i] = ++fl->stamp;
+			return i;
+		}
+
+		if (fl->used[i] < fl->used[slot]) slot = i;
+	}
+
+	if (!fl->buf && !(fl->buf = (uint8_t*)malloc(CD_FLAC_BLOCKS * CD_FLAC_BLOCK))) return -1;
+
+	uint64_t frame = (uint64_t)block * (CD_FLAC_BLOCK / 4);
+	if (frame != fl->dec_frame)
+	{
+		if (!drflac_seek_to_pcm_frame(fl->dec, frame))
+		{
+			fl->dec_frame = ~0ULL;
+			return -1;
+		}
+		fl->dec_frame = frame;
+	}
+
+	uint8_t *dst = fl->buf + (size_t)slot * CD_FLAC_BLOCK;
+	uint64_t cnt = drflac_read_pcm_frames_s16(fl->dec, CD_FLAC_BLOCK / 4, (drflac_int16*)dst);
+	fl->dec_frame += cnt;
+	if (!cnt)
+	{
+		fl->block[slot] = -1;
+		return -1;
+	}
+
+	fl->block[slot] = block;
+	fl->len[slot] = (int)cnt * 4;
+	fl->used[slot] = ++fl->stamp;
+	return slot;
+}
+
+// byte-addressed read of decoded audio, like FileReadAdv of a WAV file
+static int cd_flac_read(cd_flac_t *fl, __off64_t pos, uint8_t *buf, int len)
+{
+	if (pos < 0) return -1;
+
+	// prefetch holds the lock while decoding
+	pthread_mutex_lock(&fl->lock);
+
+	int done = 0;
+	int block = 0;
+	while (done < len)
+	{
+		block = (int)((pos + done) / CD_FLAC_BLOCK);
+		int off = (int)((pos + done) % CD_FLAC_BLOCK);
+
+		int slot = cd_flac_block(fl, block);
+		if (slot < 0 || off >= fl->len[slot]) break;
+
+		int n = fl->len[slot] - off;
+		if (n > len - done) n = len - done;
+		memcpy(buf + done, fl->buf + (size_t)slot * CD_FLAC_BLOCK + off, n);
+		done += n;
+	}
+
+	// one prefetch at a time, reads inside the current block would queue the same one again
+	int next = block + 1;
+	bool prefetch = done && !fl->inflight && ((__off64_t)next * CD_FLAC_BLOCK < fl->size);
+	for (int i = 0; prefetch && i < CD_FLAC_BLOCKS; i++) prefetch = (fl->block[i] != next);
+	if (prefetch) fl->inflight++;
+
+	pthread_mutex_unlock(&fl->lock);
+
+	// called from CDDA stream work too, so never wait for a free work slot
+	if (prefetch && !offload_try_add_work([fl, next]()
+		{
+			pthread_mutex_lock(&fl->lock);
+			cd_flac_block(fl, next);
+			fl->inflight--;
+			pthread_cond_broadcast(&fl->cond);
+			pthread_mutex_unlock(&fl->lock);
+		}, OFFLOAD_PRIO_HIGH))
+	{
+		pthread_mutex_lock(&fl->lock);
+		fl->inflight--;
+		pthread_cond_broadcast(&fl->cond);
+		pthread_mutex_unlock(&fl->lock);
+	}
+
+	return done ? done : -1;
+}
+
+int cd_track_open(cd_track_t *trk, const char *path)
+{
+	cd_flac_close(trk->flac);
+	trk->flac = NULL;
+
+	if (!FileOpen(&trk->f, path)) return 0;
+
+	int len = strlen(path);
+	if (len > 5 && !strcasecmp(path + len - 5, ".flac"))
+	{
+		trk->flac = cd_flac_open(path);
+		if (!trk->flac)
+		{
+			FileClose(&trk->f);
+			return 0;
+		}
+
+		trk->f.size = trk->flac->size;
+	}
+
+	return 1;
+}
+
+int cd_read_sector(toc_t *toc, int track, int lba, cd_read_t mode, uint8_t *buf)
+{
+	cd_track_t *trk = &toc->tracks[track];
+	int sector_size = trk->sector_size ? trk->sector_size : CD_MAX_SECTOR_DATA;
+	int data_offset = cd_data_offset(sector_size, trk->type == 2);
+
+	int len = (mode == CD_READ_COOKED) ? 2048 : (mode == CD_READ_SUBCODE) ? 96 : sector_size;
+
+	if (toc->chd_f)
+	{
+		chd_error err = (mode == CD_READ_RAW) ? cd_chd_read(toc->chd_f, lba + trk->offset, 0, len, buf) :
+			cd_chd_read_sector(toc->chd_f, lba + trk->offset, mode, data_offset, buf);
+
+		return (err == CHDERR_NONE) ? len : -1;
+	}
+
+	if (mode == CD_READ_SUBCODE)
+	{
+		if (!toc->sub.opened() || !FileSeek(&toc->sub, lba * 96, SEEK_SET)) return -1;
+		return FileReadAdv(&toc->sub, buf, len);
+	}
+
+	if (!trk->f.opened()) return -1;
+
+	__off64_t pos = ((__off64_t)lba * sector_size) - trk->offset;
+	if (mode == CD_READ_COOKED) pos += data_offset;
+
+	if (trk->flac) return cd_flac_read(trk->flac, pos, buf, len);
+	if (pos < 0) return -1;
+
+	// positioned read, track files are shared with read ahead on the offload core
+	if (trk->f.filp) return pread(fileno(trk->f.filp), buf, len, pos);
+
+	if (!FileSeek(&trk->f, pos, SEEK_SET)) return -1;
+	return FileReadAdv(&trk->f, buf, len);
+}
+
+void cd_unload(toc_t *toc)
+{
+	cd_chd_close(toc->chd_f);
+
+	for (int i = 0; i < 100; i++)
+	{
+		cd_flac_close(toc->tracks[i].flac);
+		if (toc->tracks[i].f.opened()) FileClose(&toc->tracks[i].f);
+	}
+
+	if (toc->sub.opened()) FileClose(&toc->sub);
+
+	memset(toc, 0, sizeof(toc_t));
+}
+
+// TOC cache file: header, track records, then sub file record
+#define CD_TOC_MAGIC   0x434F5443
+#define CD_TOC_VERSION 1
+#define CD_TOC_DIR     "cdtoc"
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	char     tag[8];
+	uint64_t size;
+	int64_t  mtime;
+	int32_t  end;
+	int32_t  last;
+	int32_t  sectorSize;
+	int32_t  chd_hunksize;
+	int32_t  tracks;
+	char     path[1024];
+} cd_toc_hdr_t;
+
+typedef struct
+{
+	int32_t  offset;
+	int32_t  pregap;
+	int32_t  start;
+	int32_t  end;
+	int32_t  type;
+	int32_t  sector_size;
+	int32_t  indexes[100];
+	int32_t  index_num;
+	int32_t  sbc_type;
+	int64_t  file_size; // -1 if track has no file opened
+	char     file[1024];
+} cd_toc_track_t;
+
+// records start 8 byte aligned
+#define CD_TOC_ALIGN(x) (((x) + 7) & ~7)
+#define CD_TOC_MAX_SIZE (sizeof(cd_toc_hdr_t) + (100 + 1) * sizeof(cd_toc_track_t))
+
+static const char *cd_toc_name(const char *filename, const char *tag)
+{
+	static char name[64];
+	uint32_t crc = crc32(0, (const uint8_t*)tag, strlen(tag));
+	crc = crc32(crc, (const uint8_t*)filename, strlen(filename));
+	sprintf(name, CD_TOC_DIR "/%08X.bin", crc);
+	return name;
+}
+
+static bool cd_toc_stat(const char *filename, uint64_t *size, int64_t *mtime)
+{
+	struct stat64 *st = getPathStat(filename);
+	if (!st || !S_ISREG(st->st_mode)) return false;
+
+	*size = st->st_size;
+	*mtime = st->st_mtime;
+	return true;
+}
+
+// file records are variable length, path is stored up to its terminator
+static int cd_toc_put_file(cd_toc_track_t *rec, fileTYPE *f)
+{
+	rec->file_size = -1;
+	rec->file[0] = 0;
+
+	if (f->opened())
+	{
+		// only plain files can be reopened by path
+		if (!f->filp) return -1;
+
+		char link[32];
+		sprintf(link, "/proc/self/fd/%d", fileno(f->filp));
+		int len = readlink(link, rec->file, sizeof(rec->file) - 1);
+		if (len <= 0) return -1;
+
+		rec->file[len] = 0;
+		rec->file_size = f->size;
+	}
+
+	return CD_TOC_ALIGN(offsetof(cd_toc_track_t, file) + strlen(rec->file) + 1);
+}
+
+static int cd_toc_get_file(const cd_toc_track_t *rec, int avail, fileTYPE *f, cd_track_t *trk)
+{
+	int len = offsetof(cd_toc_track_t, file);
+	if (avail <= len) return -1;
+
+	const char *end = (const char*)memchr(rec->file, 0, avail - len);
+	if (!end) return -1;
+	len = CD_TOC_ALIGN(len + (end - rec->file) + 1);
+
+	if (rec->file_size >= 0)
+	{
+		if (!(trk ? cd_track_open(trk, rec->file) : FileOpenEx(f, rec->file, O_RDONLY, 1)) || f->size != rec->file_size) return -1;
+	}
+
+	return len;
+}
+
+int cd_toc_load(const char *filename, const char *tag, toc_t *toc)
+{
+	uint64_t size;
+	int64_t mtime;
+	if (!cd_toc_stat(filename, &size, &mtime)) return 0;
+
+	char path[256];
+	sprintf(path, CONFIG_DIR "/%s", cd_toc_name(filename, tag));
+
+	fileTYPE f;
+	if (!FileOpenEx(&f, path, O_RDONLY, 1)) return 0;
+
+	int len = (f.size < (__off64_t)CD_TOC_MAX_SIZE) ? (int)f.size : 0;
+	uint8_t *buf = len ? (uint8_t*)malloc(len) : NULL;
+	if (buf && FileReadAdv(&f, buf, len) != len) len = 0;
+	FileClose(&f);
+
+	cd_toc_hdr_t *hdr = (cd_toc_hdr_t*)buf;
+	bool ok = buf && len > (int)sizeof(cd_toc_hdr_t) &&
+		hdr->magic == CD_TOC_MAGIC && hdr->version == CD_TOC_VERSION &&
+		!strncmp(hdr->tag, tag, sizeof(hdr->tag)) && hdr->size == size && hdr->mtime == mtime &&
+		!strncmp(hdr->path, filename, sizeof(hdr->path)) && hdr->tracks > 0 && hdr->tracks <= 100;
+
+	if (ok)
+	{
+		toc->end = hdr->end;
+		toc->last = hdr->last;
+		toc->sectorSize = hdr->sectorSize;
+		toc->chd_hunksize = hdr->chd_hunksize;
+
+		int pos = sizeof(cd_toc_hdr_t);
+		for (int i = 0; ok && i <= hdr->tracks; i++)
+		{
+			const cd_toc_track_t *rec = (const cd_toc_track_t*)(buf + pos);
+			bool sub = (i == hdr->tracks);
+
+			int n = cd_toc_get_file(rec, len - pos, sub ? &toc->sub : &toc->tracks[i].f, sub ? NULL : &toc->tracks[i]);
+			if (n < 0)
+			{
+				ok = false;
+				break;
+			}
+			pos += n;
+
+			if (sub) break;
+
+			cd_track_t *trk = &toc->tracks[i];
+			trk->offset = rec->offset;
+			trk->pregap = rec->pregap;
+			trk->start = rec->start;
+			trk->end = rec->end;
+			trk->type = rec->type;
+			trk->sector_size = rec->sector_size;
+			memcpy(trk->indexes, rec->indexes, sizeof(trk->indexes));
+			trk->index_num = rec->index_num;
+			trk->sbc_type = (cd_subcode_types_t)rec->sbc_type;
+		}
+	}
+
+	free(buf);
+
+	if (!ok)
+	{
+		// stale or damaged, parse the image
+		cd_unload(toc);
+		return 0;
+	}
+
+	printf("\x1b[32mCD: TOC of %s from cache\n\x1b[0m", filename);
+	return 1;
+}
+
+void cd_toc_save(const char *filename, const char *tag, toc_t *toc)
+{
+	uint64_t size;
+	int64_t mtime;
+	if (toc->last <= 0 || strlen(filename) >= sizeof(cd_toc_hdr_t::path) || !cd_toc_stat(filename, &size, &mtime)) return;
+
+	uint8_t *buf = (uint8_t*)calloc(1, CD_TOC_MAX_SIZE);
+	if (!buf) return;
+
+	// drivers may keep the lead-out in tracks[last]
+	int tracks = (toc->last < 99) ? toc->last + 1 : 100;
+
+	cd_toc_hdr_t *hdr = (cd_toc_hdr_t*)buf;
+	hdr->magic = CD_TOC_MAGIC;
+	hdr->version = CD_TOC_VERSION;
+	strncpy(hdr->tag, tag, sizeof(hdr->tag));
+	hdr->size = size;
+	hdr->mtime = mtime;
+	hdr->end = toc->end;
+	hdr->last = toc->last;
+	hdr->sectorSize = toc->sectorSize;
+	hdr->chd_hunksize = toc->chd_hunksize;
+	hdr->tracks = tracks;
+	strcpy(hdr->path, filename);
+
+	int pos = sizeof(cd_toc_hdr_t);
+	for (int i = 0; i <= tracks; i++)
+	{
+		cd_toc_track_t *rec = (cd_toc_track_t*)(buf + pos);
+		bool sub = (i == tracks);
+
+		int n = cd_toc_put_file(rec, sub ? &toc->sub : &toc->tracks[i].f);
+		if (n < 0)
+		{
+			free(buf);
+			return;
+		}
+
+		if (!sub)
+		{
+			cd_track_t *trk = &toc->tracks[i];
+			rec->offset = trk->offset;
+			rec->pregap = trk->pregap;
+			rec->start = trk->start;
+			rec->end = trk->end;
+			rec->type = trk->type;
+			rec->sector_size = trk->sector_size;
+			memcpy(rec->indexes, trk->indexes, sizeof(rec->indexes));
+			rec->index_num = trk->index_num;
+			rec->sbc_type = trk->sbc_type;
+		}
+
+		pos += n;
+	}
+
+	FileSaveConfig(cd_toc_name(filename, tag), buf, pos);
+	free(buf);
+}
+
+// stream->lock is not held, the frame is owned by the caller
+static bool cdda_read_frame(toc_t *toc, int track, int lba, uint8_t *buf)
+{
+	cd_track_t *trk = &toc->tracks[track];
+	if (toc->chd_f) return cd_chd_read_sector(toc->chd_f, lba + trk->offset, CD_READ_CDDA, 0, buf) == CHDERR_NONE;
+
+	// positional read doesn't disturb the file position the driver keeps
+	int sector_size = trk->sector_size ? trk->sector_size : CD_MAX_SECTOR_DATA;
+	__off64_t pos = ((__off64_t)lba * sector_size) - trk->offset;
+	if (trk->flac) return cd_flac_read(trk->flac, pos, buf, 2352) == 2352;
+	return pread(fileno(trk->f.filp), buf, 2352, pos) == 2352;
+}
+
+static bool cdda_can_prefetch(cd_cdda_stream_t *stream)
+{
+	toc_t *toc = stream->toc;
+	return (toc->chd_f || toc->tracks[stream->track].f.filp || toc->tracks[stream->track].flac) &&
+		stream->next_lba < stream->read_lba + CD_CDDA_RING &&
+		stream->next_lba < toc->tracks[stream->track].end;
+}
+
+static void cdda_prefetch(cd_cdda_stream_t *stream)
+{
+	pthread_mutex_lock(&stream->lock);
+	while (cdda_can_prefetch(stream))
+	{
+		// a seek may happen while the frame is read, it's checked after
+		uint32_t gen = stream->gen;
+		toc_t *toc = stream->toc;
+		int track = stream->track;
+		int lba = stream->next_lba;
+		int slot = lba % CD_CDDA_RING;
+
+		// frame in this slot is behind the poll position already
+		stream->frame_lba[slot] = -1;
+		pthread_mutex_unlock(&stream->lock);
+
+		bool ok = cdda_read_frame(toc, track, lba, stream->frame[slot]);
+
+		pthread_mutex_lock(&stream->lock);
+
+		// stale frame is dropped, the loop goes on from the new position
+		if (gen == stream->gen)
+		{
+			if (ok) stream->frame_lba[slot] = lba;
+			stream->next_lba++;
+		}
+		pthread_cond_broadcast(&stream->cond);
+	}
+
+	stream->busy = false;
+	pthread_cond_broadcast(&stream->cond);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+// stream->lock must be held
+static void cdda_wait_idle(cd_cdda_stream_t *stream)
+{
+	while (stream->busy) pthread_cond_wait(&stream->cond, &stream->lock);
+}
+
+bool cd_cdda_read(cd_cdda_stream_t *stream, toc_t *toc, int track, int lba, uint8_t *buf)
+{
+	if (!stream->init)
+	{
+		memset(stream, 0, sizeof(cd_cdda_stream_t));
+		pthread_mutex_init(&stream->lock, NULL);
+		pthread_cond_init(&stream->cond, NULL);
+		stream->init = true;
+	}
+
+	// pregap before the first track
+	if (lba < 0) return cd_read_sector(toc, track, lba, CD_READ_CDDA, buf) > 0;
+
+	pthread_mutex_lock(&stream->lock);
+
+	// seek or track change: start over
+	bool seek = stream->toc != toc || stream->track != track || lba < stream->read_lba || lba > stream->next_lba;
+	if (seek)
+	{
+		// running prefetch stops using the old position after its current frame
+		stream->gen++;
+		stream->toc = toc;
+		stream->track = track;
+		stream->next_lba = lba;
+		for (int i = 0; i < CD_CDDA_RING; i++) stream->frame_lba[i] = -1;
+	}
+	stream->read_lba = lba;
+	stream->frames++;
+
+	bool ok = true;
+	int slot = lba % CD_CDDA_RING;
+	while (stream->frame_lba[slot] != lba)
+	{
+		if (!stream->busy || seek)
+		{
+			// not read ahead (first frame after seek, read error or past the track end)
+			if (lba == stream->next_lba) stream->next_lba++;
+			if (!seek) stream->underruns++;
+			ok = cd_read_sector(toc, track, lba, CD_READ_CDDA, buf) > 0;
+			break;
+		}
+
+		pthread_cond_wait(&stream->cond, &stream->lock);
+	}
+
+	if (stream->frame_lba[slot] == lba) memcpy(buf, stream->frame[slot], 2352);
+
+	bool start = !stream->busy && cdda_can_prefetch(stream);
+	if (start) stream->busy = true;
+	pthread_mutex_unlock(&stream->lock);
+
+	// never wait for a free work slot on the poll path, next frame is read synchronously then
+	if (start && !offload_try_add_work([stream]() { cdda_prefetch(stream); }, OFFLOAD_PRIO_HIGH))
+	{
+		pthread_mutex_lock(&stream->lock);
+		stream->busy = false;
+		pthread_cond_broadcast(&stream->cond);
+		pthread_mutex_unlock(&stream->lock);
+	}
+
+	return ok;
+}
+
+void cd_cdda_stop(cd_cdda_stream_t *stream)
+{
+	if (!stream->init) return;
+
+	pthread_mutex_lock(&stream->lock);
+	cdda_wait_idle(stream);
+	if (stream->frames) printf("\x1b[32mCDDA: %u frames, %u underruns\n\x1b[0m", stream->frames, stream->underruns);
+	stream->frames = 0;
+	stream->underruns = 0;
+	stream->toc = NULL;
+	for (int i = 0; i < CD_CDDA_RING; i++) stream->frame_lba[i] = -1;
+	pthread_mutex_unlock(&stream->lock);
+}
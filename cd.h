@@ -2,6 +2,7 @@
 #define CD_H
 
 #include <libchdr/chd.h>
+#include <pthread.h>
 #include "file_io.h"
 
 
@@ -10,9 +11,12 @@ typedef enum
         SUBCODE_NONE = 0, SUBCODE_RW, SUBCODE_RW_RAW
 } cd_subcode_types_t;
 
+struct cd_flac_t;
+
 typedef struct
 {
 	fileTYPE f;
+	cd_flac_t *flac;
 	int offset;
 	int pregap;
 	int start;
@@ -64,4 +68,79 @@ typedef struct
 
 typedef int (*SendDataFunc) (uint8_t* buf, int len, uint8_t index);
 
+// CD image layer shared by all CD drivers (MegaCD, PCECD, Saturn, PSX, ATAPI).
+// Drivers keep their own TOC conventions, sector access goes through here.
+
+typedef enum
+{
+	CD_READ_RAW = 0,  // whole sector as stored (sector_size bytes)
+	CD_READ_COOKED,   // 2048 bytes of user data
+	CD_READ_CDDA,     // 2352 bytes of 16 bit little endian stereo samples
+	CD_READ_SUBCODE   // 96 bytes of P-W subchannel data (CHD only)
+} cd_read_t;
+
+// CUE sheet parsing
+int cd_sgets(char *out, int sz, char **in);
+const char *cd_cue_file(char *path, int size, const char *arg);
+
+// offset of user data within a stored sector of given track
+int cd_data_offset(int sector_size, int mode2);
+
+// CHD images. Hunk cache is kept per opened image.
+chd_error cd_chd_open(const char *filename, toc_t *toc);
+void cd_chd_close(chd_file *chd_f);
+chd_error cd_chd_read(chd_file *chd_f, int lba, int offset, int length, uint8_t *buf);
+chd_error cd_chd_read_sector(chd_file *chd_f, int lba, cd_read_t mode, int data_offset, uint8_t *buf);
+
+// count consecutive 2352 byte sectors (byteswapped to little endian if cdda)
+chd_error cd_chd_read_sectors(chd_file *chd_f, int lba, int count, bool cdda, uint8_t *buf);
+
+// open track file of CUE sheet. FLAC files are decoded on read, f.size is
+// the decoded size then, so track tables are built the same way as for BIN/WAV.
+int cd_track_open(cd_track_t *trk, const char *path);
+
+// sector-addressed read of track, CHD (lba + offset) or track file (lba * sector_size - offset)
+int cd_read_sector(toc_t *toc, int track, int lba, cd_read_t mode, uint8_t *buf);
+
+// close CHD/track/subcode files and clear the TOC
+void cd_unload(toc_t *toc);
+
+// Parsed TOC cache in config/cdtoc, keyed by image path, size and mtime.
+// tag tells apart drivers keeping different TOC conventions for the same image.
+// Load returns 1 with track/subcode files opened, 0 if the image must be parsed.
+int cd_toc_load(const char *filename, const char *tag, toc_t *toc);
+void cd_toc_save(const char *filename, const char *tag, toc_t *toc);
+
+// CDDA read ahead. Frames following the one played are read and decoded on the
+// offload core, so the poll path only copies them. If a frame is not ready yet
+// (underrun) it's read synchronously as before.
+#define CD_CDDA_RING 8
+
+typedef struct
+{
+	toc_t   *toc;
+	int      track;
+	int      read_lba;   // last frame taken by the poll path
+	int      next_lba;   // next frame to read ahead
+	int      frame_lba[CD_CDDA_RING];
+	uint8_t  frame[CD_CDDA_RING][2352];
+	uint32_t gen;        // bumped on seek, frames read for an older one are dropped
+	bool     busy;
+	bool     init;
+	uint32_t frames;
+	uint32_t underruns;
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+} cd_cdda_stream_t;
+
+// get CDDA frame of track (little endian samples). Returns false if it cannot be read.
+bool cd_cdda_read(cd_cdda_stream_t *stream, toc_t *toc, int track, int lba, uint8_t *buf);
+
+// wait for read ahead to finish and drop buffered frames, must be called before the image is closed
+void cd_cdda_stop(cd_cdda_stream_t *stream);
+
+// CDDA post processing in place: optional byteswap and volume of first/second
+// sample of each frame in 8.8 fixed point (256 = unchanged)
+void cd_cdda_mix(int16_t *buf, int samples, int vol0, int vol1, bool swap);
+
 #endif
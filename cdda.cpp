@@ -0,0 +1,61 @@
+// CDDA sample processing of the CD image layer (cd.h)
+
+#include <inttypes.h>
+#include <byteswap.h>
+
+#include "cd.h"
+
+#if defined(__ARM_NEON) || defined(__arm__)
+#include <arm_neon.h>
+#define CD_NEON
+#endif
+
+#ifdef CD_NEON
+// HPS has NEON, but the toolchain default FPU doesn't include it
+#if defined(__arm__) && !defined(__ARM_NEON)
+__attribute__((target("fpu=neon")))
+#endif
+static int cdda_mix_neon(int16_t *buf, int samples, int vol0, int vol1, bool swap)
+{
+	const int16x4_t vol = { (int16_t)vol0, (int16_t)vol1, (int16_t)vol0, (int16_t)vol1 };
+	const bool scale = (vol0 != 256) || (vol1 != 256);
+
+	int i = 0;
+	for (; i + 8 <= samples; i += 8)
+	{
+		int16x8_t v = vld1q_s16(buf + i);
+		if (swap) v = vreinterpretq_s16_u8(vrev16q_u8(vreinterpretq_u8_s16(v)));
+		if (scale)
+		{
+			int32x4_t lo = vmull_s16(vget_low_s16(v), vol);
+			int32x4_t hi = vmull_s16(vget_high_s16(v), vol);
+			v = vcombine_s16(vshrn_n_s32(lo, 8), vshrn_n_s32(hi, 8));
+		}
+		vst1q_s16(buf + i, v);
+	}
+
+	return i;
+}
+#endif
+
+// samples from..samples, tail of the NEON pass or all of them on other targets
+static void cdda_mix_scalar(int16_t *buf, int from, int samples, int vol0, int vol1, bool swap)
+{
+	for (int i = from; i < samples; i++)
+	{
+		int16_t v = swap ? (int16_t)bswap_16((uint16_t)buf[i]) : buf[i];
+		buf[i] = (int16_t)((v * ((i & 1) ? vol1 : vol0)) >> 8);
+	}
+}
+
+void cd_cdda_mix(int16_t *buf, int samples, int vol0, int vol1, bool swap)
+{
+	if (!swap && vol0 == 256 && vol1 == 256) return;
+
+	int i = 0;
+#ifdef CD_NEON
+	i = cdda_mix_neon(buf, samples, vol0, vol1, swap);
+#endif
+
+	cdda_mix_scalar(buf, i, samples, vol0, vol1, swap);
+}
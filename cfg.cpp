@@ -131,6 +131,10 @@ static const ini_var_t ini_vars[] =
 	{ "OSD_LOCK_TIME", (void*)(&(cfg.osd_lock_time)), UINT16, 0, 60 },
 	{ "DEBUG", (void *)(&(cfg.debug)), UINT8, 0, 1 },
 	{ "MAIN", (void*)(&(cfg.main)), STRING, 0, sizeof(cfg.main) - 1 },
+	{ "FPGA_POLL_LATENCY", (void*)(&(cfg.fpga_poll_latency)), UINT16, 0, 50000 },
+	{ "IO_THREAD", (void*)(&(cfg.io_thread)), UINT8, 0, 1 },
+	{ "INPUT_THREAD", (void*)(&(cfg.input_thread)), UINT8, 0, 1 },
+	{ "CHD_CACHE_SIZE", (void*)(&(cfg.chd_cache_size)), UINT16, 0, 32768 },
 };
 
 static const int nvars = (int)(sizeof(ini_vars) / sizeof(ini_var_t));
@@ -585,6 +589,7 @@ void cfg_parse()
 	cfg.hdr = 0;
 	cfg.hdr_max_nits = 1000;
 	cfg.hdr_avg_nits = 250;
+	cfg.chd_cache_size = 1024;
 	cfg.video_brightness = 50;
 	cfg.video_contrast = 50;
 	cfg.video_saturation = 100;
@@ -99,6 +99,10 @@ typedef struct {
 	uint16_t osd_lock_time;
 	char debug;
 	char main[1024];
+	uint16_t fpga_poll_latency;
+	uint8_t io_thread;
+	uint8_t input_thread;
+	uint16_t chd_cache_size;
 } cfg_t;
 
 extern cfg_t cfg;
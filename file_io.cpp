@@ -32,6 +32,7 @@
 #include "scheduler.h"
 #include "video.h"
 #include "support.h"
+#include "vhd.h"
 
 #define MIN(a,b) (((a)<(b)) ? (a) : (b))
 
@@ -72,6 +73,7 @@ fileTYPE::fileTYPE()
 	mode = 0;
 	type = 0;
 	zip = 0;
+	vhd = 0;
 	size = 0;
 	offset = 0;
 }
@@ -291,6 +293,12 @@ void FileClose(fileTYPE *file)
 		delete file->zip;
 	}
 
+	if (file->vhd)
+	{
+		vhd_close(file->vhd);
+		file->vhd = nullptr;
+	}
+
 	if (file->filp)
 	{
 		//printf("closing %p\n", file->filp);
@@ -513,7 +521,11 @@ int FileOpenEx(fileTYPE *file, const char *name, int mode, char mute, int use_zi
 
 __off64_t FileGetSize(fileTYPE *file)
 {
-	if (file->filp)
+	if (file->vhd)
+	{
+		return file->size;
+	}
+	else if (file->filp)
 	{
 		struct stat64 st;
 		if (fstat64(fileno(file->filp), &st) < 0) return 0;
@@ -540,9 +552,40 @@ int FileOpen(fileTYPE *file, const char *name, char mute)
 	return FileOpenEx(file, name, O_RDONLY, mute);
 }
 
+int FileMountVHD(fileTYPE *file)
+{
+	if (!file->filp || file->vhd) return 1;
+
+	__off64_t size = 0;
+	int ret = vhd_open(fileno(file->filp), file->size, &file->vhd, &size);
+	if (ret < 0)
+	{
+		printf("FileMountVHD: %s is not usable.\n", file->name);
+		return 0;
+	}
+
+	if (ret)
+	{
+		file->size = size;
+		file->offset = 0;
+	}
+	return 1;
+}
+
 int FileSeek(fileTYPE *file, __off64_t offset, int origin)
 {
-	if (file->filp)
+	if (file->vhd)
+	{
+		if (origin == SEEK_CUR) offset += file->offset;
+		else if (origin == SEEK_END) offset += file->size;
+
+		if (offset < 0)
+		{
+			printf("Fail to seek the file: offset=%lld, %s.\n", offset, file->name);
+			return 0;
+		}
+	}
+	else if (file->filp)
 	{
 		__off64_t res = fseeko64(file->filp, offset, origin);
 		if (res < 0)
@@ -613,7 +656,16 @@ int FileReadAdv(fileTYPE *file, void *pBuffer, int length, int failres)
 {
 	ssize_t ret = 0;
 
-	if (file->filp)
+	if (file->vhd)
+	{
+		ret = vhd_read(file->vhd, file->offset, pBuffer, length);
+		if (ret < 0)
+		{
+			printf("FileReadAdv error(%d).\n", ret);
+			return failres;
+		}
+	}
+	else if (file->filp)
 	{
 		ret = fread(pBuffer, 1, length, file->filp);
 		if (ret < 0)
@@ -653,7 +705,19 @@ int FileWriteAdv(fileTYPE *file, void *pBuffer, int length, int failres)
 {
 	int ret;
 
-	if (file->filp)
+	if (file->vhd)
+	{
+		ret = vhd_write(file->vhd, file->offset, pBuffer, length);
+		if (ret < 0)
+		{
+			printf("FileWriteAdv error(%d).\n", ret);
+			return failres;
+		}
+
+		file->offset += ret;
+		return ret;
+	}
+	else if (file->filp)
 	{
 		ret = fwrite(pBuffer, 1, length, file->filp);
 		fflush(file->filp);
@@ -9,6 +9,7 @@
 #include "spi.h"
 
 struct fileZipArchive;
+struct fileVHD;
 
 struct fileTYPE
 {
@@ -20,6 +21,7 @@ struct fileTYPE
 	int             mode;
 	int             type;
 	fileZipArchive *zip;
+	fileVHD        *vhd;
 	__off64_t       size;
 	__off64_t       offset;
 	char            path[1024];
@@ -83,6 +85,7 @@ int  isUSBMounted();
 int  FileOpenZip(fileTYPE *file, const char *name, uint32_t crc32);
 int  FileOpenEx(fileTYPE *file, const char *name, int mode, char mute = 0, int use_zip = 1);
 int  FileOpen(fileTYPE *file, const char *name, char mute = 0);
+int  FileMountVHD(fileTYPE *file); // use dynamic VHD block map if file is one, 0 if VHD is unusable
 void FileClose(fileTYPE *file);
 
 __off64_t FileGetSize(fileTYPE *file);
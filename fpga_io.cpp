@@ -8,6 +8,7 @@
 #include <termios.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "fpga_io.h"
 #include "file_io.h"
@@ -16,6 +17,8 @@
 #include "menu.h"
 #include "shmem.h"
 #include "offload.h"
+#include "iothread.h"
+#include "ide.h"
 
 #include "fpga_base_addr_ac5.h"
 #include "fpga_manager.h"
@@ -429,6 +432,8 @@ int fpga_load_rbf(const char *name, const char *cfg, const char *xml)
 
 	if(cfg)
 	{
+		// io thread must not poll the bridge while it's down
+		iothread_stop();
 		fpga_core_reset(1);
 		make_env(name, cfg);
 		do_bridge(0);
@@ -469,6 +474,8 @@ int fpga_load_rbf(const char *name, const char *cfg, const char *xml)
 			}
 			else
 			{
+				// from here app_restart follows in any case, io thread must not poll the FPGA being reprogrammed
+				iothread_stop();
 				fpga_core_reset(1);
 				if (read(rbf, buf, st.st_size)<st.st_size)
 				{
@@ -505,6 +512,14 @@ int fpga_load_rbf(const char *name, const char *cfg, const char *xml)
 	return ret;
 }
 
+// GPO register is shared by SPI chip selects, data strobe and control bits.
+// The bus is owned by one thread from the first asserted chip select till the
+// last one is released. Other read-modify-write accesses take the same lock.
+static pthread_mutex_t gpo_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static thread_local int gpo_cs_held = 0;
+
+#define SSPI_CS_MASK ((1<<18) | (1<<19) | (1<<20))
+
 static uint32_t gpo_copy = 0;
 void inline fpga_gpo_write(uint32_t value)
 {
@@ -538,11 +553,13 @@ int fpga_io_init()
 
 int fpga_core_id()
 {
+	pthread_mutex_lock(&gpo_lock);
 	uint32_t gpo = (fpga_gpo_read() & 0x7FFFFFFF);
 	fpga_gpo_write(gpo);
 	uint32_t coretype = fpga_gpi_read();
 	gpo |= 0x80000000;
 	fpga_gpo_write(gpo);
+	pthread_mutex_unlock(&gpo_lock);
 
 	if ((coretype >> 8) != 0x5CA623) return -1;
 	return coretype & 0xFF;
@@ -560,28 +577,36 @@ int fpga_get_io_version()
 
 void fpga_set_led(uint32_t on)
 {
+	pthread_mutex_lock(&gpo_lock);
 	uint32_t gpo = fpga_gpo_read();
 	fpga_gpo_write(on ? gpo | 0x20000000 : gpo & ~0x20000000);
+	pthread_mutex_unlock(&gpo_lock);
 }
 
 int fpga_get_buttons()
 {
+	pthread_mutex_lock(&gpo_lock);
 	fpga_gpo_write(fpga_gpo_read() | 0x80000000);
 	int gpi = fpga_gpi_read();
+	pthread_mutex_unlock(&gpo_lock);
 	if (gpi < 0) gpi = 0; // FPGA is not in user mode. Ignore the data;
 	return (gpi >> 29) & 3;
 }
 
 int fpga_get_io_type()
 {
+	pthread_mutex_lock(&gpo_lock);
 	fpga_gpo_write(fpga_gpo_read() | 0x80000000);
-	return (fpga_gpi_read() >> 28) & 1;
+	int gpi = fpga_gpi_read();
+	pthread_mutex_unlock(&gpo_lock);
+	return (gpi >> 28) & 1;
 }
 
 void reboot(int cold)
 {
-	sync();
 	fpga_core_reset(1);
+	ide_flush_all();
+	sync();
 
 	usleep(500000);
 
@@ -612,12 +637,14 @@ char *getappname()
 
 void app_restart(const char *path, const char *xml, const char *exe)
 {
-	sync();
 	fpga_core_reset(1);
+	ide_flush_all();
+	sync();
 
 	input_switch(0);
 	input_uinp_destroy();
 
+	iothread_stop();
 	offload_stop();
 
 	const char *appname = exe ? exe : getappname();
@@ -630,8 +657,10 @@ void app_restart(const char *path, const char *xml, const char *exe)
 
 void fpga_core_reset(int reset)
 {
+	pthread_mutex_lock(&gpo_lock);
 	uint32_t gpo = fpga_gpo_read() & ~0xC0000000;
 	fpga_gpo_write(reset ? gpo | 0x40000000 : gpo | 0x80000000);
+	pthread_mutex_unlock(&gpo_lock);
 }
 
 int is_fpga_ready(int quick)
@@ -649,8 +678,26 @@ int is_fpga_ready(int quick)
 
 void fpga_spi_en(uint32_t mask, uint32_t en)
 {
+	if (en)
+	{
+		if (!gpo_cs_held) pthread_mutex_lock(&gpo_lock);
+		gpo_cs_held = 1;
+	}
+	else if (!gpo_cs_held)
+	{
+		// chip selects of this thread are already released
+		return;
+	}
+
 	uint32_t gpo = fpga_gpo_read() | 0x80000000;
-	fpga_gpo_write(en ? gpo | mask : gpo & ~mask);
+	gpo = en ? gpo | mask : gpo & ~mask;
+	fpga_gpo_write(gpo);
+
+	if (!(gpo & SSPI_CS_MASK))
+	{
+		gpo_cs_held = 0;
+		pthread_mutex_unlock(&gpo_lock);
+	}
 }
 
 void fpga_wait_to_reset()
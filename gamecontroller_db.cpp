@@ -2,7 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include "input.h"
 #include "file_io.h"
 #include "user_io.h"
@@ -449,34 +451,220 @@ static bool parse_mapping_string(char *map_str, char *guid, int dev_fd, uint32_t
 #define GCDB_DIR  "/media/fat/linux/gamecontrollerdb/"
 
 
-bool read_controller_map_from_file(char *fname, char *guid, int dev_fd, uint32_t *fill_map)
+/*
+ * GUID index of database files.
+ * Built on first use by a single scan of the file and kept in /tmp, so it
+ * survives core changes (main is restarted on every core load). It's rebuilt
+ * when modification time or size of the database file changes.
+ * Lookup is a binary search, only lines with matching GUID are read from the file.
+ */
+
+#define GCDB_INDEX_MAGIC 0x58444347 // "GCDX"
+#define GCDB_INDEX_FILES 2
+
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+	int64_t mtime;
+	int64_t size;
+} gcdb_index_hdr;
+
+typedef struct {
+	char guid[GUID_LEN - 1]; // lower case, not terminated
+	uint32_t offset;
+	uint32_t len;
+} gcdb_index_entry;
+
+typedef struct {
+	char fname[256];
+	gcdb_index_hdr hdr;
+	gcdb_index_entry *entries;
+} gcdb_index;
+
+static gcdb_index gcdb_indexes[GCDB_INDEX_FILES] = {};
+
+static int gcdb_index_cmp(const void *a, const void *b)
+{
+	const gcdb_index_entry *ea = (const gcdb_index_entry *)a;
+	const gcdb_index_entry *eb = (const gcdb_index_entry *)b;
+
+	int res = memcmp(ea->guid, eb->guid, sizeof(ea->guid));
+	if (res) return res;
+
+	// keep file order for entries with same GUID
+	return (ea->offset < eb->offset) ? -1 : (ea->offset > eb->offset) ? 1 : 0;
+}
+
+static void gcdb_index_path(char *path, size_t size, const char *fname)
+{
+	const char *name = strrchr(fname, '/');
+	snprintf(path, size, "/tmp/gcdb_%s.idx", name ? name + 1 : fname);
+}
+
+static bool gcdb_index_load(gcdb_index *idx, const char *path)
+{
+	int size = FileLoad(path, 0, 0);
+	if (size < (int)sizeof(gcdb_index_hdr)) return false;
+
+	char *buf = (char *)malloc(size);
+	if (!buf) return false;
+
+	gcdb_index_hdr *hdr = (gcdb_index_hdr *)buf;
+	if (FileLoad(path, buf, size) != size || hdr->magic != GCDB_INDEX_MAGIC ||
+		hdr->mtime != idx->hdr.mtime || hdr->size != idx->hdr.size ||
+		size != (int)(sizeof(gcdb_index_hdr) + hdr->count * sizeof(gcdb_index_entry)))
+	{
+		free(buf);
+		return false;
+	}
+
+	idx->hdr.count = hdr->count;
+	idx->entries = (gcdb_index_entry *)malloc(hdr->count * sizeof(gcdb_index_entry) + 1);
+	if (idx->entries) memcpy(idx->entries, buf + sizeof(gcdb_index_hdr), hdr->count * sizeof(gcdb_index_entry));
+
+	free(buf);
+	return idx->entries != NULL;
+}
+
+static bool gcdb_index_build(gcdb_index *idx, const char *path)
 {
 	fileTextReader reader;
-	char matched[1024] = {};
-	char *map_start = NULL;
+	if (!FileOpenTextReader(&reader, idx->fname)) return false;
+
+	printf("Gamecontrollerdb: indexing %s\n", idx->fname);
 
-	if (FileOpenTextReader(&reader, fname))
+	uint32_t count = 0, cap = 0;
+	gcdb_index_entry *entries = NULL;
+
+	const char *line;
+	while ((line = FileReadLine(&reader)))
 	{
-		const char *line;
-		printf("Gamecontrollerdb: searching for GUID %s in file %s\n", guid, fname);
-		while ((line = FileReadLine(&reader)))
+		const char *gcom = strchr(line, ',');
+		if (!gcom || gcom - line != GUID_LEN - 1) continue;
+
+		if (count == cap)
 		{
-			if (line[0] == '#') continue;
-			const char *gcom = strchr(line, ',');
-			if (!strncasecmp(line, guid, gcom-line))
+			cap = cap ? cap * 2 : 1024;
+			gcdb_index_entry *tmp = (gcdb_index_entry *)realloc(entries, cap * sizeof(gcdb_index_entry));
+			if (!tmp)
 			{
-				if (cdb_entry_matches((char *)gcom))
-				{
-					map_start = strchr((char *)gcom+1, ',');
-					if (map_start)
-					{
-						strncpy(matched, map_start+1, sizeof(matched));
-					}
-				}
+				free(entries);
+				return false;
+			}
+			entries = tmp;
+		}
+
+		gcdb_index_entry *entry = &entries[count++];
+		for (int i = 0; i < GUID_LEN - 1; i++) entry->guid[i] = tolower(line[i]);
+		entry->offset = line - reader.buffer;
+		entry->len = strlen(line);
+	}
+
+	qsort(entries, count, sizeof(gcdb_index_entry), gcdb_index_cmp);
+
+	idx->hdr.magic = GCDB_INDEX_MAGIC;
+	idx->hdr.count = count;
+	idx->entries = entries ? entries : (gcdb_index_entry *)malloc(1);
+
+	int size = sizeof(gcdb_index_hdr) + count * sizeof(gcdb_index_entry);
+	char *buf = (char *)malloc(size);
+	if (buf)
+	{
+		memcpy(buf, &idx->hdr, sizeof(gcdb_index_hdr));
+		if (count) memcpy(buf + sizeof(gcdb_index_hdr), entries, count * sizeof(gcdb_index_entry));
+		FileSave(path, buf, size);
+		free(buf);
+	}
+
+	return idx->entries != NULL;
+}
+
+static gcdb_index *gcdb_get_index(const char *fname)
+{
+	struct stat64 st;
+	if (stat64(fname, &st) < 0) return NULL;
+
+	gcdb_index *idx = NULL;
+	for (int i = 0; i < GCDB_INDEX_FILES; i++)
+	{
+		if (!strcmp(gcdb_indexes[i].fname, fname) || (!idx && !gcdb_indexes[i].fname[0])) idx = &gcdb_indexes[i];
+	}
+	if (!idx) idx = &gcdb_indexes[0];
+
+	if (!strcmp(idx->fname, fname) && idx->entries && idx->hdr.mtime == st.st_mtime && idx->hdr.size == st.st_size) return idx;
+
+	free(idx->entries);
+	memset(idx, 0, sizeof(gcdb_index));
+	snprintf(idx->fname, sizeof(idx->fname), "%s", fname);
+	idx->hdr.mtime = st.st_mtime;
+	idx->hdr.size = st.st_size;
+
+	char path[256];
+	gcdb_index_path(path, sizeof(path), fname);
+	if (gcdb_index_load(idx, path) || gcdb_index_build(idx, path)) return idx;
+
+	idx->fname[0] = 0;
+	return NULL;
+}
+
+// Last matching line in the file wins, same as with a sequential scan.
+static bool gcdb_index_find(gcdb_index *idx, const char *guid, char *matched, size_t size)
+{
+	char key[GUID_LEN - 1];
+	for (int i = 0; i < GUID_LEN - 1; i++) key[i] = tolower(guid[i]);
+
+	// first entry not less than key
+	uint32_t lo = 0, hi = idx->hdr.count;
+	while (lo < hi)
+	{
+		uint32_t mid = (lo + hi) / 2;
+		if (memcmp(idx->entries[mid].guid, key, sizeof(key)) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+
+	uint32_t end = lo;
+	while (end < idx->hdr.count && !memcmp(idx->entries[end].guid, key, sizeof(key))) end++;
+	if (end == lo) return false;
+
+	fileTYPE f;
+	if (!FileOpen(&f, idx->fname)) return false;
+
+	bool found = false;
+	char line[1024];
+	while (!found && end-- > lo)
+	{
+		gcdb_index_entry *entry = &idx->entries[end];
+		uint32_t len = (entry->len < sizeof(line)) ? entry->len : sizeof(line) - 1;
+		if (!FileSeek(&f, entry->offset, SEEK_SET) || FileReadAdv(&f, line, len) != (int)len) break;
+		line[len] = 0;
+
+		char *gcom = line + GUID_LEN - 1;
+		if (cdb_entry_matches(gcom))
+		{
+			char *map_start = strchr(gcom + 1, ',');
+			if (map_start)
+			{
+				snprintf(matched, size, "%s", map_start + 1);
+				found = true;
 			}
 		}
+	}
+
+	FileClose(&f);
+	return found;
+}
+
+bool read_controller_map_from_file(char *fname, char *guid, int dev_fd, uint32_t *fill_map)
+{
+	char matched[1024] = {};
 
+	gcdb_index *idx = gcdb_get_index(fname);
+	if (idx)
+	{
+		printf("Gamecontrollerdb: searching for GUID %s in file %s\n", guid, fname);
+		gcdb_index_find(idx, guid, matched, sizeof(matched));
 	}
+
 	if (matched[0] != 0)
 	{
 		printf("Gamecontrollerdb: found match, using config %s\n", matched);
@@ -65,9 +65,24 @@ unsigned long GetTimer(unsigned long offset)
 	return (unsigned long)(res + offset);
 }
 
+// earliest deadline checked by CheckTimer and not yet reached.
+// Per thread: io and input threads check timers too, only main loop sleeps on them.
+static __thread unsigned long next_timer = 0;
+
 unsigned long CheckTimer(unsigned long time)
 {
-	return (!time) || (GetTimer(0) >= time);
+	if (!time) return 1;
+	if (GetTimer(0) >= time) return 1;
+
+	if (!next_timer || time < next_timer) next_timer = time;
+	return 0;
+}
+
+unsigned long FetchNextTimer()
+{
+	unsigned long time = next_timer;
+	next_timer = 0;
+	return time;
 }
 
 void WaitTimer(unsigned long time)
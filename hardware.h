@@ -8,6 +8,9 @@ unsigned long GetTimer(unsigned long offset);
 unsigned long CheckTimer(unsigned long t);
 void WaitTimer(unsigned long time);
 
+// returns the earliest pending deadline seen by CheckTimer in the calling thread since the last call (0 if none)
+unsigned long FetchNextTimer();
+
 void hexdump(void *data, uint16_t size, uint16_t offset = 0);
 
 // minimig reset stuff
@@ -11,6 +11,9 @@
 #include <string>
 #include <sstream>
 #include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include "support/x86/x86.h"
 #include "support/minimig/minimig_hdd.h"
@@ -19,7 +22,11 @@
 #include "user_io.h"
 #include "file_io.h"
 #include "hardware.h"
+#include "scheduler.h"
 #include "ide.h"
+#include "iothread.h"
+#include "offload.h"
+#include "vhd.h"
 
 #if 0
 	#define dbg_printf     printf
@@ -77,8 +84,204 @@ void ide_recvbuf(ide_config *ide, uint16_t reg, uint32_t length, uint16_t *data)
 const uint32_t ide_io_max_size = 32;
 uint8_t ide_buf[ide_io_max_size * 512];
 
+// Write-back buffer per drive. Sequential blocks of write commands are merged
+// and written to the image by offload worker while guest continues.
+// FLUSH CACHE waits for pending data and syncs the image file.
+#define IDE_WB_MAX 256
+
+struct ide_wbuf_t
+{
+	uint8_t *buf[2];   // IDE_WB_MAX sectors each, allocated on first write
+	uint32_t lba[2];   // first image sector
+	uint32_t cnt[2];
+	int      fd[2];
+	fileVHD *vhd[2];   // dynamic VHD goes through its block map
+	int      fill;     // buffer collecting blocks, other one is written by worker
+	bool     busy;
+	bool     error;    // write failed since last FLUSH CACHE
+	uint32_t done;     // completed writes, stdio read buffer is stale when changed
+	uint32_t seen;
+	uint32_t blocks;
+	uint32_t writes;
+
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+};
+
+static ide_wbuf_t ide_wb[4] = {};
+
+static void ide_wb_write(ide_wbuf_t *wb)
+{
+	pthread_mutex_lock(&wb->lock);
+	while (1)
+	{
+		int n = wb->fill ^ 1;
+		uint8_t *buf = wb->buf[n];
+		size_t size = wb->cnt[n] * 512;
+		off_t pos = (off_t)wb->lba[n] * 512;
+		int fd = wb->fd[n];
+		fileVHD *vhd = wb->vhd[n];
+		pthread_mutex_unlock(&wb->lock);
+
+		bool err = false;
+		while (size)
+		{
+			ssize_t ret = vhd ? vhd_write(vhd, pos, buf, size) : pwrite(fd, buf, size, pos);
+			if (ret <= 0)
+			{
+				printf("IDE: write error at sector %u (%d).\n", (uint32_t)(pos / 512), errno);
+				err = true;
+				break;
+			}
+
+			buf += ret;
+			pos += ret;
+			size -= ret;
+		}
+
+		pthread_mutex_lock(&wb->lock);
+		if (err) wb->error = true;
+		wb->cnt[n] = 0;
+		wb->done++;
+		wb->writes++;
+
+		// blocks merged meanwhile are written in the same run
+		if (!wb->cnt[wb->fill]) break;
+		wb->fill ^= 1;
+	}
+
+	wb->busy = false;
+	pthread_cond_broadcast(&wb->cond);
+	pthread_mutex_unlock(&wb->lock);
+}
+
+// lock must be held
+static void ide_wb_submit(ide_wbuf_t *wb)
+{
+	if (wb->busy || !wb->cnt[wb->fill]) return;
+
+	wb->fill ^= 1;
+	wb->busy = true;
+	offload_add_work([wb]() { ide_wb_write(wb); }, OFFLOAD_PRIO_LOW);
+}
+
+static void ide_wb_append(drive_t *drive, uint32_t lba, uint8_t *data, uint32_t cnt)
+{
+	ide_wbuf_t *wb = &ide_wb[drive->drvnum & 3];
+	if (!wb->buf[0])
+	{
+		pthread_mutex_init(&wb->lock, NULL);
+		pthread_cond_init(&wb->cond, NULL);
+		wb->buf[0] = (uint8_t*)malloc(IDE_WB_MAX * 512);
+		wb->buf[1] = (uint8_t*)malloc(IDE_WB_MAX * 512);
+	}
+
+	int fd = fileno(drive->f->filp);
+
+	pthread_mutex_lock(&wb->lock);
+	int n = wb->fill;
+	if (wb->cnt[n] && (wb->fd[n] != fd || wb->lba[n] + wb->cnt[n] != lba || wb->cnt[n] + cnt > IDE_WB_MAX))
+	{
+		// not mergeable: hand the buffer over as soon as worker is free
+		while (wb->busy && wb->fill == n) pthread_cond_wait(&wb->cond, &wb->lock);
+		ide_wb_submit(wb);
+		n = wb->fill;
+	}
+
+	if (!wb->cnt[n])
+	{
+		wb->lba[n] = lba;
+		wb->fd[n] = fd;
+		wb->vhd[n] = drive->f->vhd;
+	}
+
+	memcpy(wb->buf[n] + wb->cnt[n] * 512, data, cnt * 512);
+	wb->cnt[n] += cnt;
+	wb->blocks++;
+	pthread_mutex_unlock(&wb->lock);
+}
+
+// start writing collected blocks, called at the end of write command
+static void ide_wb_kick(drive_t *drive)
+{
+	ide_wbuf_t *wb = &ide_wb[drive->drvnum & 3];
+	if (!wb->buf[0]) return;
+
+	pthread_mutex_lock(&wb->lock);
+	ide_wb_submit(wb);
+	pthread_mutex_unlock(&wb->lock);
+}
+
+// write out everything, returns false if any write failed since the last call
+static bool ide_wb_sync(ide_wbuf_t *wb)
+{
+	if (!wb->buf[0]) return true;
+
+	pthread_mutex_lock(&wb->lock);
+	ide_wb_submit(wb);
+	while (wb->busy) pthread_cond_wait(&wb->cond, &wb->lock);
+	bool ok = !wb->error;
+	wb->error = false;
+	pthread_mutex_unlock(&wb->lock);
+	return ok;
+}
+
+// before image is closed or reopened
+static void ide_wb_reset(uint32_t drvnum)
+{
+	ide_wbuf_t *wb = &ide_wb[drvnum & 3];
+	if (!wb->buf[0]) return;
+
+	ide_wb_sync(wb);
+	if (wb->blocks) printf("IDE: %u blocks written in %u writes\n", wb->blocks, wb->writes);
+	wb->blocks = wb->writes = 0;
+}
+
+void ide_flush_all()
+{
+	IoThreadLock io_lock;
+	for (uint32_t i = 0; i < 4; i++) ide_wb_sync(&ide_wb[i]);
+}
+
+// reads must see written data: wait for overlapping blocks and drop stale stdio buffer
+static void ide_wb_prepare_read(drive_t *drive, uint32_t lba, uint32_t cnt)
+{
+	ide_wbuf_t *wb = &ide_wb[drive->drvnum & 3];
+	if (!wb->buf[0] || !drive->f->filp) return;
+
+	int fd = fileno(drive->f->filp);
+
+	pthread_mutex_lock(&wb->lock);
+	bool overlap = false;
+	for (int n = 0; n < 2; n++)
+	{
+		if (wb->cnt[n] && wb->fd[n] == fd && lba < wb->lba[n] + wb->cnt[n] && wb->lba[n] < lba + cnt) overlap = true;
+	}
+
+	if (overlap)
+	{
+		ide_wb_submit(wb);
+		while (wb->busy) pthread_cond_wait(&wb->cond, &wb->lock);
+	}
+
+	bool stale = (wb->seen != wb->done);
+	wb->seen = wb->done;
+	pthread_mutex_unlock(&wb->lock);
+
+	if (stale) fflush(drive->f->filp);
+}
+
 ide_config ide_inst[2] = {};
 
+// drain drives using the file before it is closed or reopened
+static void ide_wb_reset_file(fileTYPE *f)
+{
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (ide_inst[i >> 1].drive[i & 1].f == f) ide_wb_reset(i);
+	}
+}
+
 uint16_t ide_check()
 {
 	uint16_t res;
@@ -91,6 +294,9 @@ uint16_t ide_check()
 
 int ide_img_mount(fileTYPE *f, const char *name, int rw)
 {
+	IoThreadLock io_lock;
+
+	ide_wb_reset_file(f);
 	FileClose(f);
 	int writable = 0, ret = 0;
 
@@ -104,14 +310,14 @@ int ide_img_mount(fileTYPE *f, const char *name, int rw)
 		}
 		else {
 			writable = rw && FileCanWrite(name);
-			ret = FileOpenEx(f, name, writable ? (O_RDWR | O_SYNC) : O_RDONLY);
+			ret = FileOpenEx(f, name, writable ? (O_RDWR | O_SYNC) : O_RDONLY) && FileMountVHD(f);
 			if (!ret) printf("Failed to open file %s\n", name);
 		}
 	}
 
 	if (!ret)
 	{
-		f->size = 0;
+		FileClose(f);
 		return 0;
 	}
 
@@ -415,6 +621,8 @@ void ide_img_set(uint32_t drvnum, fileTYPE *f, int cd, int sectors, int heads, i
 
 	drive_t *drive = &ide_inst[port].drive[drv];
 
+	ide_wb_reset(drvnum);
+
 	ide_inst[port].base = port ? IDE1_BASE : IDE0_BASE;
 	ide_inst[port].drive[drv].drvnum = drvnum;
 
@@ -456,7 +664,7 @@ void ide_img_set(uint32_t drvnum, fileTYPE *f, int cd, int sectors, int heads, i
 
 	if(drive->f)
 	{
-		if (!drive->chd_f) drive->total_sectors = (drive->f->size / 512);
+		if (!drive->toc.chd_f) drive->total_sectors = (drive->f->size / 512);
 	}
 	else
 	{
@@ -667,7 +875,7 @@ void ide_img_set(uint32_t drvnum, fileTYPE *f, int cd, int sectors, int heads, i
 		};
 
 		for (int i = 0; i < 256; i++) drive->id[i] = identify[i];
-		drive->load_state = (drive->f || drive->chd_f) ? 1 : 3;
+		drive->load_state = (drive->f || drive->toc.chd_f) ? 1 : 3;
 	}
 
 	if (ide_inst[port].drive[drv].present)
@@ -765,9 +973,23 @@ static void process_read(ide_config *ide, int multi)
 
 	dbg2_printf("  sector_count: %d\n", ide->regs.sector_count);
 
+	drive_t *drive = &ide->drive[ide->regs.drv];
+	uint32_t total = ide->regs.sector_count ? ide->regs.sector_count : 256;
+
+	if (lba >= drive->offset)
+	{
+		ide_wb_prepare_read(drive, lba - drive->offset, total);
+
+		// kernel reads the following blocks while current one is sent to the core
+		if (total > 1 && drive->f->filp && !drive->f->vhd)
+		{
+			posix_fadvise(fileno(drive->f->filp), (off_t)(lba - drive->offset) * 512, (off_t)total * 512, POSIX_FADV_WILLNEED);
+		}
+	}
+
 	uint32_t cnt = multi ? get_cnt(ide) : 1;
-	ide->null = !FileSeekLBA(ide->drive[ide->regs.drv].f, (lba <= ide->drive[ide->regs.drv].offset) ? 0 : (lba - ide->drive[ide->regs.drv].offset));
-	if (!ide->null) ide->null = (readhdd(&ide->drive[ide->regs.drv], lba, cnt) <= 0);
+	ide->null = !FileSeekLBA(drive->f, (lba <= drive->offset) ? 0 : (lba - drive->offset));
+	if (!ide->null) ide->null = (readhdd(drive, lba, cnt) <= 0);
 	if (ide->null) memset(ide_buf, 0, cnt * 512);
 
 	while (1)
@@ -800,7 +1022,7 @@ static void process_read(ide_config *ide, int multi)
 		}
 
 		cnt = multi ? get_cnt(ide) : 1;
-		if (!ide->null) ide->null = (readhdd(&ide->drive[ide->regs.drv], lba, cnt) <= 0);
+		if (!ide->null) ide->null = (readhdd(drive, lba, cnt) <= 0);
 		if (ide->null) memset(ide_buf, 0, cnt * 512);
 
 		ide_req = 0;
@@ -857,7 +1079,12 @@ static void process_write(ide_config *ide, int multi)
 		}
 		else
 		{
-			if (!ide->null) ide->null = (lba < ide->drive[ide->regs.drv].offset) ? 0 : (FileWriteAdv(ide->drive[ide->regs.drv].f, ide_buf, cnt * 512, -1) <= 0);
+			drive_t *drive = &ide->drive[ide->regs.drv];
+			if (!ide->null && lba >= drive->offset)
+			{
+				if (drive->f->filp) ide_wb_append(drive, lba - drive->offset, ide_buf, cnt);
+				else ide->null = 1;
+			}
 			lba += cnt;
 			ide->regs.sector_count -= cnt;
 			put_lba(ide, lba);
@@ -871,6 +1098,20 @@ static void process_write(ide_config *ide, int multi)
 			break;
 		}
 	}
+
+	if (ide->regs.cmd != 0xFA) ide_wb_kick(&ide->drive[ide->regs.drv]);
+}
+
+static int flush_cache(drive_t *drive)
+{
+	bool ok = ide_wb_sync(&ide_wb[drive->drvnum & 3]);
+	if (drive->f && drive->f->filp && fsync(fileno(drive->f->filp)) < 0)
+	{
+		printf("IDE: fsync error (%d).\n", errno);
+		ok = false;
+	}
+
+	return ok ? 0 : 1;
 }
 
 static int handle_hdd(ide_config *ide)
@@ -912,6 +1153,13 @@ static int handle_hdd(ide_config *ide)
 		process_write(ide, 0);
 		break;
 
+	case 0xE7: // flush cache
+	case 0xEA: // flush cache ext
+		if (flush_cache(&ide->drive[ide->regs.drv])) return 1;
+		ide->regs.status = ATA_STATUS_RDY | ATA_STATUS_IRQ;
+		ide_set_regs(ide);
+		break;
+
 	case 0xC6: // set multople
 		if (ide->regs.sector_count > ide_io_max_size)
 		{
@@ -959,6 +1207,7 @@ void ide_io(int num, int req)
 	ide_config *ide = &ide_inst[num];
 
 	//printf("req: %d, disk: %d\n", req, num);
+	if (req) scheduler_activity();
 
 	if (req == 0) // no request
 	{
@@ -1054,6 +1303,8 @@ int ide_is_placeholder(int num)
 
 void ide_reset(uint8_t hotswap[4])
 {
+	IoThreadLock io_lock;
+
 	ide_inst[0].drive[0].placeholder = 0;
 	ide_inst[0].drive[1].placeholder = 0;
 	ide_inst[1].drive[0].placeholder = 0;
@@ -1083,13 +1334,17 @@ void ide_reset(uint8_t hotswap[4])
 
 int ide_open(uint8_t unit, const char* filename)
 {
+	IoThreadLock io_lock;
+
 	static fileTYPE hdd_file[4] = {};
 	chs_t chs = {};
 
+	ide_wb_reset(unit);
+
 	if (!is_minimig() || ((minimig_config.ide_cfg & 1) && minimig_config.hardfile[unit].cfg))
 	{
 		printf("\nChecking HDD %d\n", unit);
-		if (filename[0] && FileOpenEx(&hdd_file[unit], filename, FileCanWrite(filename) ? O_RDWR : O_RDONLY))
+		if (filename[0] && FileOpenEx(&hdd_file[unit], filename, FileCanWrite(filename) ? O_RDWR : O_RDONLY) && FileMountVHD(&hdd_file[unit]))
 		{
 			printf("file: \"%s\": ", hdd_file[unit].name);
 			guess_geometry(&hdd_file[unit], &chs, is_minimig() && !strcasecmp(".hdf", filename + strlen(filename) - 4));
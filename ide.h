@@ -55,9 +55,9 @@ struct regs_t
 	uint8_t status;
 };
 
+// CD layout as addressed by the host, sectors are read through toc
 struct track_t
 {
-	fileTYPE f;
 	char     filename[1024];
 	uint32_t start;
 	uint32_t length;
@@ -66,7 +66,6 @@ struct track_t
 	uint8_t  attr;
 	uint8_t  mode2;
 	uint8_t  number;
-	int      chd_offset;
 };
 
 struct drive_t
@@ -105,9 +104,7 @@ struct drive_t
 	uint8_t  atapi_asc_code;
 	uint8_t  atapi_ascq_code;
 
-	chd_file *chd_f;
-	int      chd_hunknum;
-	uint8_t	 *chd_hunkbuf;
+	toc_t     toc;
 	uint32_t  chd_total_size;
 	uint32_t  chd_last_partial_lba;
 
@@ -155,6 +152,9 @@ int ide_is_placeholder(int num);
 void ide_reset(uint8_t hotswap[4]);
 int ide_open(uint8_t unit, const char* filename);
 
+// write out pending blocks of all drives, before reboot or restart
+void ide_flush_all();
+
 void ide_io(int num, int req);
 
 #endif
@@ -5,21 +5,19 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <time.h>
-#include <ios>
-#include <fstream>
-#include <iostream>
-#include <string>
-#include <sstream>
 #include <sys/stat.h>
 #include <cmath>
 #include <libchdr/chd.h>
 #include <byteswap.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "spi.h"
 #include "user_io.h"
 #include "file_io.h"
 #include "hardware.h"
 #include "cd.h"
 #include "ide.h"
+#include "offload.h"
 
 #if 0
 #define dbg_printf     printf
@@ -58,17 +56,16 @@ typedef struct
 	unsigned char   fr;
 } TMSF;
 
-static int check_magic(fileTYPE *file, int sectorSize, int mode2)
+static int check_magic(toc_t *toc, int sectorSize, int mode2)
 {
-	// Initialize our array in the event file->read() doesn't fully write it
+	// Initialize our array in the event of a short read
 	static uint8_t pvd[BYTES_PER_COOKED_REDBOOK_FRAME];
 	memset(pvd, 0, sizeof(pvd));
 
-	uint32_t seek = 16 * sectorSize;  // first vd is located at sector 16
-	if (sectorSize == BYTES_PER_RAW_REDBOOK_FRAME && !mode2) seek += 16;
-	if (mode2) seek += 24;
-	FileSeek(file, seek, SEEK_SET);
-	if (!FileReadAdv(file, pvd, BYTES_PER_COOKED_REDBOOK_FRAME)) return 0;
+	// first vd is located at sector 16
+	toc->tracks[0].sector_size = sectorSize;
+	toc->tracks[0].type = mode2 ? 2 : 1;
+	if (cd_read_sector(toc, 0, 16, CD_READ_COOKED, pvd) <= 0) return 0;
 
 	// pvd[0] = descriptor type, pvd[1..5] = standard identifier,
 	// pvd[6] = iso version (+8 for High Sierra)
@@ -76,27 +73,27 @@ static int check_magic(fileTYPE *file, int sectorSize, int mode2)
 		(pvd[8] == 1 && !strncmp((char*)(&pvd[9]), "CDROM", 5) && pvd[14] == 1));
 }
 
-static int check_iso_file(fileTYPE *f, uint8_t *mode2, uint16_t *sectorSize)
+static int check_iso_file(toc_t *toc, uint8_t *mode2, uint16_t *sectorSize)
 {
-	if (check_magic(f, BYTES_PER_COOKED_REDBOOK_FRAME, false))
+	if (check_magic(toc, BYTES_PER_COOKED_REDBOOK_FRAME, false))
 	{
 		if (sectorSize) *sectorSize = BYTES_PER_COOKED_REDBOOK_FRAME;
 		if (mode2) *mode2 = 0;
 		return 1;
 	}
-	else if (check_magic(f, BYTES_PER_RAW_REDBOOK_FRAME, false))
+	else if (check_magic(toc, BYTES_PER_RAW_REDBOOK_FRAME, false))
 	{
 		if (sectorSize) *sectorSize = BYTES_PER_RAW_REDBOOK_FRAME;
 		if (mode2) *mode2 = 0;
 		return 1;
 	}
-	else if (check_magic(f, 2336, true))
+	else if (check_magic(toc, 2336, true))
 	{
 		if (sectorSize) *sectorSize = 2336;
 		if (mode2) *mode2 = 1;
 		return 1;
 	}
-	else if (check_magic(f, BYTES_PER_RAW_REDBOOK_FRAME, true))
+	else if (check_magic(toc, BYTES_PER_RAW_REDBOOK_FRAME, true))
 	{
 		if (sectorSize) *sectorSize = BYTES_PER_RAW_REDBOOK_FRAME;
 		if (mode2) *mode2 = 1;
@@ -108,32 +105,94 @@ static int check_iso_file(fileTYPE *f, uint8_t *mode2, uint16_t *sectorSize)
 	return 0;
 }
 
+// copy CUE/ISO layout to the toc, so sectors are read by cd_read_sector.
+// Lead-out is kept in drv->track only.
+static void set_toc(drive_t *drv)
+{
+	drv->toc.last = drv->track_cnt - 1;
+	for (int i = 0; i < drv->toc.last; i++)
+	{
+		track_t *trk = &drv->track[i];
+		cd_track_t *t = &drv->toc.tracks[i];
+
+		t->start = trk->start;
+		t->end = trk->start + trk->length;
+		t->type = trk->attr ? (trk->mode2 ? 2 : 1) : 0;
+		t->sector_size = trk->sectorSize;
+		t->offset = trk->start * trk->sectorSize - trk->skip;
+	}
+
+	drv->toc.end = drv->track[drv->toc.last].start;
+	drv->toc.sectorSize = drv->track[drv->data_num].sectorSize;
+}
+
+// inverse of set_toc() for a TOC from the cache, track files are opened already
+static const char *get_toc(drive_t *drv)
+{
+	const char *res = 0;
+	if (drv->toc.last <= 0 || drv->toc.last >= (int)(sizeof(drv->track) / sizeof(drv->track[0]))) return 0;
+
+	memset(drv->track, 0, sizeof(drv->track));
+	for (int i = 0; i < drv->toc.last; i++)
+	{
+		track_t *trk = &drv->track[i];
+		cd_track_t *t = &drv->toc.tracks[i];
+		if (!t->f.filp) return 0;
+
+		// cache keeps real paths of track files
+		char link[32];
+		sprintf(link, "/proc/self/fd/%d", fileno(t->f.filp));
+		int len = readlink(link, trk->filename, sizeof(trk->filename) - 1);
+		if (len <= 0) return 0;
+		trk->filename[len] = 0;
+
+		trk->number = i + 1;
+		trk->start = t->start;
+		trk->length = t->end - t->start;
+		trk->sectorSize = t->sector_size;
+		trk->attr = t->type ? 0x40 : 0;
+		trk->mode2 = (t->type == 2);
+		trk->skip = trk->start * trk->sectorSize - t->offset;
+
+		if (trk->attr && !res)
+		{
+			drv->data_num = i;
+			res = trk->filename;
+		}
+	}
+
+	// lead-out track
+	drv->track[drv->toc.last].number = drv->toc.last + 1;
+	drv->track[drv->toc.last].start = drv->toc.end;
+	drv->track_cnt = drv->toc.last + 1;
+
+	return res;
+}
+
 static const char * load_iso_file(drive_t *drv, const char* filename)
 {
-	fileTYPE f;
+	cd_unload(&drv->toc);
 	memset(drv->track, 0, sizeof(drv->track));
 	drv->track_cnt = 0;
 
 	strcpy(drv->track[0].filename, filename);
-	if (!FileOpen(&f, filename))
+	if (!cd_track_open(&drv->toc.tracks[0], filename))
 	{
 		printf("Cannot open ISO file!\n");
 		return 0;
 	}
 
-	if (!check_iso_file(&f, &drv->track[0].mode2, &drv->track[0].sectorSize))
+	if (!check_iso_file(&drv->toc, &drv->track[0].mode2, &drv->track[0].sectorSize))
 	{
 		printf("Fail to parse ISO!\n");
-		FileClose(&f);
+		cd_unload(&drv->toc);
 		return 0;
 	}
 
 	drv->track[0].attr = 0x40; //data track
-	drv->track[0].length = f.size / drv->track[0].sectorSize;
+	drv->track[0].length = drv->toc.tracks[0].f.size / drv->track[0].sectorSize;
 	drv->track[0].number = 1;
 
-	FileClose(&f);
-
 	// lead-out track (track 2)
 	drv->track[1].start = drv->track[0].length;
 	drv->track[2].number = 2;
@@ -142,31 +201,10 @@ static const char * load_iso_file(drive_t *drv, const char* filename)
 	drv->track_cnt = 2;
 
 	drv->data_num = 0;
-	if (!FileOpen(&drv->track[0].f, drv->track[0].filename))
-	{
-		printf("Cannot open ISO file! (First track)\n");
-		return 0;
-	}
+	set_toc(drv);
 	return drv->track[0].filename;
 }
 
-static int get_word(std::string &keyword, std::istream &in)
-{
-	in >> keyword;
-	for (uint32_t i = 0; i < keyword.size(); i++) keyword[i] = (char)toupper(keyword[i]);
-	return keyword.size();
-}
-
-static int get_timecode(uint32_t &frames, std::istream &in)
-{
-	std::string msf;
-	in >> msf;
-	TMSF tmp = { 0, 0, 0 };
-	int success = sscanf(msf.c_str(), "%hhu:%hhu:%hhu", &tmp.min, &tmp.sec, &tmp.fr) == 3;
-	frames = (int)MSF_TO_FRAMES(tmp.min, tmp.sec, tmp.fr);
-	return success;
-}
-
 static track_t *get_track_from_lba(drive_t *drive, uint32_t lba, bool &index0)
 {
 	track_t *ret = NULL;
@@ -187,6 +225,36 @@ static track_t *get_track_from_lba(drive_t *drive, uint32_t lba, bool &index0)
 	return ret;
 }
 
+// Read sector of the track holding lba. Index 0 area is stored either in front
+// of the track data or at the end of the previous track file, PREGAP isn't stored.
+static int read_sector(drive_t *drv, uint32_t lba, cd_read_t mode, uint8_t *buf)
+{
+	bool is_index0;
+	track_t *track = get_track_from_lba(drv, lba, is_index0);
+	if (!track) return -1;
+
+	int n = track - drv->track;
+	if (n >= drv->toc.last) return -1;
+
+	int len = cd_read_sector(&drv->toc, n, lba, mode, buf);
+	if (len <= 0 && is_index0 && n) len = cd_read_sector(&drv->toc, n - 1, lba, mode, buf);
+	return len;
+}
+
+// track file is opened in the toc slot of the same index, lead-out has no file
+static int put_track(drive_t *drv, track_t *curr)
+{
+	if (curr->filename[0] && !cd_track_open(&drv->toc.tracks[drv->track_cnt], curr->filename))
+	{
+		printf("CDROM: cannot open %s\n", curr->filename);
+		return 0;
+	}
+
+	memcpy(&drv->track[drv->track_cnt], curr, sizeof(track_t));
+	drv->track_cnt++;
+	return 1;
+}
+
 static int add_track(drive_t *drv, track_t *curr, uint32_t &shift, const int32_t prestart, uint32_t &totalPregap, uint32_t currPregap)
 {
 	uint32_t skip = 0;
@@ -215,10 +283,7 @@ static int add_track(drive_t *drv, track_t *curr, uint32_t &shift, const int32_t
 		curr->start += currPregap;
 		totalPregap = currPregap;
 
-		memcpy(&drv->track[drv->track_cnt], curr, sizeof(track_t));
-		FileOpenEx(&drv->track[drv->track_cnt].f, curr->filename, O_RDONLY);
-		drv->track_cnt++;
-		return 1;
+		return put_track(drv, curr);
 	}
 
 	// Guard against undefined behavior in subsequent tracks.back() call
@@ -240,7 +305,8 @@ static int add_track(drive_t *drv, track_t *curr, uint32_t &shift, const int32_t
 	}
 	else
 	{
-		uint32_t size = FileLoad(prev->filename, 0, 0);
+		// decoded size for FLAC
+		uint32_t size = drv->toc.tracks[drv->track_cnt - 1].f.size;
 		const uint32_t tmp = size - prev->skip;
 		prev->length = tmp / prev->sectorSize;
 
@@ -265,50 +331,35 @@ static int add_track(drive_t *drv, track_t *curr, uint32_t &shift, const int32_t
 		return 0;
 	}
 
-	memcpy(&drv->track[drv->track_cnt], curr, sizeof(track_t));
-	FileOpenEx(&drv->track[drv->track_cnt].f, drv->track[drv->track_cnt].filename, O_RDONLY);
-	drv->track_cnt++;
-	return 1;
+	return put_track(drv, curr);
 }
 
 static const char* load_chd_file(drive_t *drv, const char *chdfile)
 {
-
-	//Borrow the cd.h "toc_t" and mister_chd* parse function. Then translate the toc_t to drive_t+track_t.
-	//TODO: abstract all the bin/cue+chd+iso parsing and reading into a shared class
-	//
-
+	// CHD layout comes from the shared CD image layer, it's translated to track_t here
 	const char *ext = chdfile + strlen(chdfile) - 4;
 	uint32_t total_sector_size = 0;
 
-
 	if (strncasecmp(".chd", ext, 4))
 	{
 		//Not a CHD
 		return 0;
 	}
-	toc_t tmpTOC = { };
+
+	cd_unload(&drv->toc);
 	memset(drv->track, 0, sizeof(drv->track));
 	drv->track_cnt = 0;
-	chd_error err = mister_load_chd(chdfile, &tmpTOC);
+	chd_error err = cd_chd_open(chdfile, &drv->toc);
 	if (err != CHDERR_NONE)
 	{
+		cd_unload(&drv->toc);
 		return 0;
 	}
 
-	if (drv->chd_hunkbuf)
-	{
-		free(drv->chd_hunkbuf);
-	}
-
-	drv->chd_hunkbuf = (uint8_t *)malloc(tmpTOC.chd_hunksize);
-	drv->chd_hunknum = -1;
-	drv->chd_f = tmpTOC.chd_f;
-
 	//don't use add_track, just do it ourselves...
-	for (int i = 0; i < tmpTOC.last; i++)
+	for (int i = 0; i < drv->toc.last; i++)
 	{
-		cd_track_t *chd_track = &tmpTOC.tracks[i];
+		cd_track_t *chd_track = &drv->toc.tracks[i];
 		track_t *trk = &drv->track[i];
 		trk->number = i + 1;
 		trk->sectorSize = chd_track->sector_size;
@@ -322,7 +373,6 @@ static const char* load_chd_file(drive_t *drv, const char *chdfile)
 
 		}
 
-		trk->chd_offset = chd_track->offset;
 		trk->start = chd_track->start;
 		trk->length = chd_track->end - chd_track->start;
 		drv->track_cnt++;
@@ -334,7 +384,7 @@ static const char* load_chd_file(drive_t *drv, const char *chdfile)
 	track_t *lead_out = &drv->track[drv->track_cnt];
 	lead_out->number = drv->track_cnt + 1;
 	lead_out->attr = 0;
-	lead_out->start = tmpTOC.tracks[tmpTOC.last - 1].end;
+	lead_out->start = drv->toc.tracks[drv->toc.last - 1].end;
 	lead_out->length = 0;
 	drv->track_cnt++;
 
@@ -352,89 +402,83 @@ static const char* load_chd_file(drive_t *drv, const char *chdfile)
 	return chdfile;
 }
 
+static int get_timecode(const char *str, uint32_t *frames)
+{
+	int mm, ss, ff;
+	if (sscanf(str, "%d:%d:%d", &mm, &ss, &ff) != 3) return 0;
+
+	*frames = MSF_TO_FRAMES(mm, ss, ff);
+	return 1;
+}
 
 static const char* load_cue_file(drive_t *drv, const char *cuefile)
 {
+	static char sheet[100 * 1024];
+	static char line[1024];
+
+	cd_unload(&drv->toc);
 	memset(drv->track, 0, sizeof(drv->track));
 	drv->track_cnt = 0;
 
+	memset(sheet, 0, sizeof(sheet));
+	if (!FileLoad(cuefile, sheet, sizeof(sheet) - 1)) return 0;
+
 	track_t track = {};
 	uint32_t shift = 0;
 	uint32_t currPregap = 0;
 	uint32_t totalPregap = 0;
 	int32_t prestart = -1;
-	int track_number;
-	int success;
+	int success = 1;
 	int canAddTrack = 0;
 
-	std::string pathname(cuefile);
-	std::size_t found = pathname.find_last_of('/');
-	if (found == std::string::npos) return 0; // no folder name?
-	pathname.resize(found + 1);
-
-	std::ifstream in;
-	in.open(cuefile, std::ios::in);
-	if (in.fail()) return 0;
-
-	while (!in.eof())
+	char *buf = sheet;
+	while (success && cd_sgets(line, sizeof(line), &buf))
 	{
-		// get next line
-		std::string buf;
-		std::getline(in, buf);
-
-		if (in.fail() && !in.eof()) return 0;  // probably a binary file
-
-		std::istringstream line(buf);
+		char command[16] = {};
+		int arg = 0;
+		sscanf(line, "%15s %n", command, &arg);
+		const char *lptr = line + arg;
 
-		std::string command;
-		get_word(command, line);
-
-		//printf("command: %s\n", command.c_str());
-
-		if (command == "TRACK")
+		if (!strcasecmp(command, "TRACK"))
 		{
 			if (canAddTrack) success = add_track(drv, &track, shift, prestart, totalPregap, currPregap);
-			else success = 1;
 
 			track.start = 0;
 			track.skip = 0;
 			currPregap = 0;
 			prestart = -1;
 
-			line >> track_number; // (cin) read into a true int first
+			int track_number = 0;
+			char type[16] = {};
+			if (sscanf(lptr, "%d %15s", &track_number, type) != 2) success = 0;
 
 			track.number = static_cast<uint8_t>(track_number);
 
-			std::string type;
-			get_word(type, line);
-
-			//printf("  type: %s\n", type.c_str());
-
-			if (type == "AUDIO")
+			if (!strcasecmp(type, "AUDIO"))
 			{
 				track.sectorSize = BYTES_PER_RAW_REDBOOK_FRAME;
 				track.attr = 0;
 				track.mode2 = false;
 			}
-			else if (type == "MODE1/2048")
+			else if (!strcasecmp(type, "MODE1/2048"))
 			{
 				track.sectorSize = BYTES_PER_COOKED_REDBOOK_FRAME;
 				track.attr = 0x40;
 				track.mode2 = false;
 			}
-			else if (type == "MODE1/2352")
+			else if (!strcasecmp(type, "MODE1/2352"))
 			{
 				track.sectorSize = BYTES_PER_RAW_REDBOOK_FRAME;
 				track.attr = 0x40;
 				track.mode2 = false;
 			}
-			else if (type == "MODE2/2336")
+			else if (!strcasecmp(type, "MODE2/2336"))
 			{
 				track.sectorSize = 2336;
 				track.attr = 0x40;
 				track.mode2 = true;
 			}
-			else if (type == "MODE2/2352")
+			else if (!strcasecmp(type, "MODE2/2352"))
 			{
 				track.sectorSize = BYTES_PER_RAW_REDBOOK_FRAME;
 				track.attr = 0x40;
@@ -444,54 +488,41 @@ static const char* load_cue_file(drive_t *drv, const char *cuefile)
 
 			canAddTrack = 1;
 		}
-		else if (command == "INDEX")
+		else if (!strcasecmp(command, "INDEX"))
 		{
-			int index;
-			line >> index;
+			int index = -1, len = 0;
 			uint32_t frame;
-			success = get_timecode(frame, line);
+			success = (sscanf(lptr, "%d %n", &index, &len) == 1) && get_timecode(lptr + len, &frame);
 
 			if (index == 1) track.start = frame;
 			else if (index == 0) prestart = static_cast<int32_t>(frame);
 			// ignore other indices
 		}
-		else if (command == "FILE")
+		else if (!strcasecmp(command, "FILE"))
 		{
 			if (canAddTrack) success = add_track(drv, &track, shift, prestart, totalPregap, currPregap);
-			else success = 1;
 			canAddTrack = 0;
 
-			std::string filename;
-			std::getline(std::getline(line, filename, '"'), filename, '"');
-
-			strcpy(track.filename, pathname.c_str());
-			strcat(track.filename, filename.c_str());
+			strcpy(track.filename, cuefile);
+			cd_cue_file(track.filename, sizeof(track.filename), lptr);
 
 			printf("cue: got new file name: %s\n", track.filename);
 		}
-		else if (command == "PREGAP") success = get_timecode(currPregap, line);
+		else if (!strcasecmp(command, "PREGAP")) success = get_timecode(lptr, &currPregap);
 		// ignored commands
-		else if (command == "CATALOG" || command == "CDTEXTFILE" || command == "FLAGS" || command == "ISRC" ||
-			command == "PERFORMER" || command == "POSTGAP" || command == "REM" ||
-			command == "SONGWRITER" || command == "TITLE" || command.empty())
-		{
-			success = 1;
-		}
-		// failure
-		else
+		else if (command[0] && strcasecmp(command, "CATALOG") && strcasecmp(command, "CDTEXTFILE") && strcasecmp(command, "FLAGS") &&
+			strcasecmp(command, "ISRC") && strcasecmp(command, "PERFORMER") && strcasecmp(command, "POSTGAP") &&
+			strcasecmp(command, "REM") && strcasecmp(command, "SONGWRITER") && strcasecmp(command, "TITLE"))
 		{
+			// failure, probably not a CUE sheet
 			success = 0;
 		}
-
-		if (!success)
-		{
-			return 0;
-		}
 	}
 
 	// add last track
-	if (!add_track(drv, &track, shift, prestart, totalPregap, currPregap))
+	if (!success || !canAddTrack || !add_track(drv, &track, shift, prestart, totalPregap, currPregap))
 	{
+		cd_unload(&drv->toc);
 		return 0;
 	}
 
@@ -504,6 +535,7 @@ static const char* load_cue_file(drive_t *drv, const char *cuefile)
 
 	if (!add_track(drv, &track, shift, -1, totalPregap, 0))
 	{
+		cd_unload(&drv->toc);
 		return 0;
 	}
 
@@ -512,10 +544,12 @@ static const char* load_cue_file(drive_t *drv, const char *cuefile)
 		if (drv->track[i].attr == 0x40)
 		{
 			drv->data_num = i;
+			set_toc(drv);
 			return drv->track[i].filename;
 		}
 	}
 
+	cd_unload(&drv->toc);
 	return 0;
 }
 
@@ -990,37 +1024,183 @@ static void pkt_send(ide_config *ide, void *data, uint16_t size)
 	ide->state = IDE_STATE_WAIT_PKT_RD;
 }
 
-static void read_cd_sectors(ide_config *ide, track_t *track, int cnt)
+// Sequential readahead of data sectors. Packets continuing the previous one are served
+// from memory, the buffer is refilled on the offload core. Readahead size doubles
+// with every sequential packet and drops back on a seek.
+#define CD_RA_MIN 16
+#define CD_RA_MAX 128
+
+struct cd_readahead_t
 {
-	drive_t *drv = &ide->drive[ide->regs.drv];
-	uint32_t sz = drv->track[drv->data_num].sectorSize;
+	uint8_t *buf;      // CD_RA_MAX cooked sectors, allocated on first stream
+	uint32_t lba;      // first sector in buffer
+	uint32_t cnt;      // sectors ready
+	uint32_t target;   // sectors in buffer when fill completes
+	uint32_t next;     // sector expected in next packet
+	uint32_t window;
+	bool     busy;
+	bool     stop;
+	uint32_t hits;
+	uint32_t misses;
+
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+};
+
+static cd_readahead_t cd_ra[4] = {};
+
+static cd_readahead_t *cd_ra_get(ide_config *ide)
+{
+	cd_readahead_t *ra = &cd_ra[((ide - ide_inst) << 1) | (ide->regs.drv & 1)];
+	if (!ra->window)
+	{
+		pthread_mutex_init(&ra->lock, NULL);
+		pthread_cond_init(&ra->cond, NULL);
+		ra->window = CD_RA_MIN;
+	}
+
+	return ra;
+}
 
-	if (sz == 2048)
+// read cooked sectors by LBA, track file reads are positioned so the sync path may run meanwhile
+static bool cd_ra_read_sectors(drive_t *drv, uint32_t lba, uint32_t cnt, uint8_t *dst)
+{
+	for (uint32_t i = 0; i < cnt; i++, dst += 2048)
 	{
-		if (!ide->null) ide->null = (FileReadAdv(&track->f, ide_buf, cnt * sz, -1) <= 0);
-		if (ide->null) memset(ide_buf, 0, cnt * sz);
-		return;
+		if (read_sector(drv, lba + i, CD_READ_COOKED, dst) != 2048) return false;
+	}
+
+	return true;
+}
+
+static void cd_ra_fill(cd_readahead_t *ra, drive_t *drv)
+{
+	pthread_mutex_lock(&ra->lock);
+	while (!ra->stop && ra->cnt < ra->target)
+	{
+		uint32_t lba = ra->lba + ra->cnt;
+		uint32_t n = ra->target - ra->cnt;
+		if (n > 16) n = 16;
+		uint8_t *dst = ra->buf + ra->cnt * 2048;
+		pthread_mutex_unlock(&ra->lock);
+
+		// sectors past cnt are not read by the consumer, so buffer is filled unlocked
+		bool ok = cd_ra_read_sectors(drv, lba, n, dst);
+
+		pthread_mutex_lock(&ra->lock);
+		if (!ok)
+		{
+			ra->target = ra->cnt;
+			break;
+		}
+		ra->cnt += n;
+		pthread_cond_broadcast(&ra->cond);
 	}
 
-	uint32_t pre = drv->track[drv->data_num].mode2 ? 24 : 16;
-	uint32_t post = sz - pre - 2048;
-	uint32_t off = 0;
+	ra->busy = false;
+	pthread_cond_broadcast(&ra->cond);
+	pthread_mutex_unlock(&ra->lock);
+}
+
+// copy sectors from readahead buffer, false if not buffered
+static bool cd_ra_get_sectors(cd_readahead_t *ra, uint32_t lba, uint32_t cnt, uint8_t *dst)
+{
+	pthread_mutex_lock(&ra->lock);
 
-	while (cnt--)
+	bool hit = ra->buf && lba >= ra->lba && lba + cnt <= ra->lba + ra->target;
+	while (hit && ra->busy && lba + cnt > ra->lba + ra->cnt) pthread_cond_wait(&ra->cond, &ra->lock);
+
+	hit = hit && lba + cnt <= ra->lba + ra->cnt;
+	if (hit)
+	{
+		memcpy(dst, ra->buf + (lba - ra->lba) * 2048, cnt * 2048);
+		ra->hits++;
+	}
+	else
+	{
+		ra->misses++;
+	}
+
+	pthread_mutex_unlock(&ra->lock);
+	return hit;
+}
+
+// request lba..lba+cnt has been served, keep the stream ahead of it
+static void cd_ra_update(cd_readahead_t *ra, drive_t *drv, uint32_t lba, uint32_t cnt)
+{
+	bool is_index0;
+	uint32_t end = lba + cnt;
+	track_t *track = get_track_from_lba(drv, end, is_index0);
+
+	pthread_mutex_lock(&ra->lock);
+
+	bool seq = (lba == ra->next);
+	ra->next = end;
+
+	if (!seq)
+	{
+		ra->window = CD_RA_MIN;
+	}
+	else if (!ra->busy && !ra->stop && track && !is_index0 && track - drv->track < drv->toc.last)
 	{
-		if (!ide->null) ide->null = !FileSeek(&track->f, pre, SEEK_CUR);
-		if (!ide->null) ide->null = (FileReadAdv(&track->f, ide_buf + off, 2048, -1) <= 0);
-		if (ide->null) memset(ide_buf + off, 0, 2048);
-		if (!ide->null) ide->null = !FileSeek(&track->f, post, SEEK_CUR);
-		off += 2048;
+		if (!ra->buf) ra->buf = (uint8_t*)malloc(CD_RA_MAX * 2048);
+
+		// keep sectors not consumed yet
+		uint32_t left = 0;
+		if (ra->buf && end >= ra->lba && end < ra->lba + ra->cnt)
+		{
+			left = ra->lba + ra->cnt - end;
+			memmove(ra->buf, ra->buf + (end - ra->lba) * 2048, left * 2048);
+		}
+
+		ra->lba = end;
+		ra->cnt = left;
+		ra->target = left;
+
+		// refill once half of the window is consumed, don't cross the track end
+		if (ra->buf && left < ra->window / 2)
+		{
+			if (ra->window < CD_RA_MAX) ra->window <<= 1;
+
+			uint32_t limit = track->start + track->length;
+			ra->target = ra->window;
+			if (ra->lba + ra->target > limit) ra->target = (limit > ra->lba) ? limit - ra->lba : 0;
+
+			if (ra->target > ra->cnt)
+			{
+				// never wait for a free work slot on the io path, the next packet is read synchronously then
+				ra->busy = offload_try_add_work([ra, drv]() { cd_ra_fill(ra, drv); }, OFFLOAD_PRIO_HIGH);
+				if (!ra->busy) ra->target = ra->cnt;
+			}
+		}
 	}
+
+	pthread_mutex_unlock(&ra->lock);
+}
+
+// wait for pending fill and drop buffered sectors, before image files are closed
+static void cd_ra_reset(cd_readahead_t *ra)
+{
+	if (!ra->window) return;
+
+	pthread_mutex_lock(&ra->lock);
+	ra->stop = true;
+	while (ra->busy) pthread_cond_wait(&ra->cond, &ra->lock);
+
+	if (ra->hits || ra->misses) printf("CDROM: readahead %u hits, %u misses\n", ra->hits, ra->misses);
+
+	ra->stop = false;
+	ra->lba = ra->cnt = ra->target = ra->next = 0;
+	ra->hits = ra->misses = 0;
+	ra->window = CD_RA_MIN;
+	pthread_mutex_unlock(&ra->lock);
 }
 
 void cdrom_read(ide_config *ide)
 {
-	bool is_index0 = false;
 	uint32_t cnt = ide->regs.pkt_cnt;
 	drive_t *drive = &ide->drive[ide->regs.drv];
+	cd_readahead_t *ra = cd_ra_get(ide);
 
 	if ((cnt * 4) > ide_io_max_size) cnt = ide_io_max_size / 4;
 
@@ -1037,52 +1217,30 @@ void cdrom_read(ide_config *ide)
 	}
 
 
-	track_t *track = get_track_from_lba(drive, ide->regs.pkt_lba, is_index0);
-
-	if (ide->state == IDE_STATE_INIT_RW && !drive->chd_f && track)
+	// next sector of the packet, for partial reads
+	if (ide->state == IDE_STATE_INIT_RW)
 	{
-		uint32_t pos = track->skip + (ide->regs.pkt_lba - track->start) * track->sectorSize;
-		ide->null = (FileSeek(&track->f, pos, SEEK_SET) < 0);
+		drive->chd_last_partial_lba = ide->regs.pkt_lba;
 	}
 
-
-	if (drive->chd_f) {
-
-		uint32_t hdr = drive->track[drive->data_num].mode2 ? 24 : 16;
-		if (drive->track[drive->data_num].sectorSize == 2048)
-		{
-			hdr = 0;
-		}
-		uint32_t d_offset = 0;
-
-		if (ide->state == IDE_STATE_INIT_RW)
-		{
-			drive->chd_last_partial_lba = ide->regs.pkt_lba;
-		}
-
+	uint32_t lba = drive->chd_last_partial_lba;
+	ide->null = 0;
+	if (!cd_ra_get_sectors(ra, lba, cnt, ide_buf))
+	{
 		for (uint32_t i = 0; i < cnt; i++)
 		{
-
-			if (mister_chd_read_sector(drive->chd_f, drive->chd_last_partial_lba + drive->track[drive->data_num].chd_offset, d_offset, hdr, 2048, ide_buf, drive->chd_hunkbuf, &drive->chd_hunknum) != CHDERR_NONE)
+			uint8_t *dst = ide_buf + i * 2048;
+			if (read_sector(drive, lba + i, CD_READ_COOKED, dst) != 2048)
 			{
-				//I don't think anything else uses this, but set it just in case.
 				ide->null = 1;
-				memset(ide_buf + d_offset, 0, 2048);
+				memset(dst, 0, 2048);
 			}
-			else
-			{
-				ide->null = 0;
-			}
-			d_offset += 2048;
-			drive->chd_last_partial_lba++;
 		}
-
-	}
-	else
-	{
-		read_cd_sectors(ide, track, cnt);
 	}
 
+	drive->chd_last_partial_lba += cnt;
+	cd_ra_update(ra, drive, lba, cnt);
+
 	dbg_printf("\nsector:\n");
 	dbg_hexdump(ide_buf, 512, 0);
 
@@ -1506,23 +1664,6 @@ void cdrom_reply(ide_config *ide, uint8_t error, uint8_t asc_code, uint8_t ascq_
 }
 
 
-void cdrom_close_chd(drive_t *drv)
-{
-
-	if (drv->chd_f)
-	{
-		chd_close(drv->chd_f);
-		drv->chd_f = NULL;
-	}
-
-	if (drv->chd_hunkbuf)
-	{
-		free(drv->chd_hunkbuf);
-		drv->chd_hunkbuf = NULL;
-	}
-	drv->chd_hunknum = -1;
-}
-
 const char* cdrom_parse(uint32_t num, const char *filename)
 {
 	const char *res = 0;
@@ -1531,14 +1672,8 @@ const char* cdrom_parse(uint32_t num, const char *filename)
 	num >>= 1;
 
 	//always close files and reset state. empty filename == unmounted cd from OSD
-	cdrom_close_chd(&ide_inst[num].drive[drv]);
-	for (uint8_t i = 0; i < sizeof(ide_inst[num].drive[drv].track) / sizeof(track_t); i++)
-	{
-		if (ide_inst[num].drive[drv].track[i].f.opened())
-		{
-			FileClose(&ide_inst[num].drive[drv].track[i].f);
-		}
-	}
+	cd_ra_reset(&cd_ra[(num << 1) | drv]);
+	cd_unload(&ide_inst[num].drive[drv].toc);
 	ide_inst[num].drive[drv].mcr_flag = true;
 	ide_inst[num].drive[drv].playing = 0;
 	ide_inst[num].drive[drv].paused = 0;
@@ -1548,7 +1683,20 @@ const char* cdrom_parse(uint32_t num, const char *filename)
 	{
 		const char *path = getFullPath(filename);
 		res = load_chd_file(&ide_inst[num].drive[drv], path);
-		if (!res) res = load_cue_file(&ide_inst[num].drive[drv], path);
+
+		// parsed CUE layout is kept in the TOC cache
+		if (!res && cd_toc_load(path, "ATAPI", &ide_inst[num].drive[drv].toc))
+		{
+			res = get_toc(&ide_inst[num].drive[drv]);
+			if (!res) cd_unload(&ide_inst[num].drive[drv].toc);
+		}
+
+		if (!res)
+		{
+			res = load_cue_file(&ide_inst[num].drive[drv], path);
+			if (res) cd_toc_save(path, "ATAPI", &ide_inst[num].drive[drv].toc);
+		}
+
 		if (!res) res = load_iso_file(&ide_inst[num].drive[drv], path);
 	}
 	return res;
@@ -1577,40 +1725,12 @@ void ide_cdda_send_sector()
 
 	if (!drv || !ide) return;
 
-	bool needs_swap = false;
+	// CHD keeps audio big endian, byteswap is done together with volume below
+	bool needs_swap = drv->toc.chd_f != NULL;
 	track_t *track = get_track_from_lba(drv, drv->play_start_lba, is_index0);
 
-	if (!track->attr)
-	{
-		if (drv->chd_f)
-		{
-			mister_chd_read_sector(drv->chd_f, drv->play_start_lba + drv->track[drv->data_num].chd_offset, 0, 0, BYTES_PER_RAW_REDBOOK_FRAME, cdda_buf, drv->chd_hunkbuf, &drv->chd_hunknum);
-			needs_swap = true;
-		}
-		else
-		{
-			//If we're in the index0 area "audio pregap", that data is actually in the
-			//previous track. Use that file object, seek and return the data from there.
-			//If the seek fails just return zero data.
-			//It may be a 'PREGAP' which indicates no stored data
-
-			track_t *read_track = track;
-			if (is_index0 && track->number > 1)
-			{
-				//track number is 1-based, track array is zero. 
-				read_track = &drv->track[track->number-2];
-
-			}
-			uint32_t pos = read_track->skip + (drv->play_start_lba - read_track->start) * read_track->sectorSize;
-			if (FileSeek(&read_track->f, pos, SEEK_SET))
-			{
-				FileReadAdv(&read_track->f, cdda_buf, sizeof(cdda_buf), -1);
-			} else {
-				memset(cdda_buf, 0, sizeof(cdda_buf));
-			}
-		}
-	}
-	else
+	//PREGAP and data tracks play silence
+	if (!track || track->attr || read_sector(drv, drv->play_start_lba, CD_READ_RAW, cdda_buf) != sizeof(cdda_buf))
 	{
 		memset(cdda_buf, 0, sizeof(cdda_buf));
 	}
@@ -1618,12 +1738,7 @@ void ide_cdda_send_sector()
 	int16_t *cdda_buf16 = (int16_t *)cdda_buf;
 	const int buf_wsize = sizeof(cdda_buf) / 2;
 
-	for (int sidx = 0; sidx < buf_wsize; sidx++)
-	{
-		if (needs_swap) cdda_buf16[sidx] = bswap_16(cdda_buf16[sidx]);
-		double tmps = (double)cdda_buf16[sidx];
-		cdda_buf16[sidx] = (int16_t)(tmps*((sidx & 1) ? drv->volume_l : drv->volume_r));
-	}
+	cd_cdda_mix(cdda_buf16, buf_wsize, (int)(drv->volume_r * 256), (int)(drv->volume_l * 256), needs_swap);
 
 	ide_sendbuf(ide, 0x200, buf_wsize, (uint16_t *)cdda_buf);
 
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <sys/inotify.h>
 #include <sys/poll.h>
+#include <sys/epoll.h>
 #include <sys/sysinfo.h>
 #include <dirent.h>
 #include <errno.h>
@@ -14,6 +15,7 @@
 #include <linux/input.h>
 #include <linux/uinput.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <stdarg.h>
 #include <math.h>
@@ -32,16 +34,22 @@
 #include "profiling.h"
 #include "gamecontroller_db.h"
 #include "str_util.h"
+#include "scheduler.h"
+#include "inputthread.h"
+#include "inputrec.h"
 
-#define NUMDEV 30
+// device table grows on demand, pool has 3 extra entries at the end (inotify, cmd fifo, led monitor)
+#define NUMDEV numdev
+#define NUMDEV_INIT 16
 #define NUMPLAYERS 6
 #define UINPUT_NAME "MiSTer virtual input"
 
 char joy_bnames[NUMBUTTONS][32] = {};
 int  joy_bcount = 0;
-static struct pollfd pool[NUMDEV + 3];
+static int numdev = 0;
+static struct pollfd *pool = NULL;
 
-static int ev2amiga[] =
+static const int ev2amiga[] =
 {
 	NONE, //0   KEY_RESERVED
 	0x45, //1   KEY_ESC
@@ -822,7 +830,7 @@ static const int ev2ps2_set1[] =
 	NONE  //255 ???
 };
 
-static int ev2archie[] =
+static const int ev2archie[] =
 {
 	NONE, //0   KEY_RESERVED
 	0x00, //1   KEY_ESC
@@ -1082,11 +1090,19 @@ static int ev2archie[] =
 	NONE  //255 ???
 };
 
+static_assert(sizeof(ev2amiga) / sizeof(ev2amiga[0]) == 256, "ev2amiga must cover all 256 key codes");
+static_assert(sizeof(ev2ps2) / sizeof(ev2ps2[0]) == 256, "ev2ps2 must cover all 256 key codes");
+static_assert(sizeof(ev2ps2_set1) / sizeof(ev2ps2_set1[0]) == 256, "ev2ps2_set1 must cover all 256 key codes");
+static_assert(sizeof(ev2archie) / sizeof(ev2archie[0]) == 256, "ev2archie must cover all 256 key codes");
+
+// indexed by (scan set == 1), avoids the branch on every key event
+static const int *const ev2ps2_sets[2] = { ev2ps2, ev2ps2_set1 };
+
 uint8_t ps2_kbd_scan_set = 2;
 uint32_t get_ps2_code(uint16_t key)
 {
 	if (key > 255) return NONE;
-	return (ps2_kbd_scan_set == 1) ? ev2ps2_set1[key] : ev2ps2[key];
+	return ev2ps2_sets[ps2_kbd_scan_set == 1][key];
 }
 
 uint32_t get_amiga_code(uint16_t key)
@@ -1194,6 +1210,7 @@ typedef struct
 
 	int      bind;
 	uint32_t unique_hash;
+	uint32_t gen;
 	char     devname[32];
 	char     id[80];
 	char     name[128];
@@ -1206,7 +1223,7 @@ typedef struct
 	uint32_t deadzone;
 } devInput;
 
-static devInput input[NUMDEV] = {};
+static devInput *input = NULL;
 static devInput player_pad[NUMPLAYERS] = {};
 static devInput player_pdsp[NUMPLAYERS] = {};
 
@@ -1218,6 +1235,46 @@ static devInput player_pdsp[NUMPLAYERS] = {};
 
 #define BTN_NUM (sizeof(devInput::map) / sizeof(devInput::map[0]))
 
+// UI is owned by main loop, these are queued when input is processed by the input thread
+static void input_info(const char *message, int timeout = 2000)
+{
+	inputthread_ui_call([](const char *str, int timeout, int) { Info(str, timeout); }, message, timeout);
+}
+
+static void input_info_message(const char *message)
+{
+	inputthread_ui_call([](const char *str, int, int) { InfoMessage(str); }, message);
+}
+
+static void input_kbd(uint16_t key, int press)
+{
+	inputthread_ui_call([](const char *, int key, int press) { user_io_kbd(key, press); }, 0, key, press);
+}
+
+static void input_menu_key(int key)
+{
+	inputthread_ui_call([](const char *, int key, int) { menu_key_set(key); }, 0, key);
+}
+
+static void input_set_ini(int num)
+{
+	inputthread_ui_call([](const char *, int num, int) { user_io_set_ini(num); }, 0, num);
+}
+
+static void input_check_reset(uint16_t modifiers, char use_keys)
+{
+	inputthread_ui_call([](const char *, int modifiers, int use_keys) { user_io_check_reset(modifiers, use_keys); }, 0, modifiers, use_keys);
+}
+
+static void input_map_show(int dev)
+{
+	inputthread_ui_call([](const char *, int dev, int)
+	{
+		InputLock input_lock;
+		map_joystick_show(input[dev].map, input[dev].mmap, input[dev].num);
+	}, 0, dev);
+}
+
 int mfd = -1;
 int mwd = -1;
 
@@ -1245,6 +1302,21 @@ static int set_watch()
 #define EVENT_SIZE  ( sizeof (struct inotify_event) )
 #define BUF_LEN     ( 1024 * ( EVENT_SIZE + 16 ) )
 
+// Device nodes created/removed since last check, handled by input_hotplug()
+#define HOTPLUG_MAX 32
+static struct
+{
+	char name[32];
+	bool add;
+} hotplug_ops[HOTPLUG_MAX];
+static int hotplug_cnt = 0;
+
+static int hotplug_node(const char *name)
+{
+	return !strncmp(name, "event", 5) || !strncmp(name, "mouse", 5);
+}
+
+// Returns 0 - nothing changed, 1 - full rescan required, 2 - changes are in hotplug_ops
 static int check_devs()
 {
 	int result = 0;
@@ -1258,14 +1330,29 @@ static int check_devs()
 		return 0;
 	}
 
+	hotplug_cnt = 0;
 	while (i<length)
 	{
 		struct inotify_event *event = (struct inotify_event *) &buffer[i];
+		if (event->mask & IN_Q_OVERFLOW) result = 1;
+
 		if (event->len)
 		{
-			if (event->mask & IN_CREATE)
+			if ((event->mask & (IN_CREATE | IN_DELETE)) && !(event->mask & IN_ISDIR) && hotplug_node(event->name))
+			{
+				// device nodes are handled incrementally, other files are not used
+				if (hotplug_cnt < HOTPLUG_MAX)
+				{
+					snprintf(hotplug_ops[hotplug_cnt].name, sizeof(hotplug_ops[hotplug_cnt].name), "%s", event->name);
+					hotplug_ops[hotplug_cnt].add = (event->mask & IN_CREATE) != 0;
+					hotplug_cnt++;
+				}
+				else result = 1;
+
+				printf("The file %s was %s.\n", event->name, (event->mask & IN_CREATE) ? "created" : "deleted");
+			}
+			else if (event->mask & IN_CREATE)
 			{
-				result = 1;
 				if (event->mask & IN_ISDIR)
 				{
 					printf("The directory %s was created.\n", event->name);
@@ -1277,7 +1364,6 @@ static int check_devs()
 			}
 			else if (event->mask & IN_DELETE)
 			{
-				result = 1;
 				if (event->mask & IN_ISDIR)
 				{
 					printf("The directory %s was deleted.\n", event->name);
@@ -1305,6 +1391,7 @@ static int check_devs()
 		i += EVENT_SIZE + event->len;
 	}
 
+	if (!result && hotplug_cnt) result = 2;
 	return result;
 }
 
@@ -1341,6 +1428,7 @@ static char has_led(int fd)
 static char leds_state = 0;
 void set_kbdled(int mask, int state)
 {
+	InputLock input_lock;
 	leds_state = state ? leds_state | (mask&HID_LED_MASK) : leds_state & ~(mask&HID_LED_MASK);
 }
 
@@ -1351,6 +1439,7 @@ int get_kbdled(int mask)
 
 int toggle_kbdled(int mask)
 {
+	InputLock input_lock;
 	int state = !get_kbdled(mask);
 	set_kbdled(mask, state);
 	return state;
@@ -1407,6 +1496,7 @@ static int grabbed = 1;
 
 void start_map_setting(int cnt, int set)
 {
+	InputLock input_lock;
 	mapping_current_key = 0;
 	mapping_current_dev = -1;
 
@@ -1427,7 +1517,7 @@ void start_map_setting(int cnt, int set)
 	memset(tmp_axis, 0, sizeof(tmp_axis));
 
 	//un-stick the enter key
-	user_io_kbd(KEY_ENTER, 0);
+	input_kbd(KEY_ENTER, 0);
 }
 
 int get_map_set()
@@ -1509,6 +1599,7 @@ static char *get_kbdmap_name(int dev)
 
 void finish_map_setting(int dismiss)
 {
+	InputLock input_lock;
 	mapping = 0;
 	if (mapping_dev<0) return;
 
@@ -1538,6 +1629,7 @@ void finish_map_setting(int dismiss)
 
 void input_lightgun_save(int idx, int32_t *cal)
 {
+	InputLock input_lock;
 	static char name[128];
 	sprintf(name, "%s_gun_cal_%04x_%04x_v2.cfg", user_io_get_core_name(), input[idx].vid, input[idx].pid);
 	FileSaveConfig(name, cal, 4 * sizeof(int32_t));
@@ -1553,6 +1645,7 @@ static void input_lightgun_load(int idx)
 
 int input_has_lightgun()
 {
+	InputLock input_lock;
 	for (int i = 0; i < NUMDEV; i++)
 	{
 		if (input[i].quirk == QUIRK_WIIMOTE)  return 1;
@@ -1565,20 +1658,23 @@ int input_has_lightgun()
 
 uint16_t get_map_vid()
 {
+	InputLock input_lock;
 	return (mapping && mapping_dev >= 0) ? input[mapping_dev].vid : 0;
 }
 
 uint16_t get_map_pid()
 {
+	InputLock input_lock;
 	return (mapping && mapping_dev >= 0) ? input[mapping_dev].pid : 0;
 }
 
 int has_default_map()
 {
+	InputLock input_lock;
 	return (mapping_dev >= 0) ? (input[mapping_dev].has_mmap == 1) : 0;
 }
 
-static char kr_fn_table[] =
+static constexpr uint8_t kr_fn_table[] =
 {
 	KEY_KPSLASH,    KEY_PAUSE,
 	KEY_KPASTERISK, KEY_PRINT,
@@ -1614,6 +1710,25 @@ static char kr_fn_table[] =
 	KEY_ENTER,      KEY_KPENTER
 };
 
+// direct lookup built from kr_fn_table at compile time, 0 = no Fn translation
+struct kr_fn_map_t
+{
+	uint8_t code[256];
+};
+
+static constexpr kr_fn_map_t kr_fn_map_make()
+{
+	kr_fn_map_t map = {};
+	for (uint32_t n = 0; n < sizeof(kr_fn_table) / 2; n++)
+	{
+		// first entry wins, same as the former linear search
+		if (!map.code[kr_fn_table[n * 2]]) map.code[kr_fn_table[n * 2]] = kr_fn_table[(n * 2) + 1];
+	}
+	return map;
+}
+
+static constexpr kr_fn_map_t kr_fn_map = kr_fn_map_make();
+
 static int keyrah_trans(int key, int press)
 {
 	static int fn = 0;
@@ -1624,17 +1739,14 @@ static int keyrah_trans(int key, int press)
 
 	if (key == KEY_102ND)
 	{
-		if (!press && fn == 1) menu_key_set(KEY_MENU);
+		if (!press && fn == 1) input_menu_key(KEY_MENU);
 		fn = press ? 1 : 0;
 		return 0;
 	}
 	else if (fn)
 	{
 		fn |= 2;
-		for (uint32_t n = 0; n<(sizeof(kr_fn_table) / (2 * sizeof(kr_fn_table[0]))); n++)
-		{
-			if ((key&255) == kr_fn_table[n * 2]) return kr_fn_table[(n * 2) + 1];
-		}
+		if (kr_fn_map.code[key & 255]) return kr_fn_map.code[key & 255];
 	}
 
 	return key;
@@ -1648,7 +1760,7 @@ static uint64_t autofire[NUMPLAYERS] = {};	// 0-31 primary mappings, 32-64 alter
 static uint32_t autofirecodes[NUMPLAYERS][BTN_NUM] = {};
 static int af_delay[NUMPLAYERS] = {};
 
-static uint32_t crtgun_timeout[NUMDEV] = {};
+static uint32_t *crtgun_timeout = NULL;
 
 static unsigned char mouse_btn = 0; //emulated mouse
 static unsigned char mice_btn = 0;
@@ -1707,6 +1819,7 @@ static int input_uinp_setup()
 
 void input_uinp_destroy()
 {
+	InputLock input_lock;
 	if (uinp_fd > 0)
 	{
 		ioctl(uinp_fd, UI_DEV_DESTROY);
@@ -1893,9 +2006,9 @@ static void joy_digital(int jnum, uint64_t mask, uint32_t code, char press, int
 						{
 							if (!found) sprintf(str, "Auto fire: %dms (%uhz)", af_delay[num] * 2, 1000 / (af_delay[num] * 2));
 							else sprintf(str, "Auto fire: OFF");
-							Info(str);
+							input_info(str);
 						}
-						else InfoMessage((!found) ? "\n\n          Auto fire\n             ON" :
+						else input_info_message((!found) ? "\n\n          Auto fire\n             ON" :
 							"\n\n          Auto fire\n             OFF");
 
 						return;
@@ -1918,12 +2031,12 @@ static void joy_digital(int jnum, uint64_t mask, uint32_t code, char press, int
 						if (hasAPI1_5())
 						{
 							sprintf(str, "Auto fire period: %dms (%uhz)", af_delay[num] * 2, 1000 / (af_delay[num] * 2));
-							Info(str);
+							input_info(str);
 						}
 						else
 						{
 							sprintf(str, "\n\n       Auto fire period\n            %dms(%uhz)", af_delay[num] * 2, 1000 / (af_delay[num] * 2));
-							InfoMessage(str);
+							input_info_message(str);
 						}
 
 						return;
@@ -1951,8 +2064,8 @@ static void joy_digital(int jnum, uint64_t mask, uint32_t code, char press, int
 				mouse_btn_req();
 
 				mouse_emu ^= 2;
-				if (hasAPI1_5()) Info((mouse_emu & 2) ? "Mouse mode ON" : "Mouse mode OFF");
-				else InfoMessage((mouse_emu & 2) ? "\n\n       Mouse mode lock\n             ON" :
+				if (hasAPI1_5()) input_info((mouse_emu & 2) ? "Mouse mode ON" : "Mouse mode OFF");
+				else input_info_message((mouse_emu & 2) ? "\n\n       Mouse mode lock\n             ON" :
 					"\n\n       Mouse mode lock\n             OFF");
 			}
 			return;
@@ -2008,7 +2121,7 @@ static void joy_digital(int jnum, uint64_t mask, uint32_t code, char press, int
 			case JOY_RIGHT:
 				if (cfg_switch)
 				{
-					user_io_set_ini(0);
+					input_set_ini(0);
 					osdbtn = 0;
 					return;
 				}
@@ -2018,7 +2131,7 @@ static void joy_digital(int jnum, uint64_t mask, uint32_t code, char press, int
 			case JOY_LEFT:
 				if (cfg_switch)
 				{
-					user_io_set_ini(1);
+					input_set_ini(1);
 					osdbtn = 0;
 					return;
 				}
@@ -2028,7 +2141,7 @@ static void joy_digital(int jnum, uint64_t mask, uint32_t code, char press, int
 			case JOY_UP:
 				if (cfg_switch)
 				{
-					user_io_set_ini(2);
+					input_set_ini(2);
 					osdbtn = 0;
 					return;
 				}
@@ -2038,7 +2151,7 @@ static void joy_digital(int jnum, uint64_t mask, uint32_t code, char press, int
 			case JOY_DOWN:
 				if (cfg_switch)
 				{
-					user_io_set_ini(3);
+					input_set_ini(3);
 					osdbtn = 0;
 					return;
 				}
@@ -2151,6 +2264,46 @@ static bool joy_dir_is_diagonal(const int x, const int y)
 		abs((x > y) == (x > -y) ? (float)y / x : (float)x / y) >= JOY_DIAG_THRESHOLD;
 }
 
+// While events are processed in bulk, analog state is sent once per SYN_REPORT frame.
+struct analog_out_t
+{
+	char x, y;
+	bool pending;
+};
+
+static bool analog_defer = false;
+static analog_out_t analog_out[2][NUMPLAYERS] = {};
+
+static void joy_analog_send(int num, int stick, int x, int y)
+{
+	if (analog_defer && num >= 0 && num < NUMPLAYERS)
+	{
+		analog_out[stick][num].x = (char)x;
+		analog_out[stick][num].y = (char)y;
+		analog_out[stick][num].pending = true;
+		return;
+	}
+
+	if (stick) user_io_r_analog_joystick(num, (char)x, (char)y);
+	else user_io_l_analog_joystick(num, (char)x, (char)y);
+}
+
+static void joy_analog_flush()
+{
+	for (int stick = 0; stick < 2; stick++)
+	{
+		for (int num = 0; num < NUMPLAYERS; num++)
+		{
+			analog_out_t *out = &analog_out[stick][num];
+			if (!out->pending) continue;
+
+			out->pending = false;
+			if (stick) user_io_r_analog_joystick(num, out->x, out->y);
+			else user_io_l_analog_joystick(num, out->x, out->y);
+		}
+	}
+}
+
 static void joy_analog(int dev, int axis, int offset, int stick = 0)
 {
 	int num = input[dev].num;
@@ -2189,14 +2342,7 @@ static void joy_analog(int dev, int axis, int offset, int stick = 0)
 			stick_swap(num, stick, &num, &stick);
 		}
 
-		if (stick)
-		{
-			user_io_r_analog_joystick(num, (char)x, (char)y);
-		}
-		else
-		{
-			user_io_l_analog_joystick(num, (char)x, (char)y);
-		}
+		joy_analog_send(num, stick, x, y);
 	}
 }
 
@@ -2334,6 +2480,7 @@ static void update_num_hw(int dev, int num)
 
 void reset_players()
 {
+	InputLock input_lock;
 	for (int i = 0; i < NUMDEV; i++)
 	{
 		input[i].num = 0;
@@ -2725,11 +2872,11 @@ static void input_cb(struct input_event *ev, struct input_absinfo *absinfo, int
 			{
 				char str[32];
 				sprintf(str, "P%d paddle/spinner", input[dev].num);
-				Info(str, cfg.controller_info * 1000);
+				input_info(str, cfg.controller_info * 1000);
 			}
 			else
 			{
-				map_joystick_show(input[dev].map, input[dev].mmap, input[dev].num);
+				input_map_show(dev);
 			}
 		}
 	}
@@ -3150,7 +3297,7 @@ static void input_cb(struct input_event *ev, struct input_absinfo *absinfo, int
 					if (osd_event == 1)
 					{
 						input[dev].lightgun = !input[dev].lightgun;
-						Info(input[dev].lightgun ? "Light Gun mode is ON" : "Light Gun mode is OFF");
+						input_info(input[dev].lightgun ? "Light Gun mode is ON" : "Light Gun mode is OFF");
 					}
 				}
 				else
@@ -3289,7 +3436,7 @@ static void input_cb(struct input_event *ev, struct input_absinfo *absinfo, int
 
 					if (input[dev].has_map >= 2)
 					{
-						if (input[dev].has_map == 3) Info("This joystick is not defined");
+						if (input[dev].has_map == 3) input_info("This joystick is not defined");
 						input[dev].has_map = 1;
 					}
 					
@@ -3343,7 +3490,7 @@ static void input_cb(struct input_event *ev, struct input_absinfo *absinfo, int
 
 				uint16_t reset_m = (modifier & MODMASK) >> 8;
 				if (ev->code == 111) reset_m |= 0x100;
-				user_io_check_reset(reset_m, (keyrah && !cfg.reset_combo) ? 1 : cfg.reset_combo);
+				input_check_reset(reset_m, (keyrah && !cfg.reset_combo) ? 1 : cfg.reset_combo);
 
 				if(!user_io_osd_is_visible() && ((user_io_get_kbdemu() == EMU_JOY0) || (user_io_get_kbdemu() == EMU_JOY1)) && !video_fb_state())
 				{
@@ -3429,7 +3576,7 @@ static void input_cb(struct input_event *ev, struct input_absinfo *absinfo, int
 				}
 
 				if (ev->code == KEY_HOMEPAGE) ev->code = KEY_MENU;
-				user_io_kbd(ev->code, ev->value);
+				input_kbd(ev->code, ev->value);
 				return;
 			}
 			break;
@@ -3576,6 +3723,7 @@ static void input_cb(struct input_event *ev, struct input_absinfo *absinfo, int
 
 void send_map_cmd(int key)
 {
+	InputLock input_lock;
 	if (mapping && mapping_dev >= 0)
 	{
 		input_event ev;
@@ -3589,6 +3737,73 @@ void send_map_cmd(int key)
 #define CMD_FIFO "/dev/MiSTer_cmd"
 #define LED_MONITOR "/sys/class/leds/hps_led0/brightness_hw_changed"
 
+// Bypass merging of specified 2 port/player controllers
+static const struct
+{
+	uint16_t vid;
+	uint16_t pid;
+	int type;
+} unique_devs[] =
+{
+	{ 0x289B, 0x0057, -1 }, // Raphnet
+	{ 0x0E8F, 0x3013, 1 },  // Mayflash SNES controller 2 port adapter
+	{ 0x16C0, 0x05E1, 1 },  // XinMo XM-10 2 player USB Encoder
+	{ 0x045E, 0x02A1, 1 },  // Xbox 360 wireless receiver
+	{ 0x8282, 0x3201, 1 },  // Irken Labs JAMMA Expander / Mojo Retro Adapter
+	{ 0x1209, 0xFACA, 1 },  // ControllaBLE
+	{ 0x16D0, 0x127E, 1 },  // Reflex Adapt to USB
+	{ 0x1209, 0x595A, 1 },  // RetroZord adapter
+};
+
+// Rules from the list above followed by the ones from MiSTer.ini. Returns false past the last one.
+static bool unique_rule(int idx, uint16_t *vid, uint16_t *pid, int *type)
+{
+	int cnt = sizeof(unique_devs) / sizeof(unique_devs[0]);
+	if (idx < cnt)
+	{
+		*vid = unique_devs[idx].vid;
+		*pid = unique_devs[idx].pid;
+		*type = unique_devs[idx].type;
+		return true;
+	}
+	idx -= cnt;
+
+	if (cfg.no_merge_vid)
+	{
+		if (!idx)
+		{
+			*vid = cfg.no_merge_vid;
+			*pid = cfg.no_merge_pid;
+			*type = cfg.no_merge_pid ? 1 : 0;
+			return true;
+		}
+		idx--;
+	}
+
+	if (idx < (int)cfg.no_merge_vidpid[0])
+	{
+		*vid = cfg.no_merge_vidpid[idx + 1] >> 16;
+		*pid = (uint16_t)cfg.no_merge_vidpid[idx + 1];
+		*type = 1;
+		return true;
+	}
+
+	return false;
+}
+
+static bool unique_match(int i, uint16_t vid, uint16_t pid, int type)
+{
+	return (!type && (input[i].vid == vid)) ||
+		(type > 0 && (input[i].vid == vid) && (input[i].pid == pid)) ||
+		(type < 0 && (input[i].vid == vid) && (input[i].pid != pid));
+}
+
+static int event_num(int i)
+{
+	const char *n = strstr(input[i].devname, "/event");
+	return n ? (int)strtoul(n + 6, NULL, 10) : -1;
+}
+
 // add sequential suffixes for non-merged devices
 void make_unique(uint16_t vid, uint16_t pid, int type)
 {
@@ -3604,13 +3819,9 @@ void make_unique(uint16_t vid, uint16_t pid, int type)
 		min = INT32_MAX;
 		for (int i = 0; i < NUMDEV; i++)
 		{
-			if ((!type && (input[i].vid == vid)) ||
-				(type > 0 && (input[i].vid == vid) && (input[i].pid == pid)) ||
-				(type < 0 && (input[i].vid == vid) && (input[i].pid != pid)))
+			if (unique_match(i, vid, pid, type))
 			{
-				int num = -1;
-				const char *n = strstr(input[i].devname, "/event");
-				if (n) num = strtoul(n + 6, NULL, 10);
+				int num = event_num(i);
 				if (num >= 0 && num < min && num > lastmin)
 				{
 					min = num;
@@ -3626,6 +3837,83 @@ void make_unique(uint16_t vid, uint16_t pid, int type)
 	}
 }
 
+// make_unique() for a single new device: suffix is the number of matching devices with lower event number.
+// Returns false if existing devices would get other suffixes.
+static bool make_unique_dev(int n)
+{
+	int num = event_num(n);
+	if (num < 0) return true;
+
+	uint16_t vid, pid;
+	int type;
+	for (int r = 0; unique_rule(r, &vid, &pid, &type); r++)
+	{
+		if (!unique_match(n, vid, pid, type)) continue;
+
+		int cnt = 0;
+		for (int i = 0; i < NUMDEV; i++)
+		{
+			if (i == n || pool[i].fd < 0 || !unique_match(i, vid, pid, type)) continue;
+
+			int k = event_num(i);
+			if (k > num) return false;
+			if (k >= 0) cnt++;
+		}
+
+		sprintf(input[n].id + strlen(input[n].id), "/%d", cnt);
+	}
+
+	return true;
+}
+
+static void set_dev_id(int i, const char *id, const char *sysfs, const char *uniq)
+{
+	strcpy(input[i].id, id);
+	strcpy(input[i].sysfs, sysfs);
+	strcpy(input[i].mac, uniq);
+
+	input[i].unique_hash = str_hash(input[i].id);
+	input[i].unique_hash = str_hash(input[i].mac, input[i].unique_hash);
+
+	input[i].timeout = (strlen(uniq) && strstr(sysfs, "bluetooth")) ? (cfg.bt_auto_disconnect * 10) : 0;
+}
+
+// copy missing fields from device j to mouse i
+static void merge_mouse(int i, int j)
+{
+	input[i].bind = j;
+	input[i].vid = input[j].vid;
+	input[i].pid = input[j].pid;
+	input[i].version = input[j].version;
+	input[i].bustype = input[j].bustype;
+	input[i].quirk = input[j].quirk;
+	memcpy(input[i].name, input[j].name, sizeof(input[i].name));
+	memcpy(input[i].idstr, input[j].idstr, sizeof(input[i].idstr));
+
+	if (!input[i].quirk)
+	{
+		//All mice as spinners
+		if ((cfg.spinner_vid == 0xFFFF && cfg.spinner_pid == 0xFFFF)
+			//Mouse as spinner
+			|| (cfg.spinner_vid && cfg.spinner_pid && input[i].vid == cfg.spinner_vid && input[i].pid == cfg.spinner_pid))
+		{
+			input[i].quirk = QUIRK_MSSP;
+			input[i].bind = i;
+			input[i].spinner_prediv = 1;
+		}
+
+		//Arcade Spinner TS-BSP01 (X axis) and Atari (Y axis)
+		if (input[i].vid == 0x32be && input[i].pid == 0x1420)
+		{
+			input[i].quirk = QUIRK_MSSP;
+			input[i].bind = i;
+			input[i].spinner_prediv = 3;
+		}
+
+		if (input[i].quirk == QUIRK_MSSP) strcat(input[i].id, "_sp");
+	}
+}
+
 void mergedevs()
 {
 	for (int i = 0; i < NUMDEV; i++)
@@ -3682,17 +3970,7 @@ void mergedevs()
 								char idsp[32];
 								strcpy(idsp, dev + 1);
 								strcat(idsp, " ");
-								if (strstr(handlers, idsp))
-								{
-									strcpy(input[i].id, id);
-									strcpy(input[i].sysfs, sysfs);
-									strcpy(input[i].mac, uniq);
-
-									input[i].unique_hash = str_hash(input[i].id);
-									input[i].unique_hash = str_hash(input[i].mac, input[i].unique_hash);
-
-									input[i].timeout = (strlen(uniq) && strstr(sysfs, "bluetooth")) ? (cfg.bt_auto_disconnect * 10) : 0;
-								}
+								if (strstr(handlers, idsp)) set_dev_id(i, id, sysfs, uniq);
 							}
 						}
 					}
@@ -3703,22 +3981,9 @@ void mergedevs()
 
 	fclose(f);
 
-	//Bypass merging of specified 2 port/player controllers
-	make_unique(0x289B, 0x0057, -1); // Raphnet
-	make_unique(0x0E8F, 0x3013, 1);  // Mayflash SNES controller 2 port adapter
-	make_unique(0x16C0, 0x05E1, 1);  // XinMo XM-10 2 player USB Encoder
-	make_unique(0x045E, 0x02A1, 1);  // Xbox 360 wireless receiver
-	make_unique(0x8282, 0x3201, 1);  // Irken Labs JAMMA Expander / Mojo Retro Adapter
-	make_unique(0x1209, 0xFACA, 1);  // ControllaBLE
-	make_unique(0x16D0, 0x127E, 1);  // Reflex Adapt to USB
-	make_unique(0x1209, 0x595A, 1);  // RetroZord adapter
-
-	if (cfg.no_merge_vid)
-	{
-		make_unique(cfg.no_merge_vid, cfg.no_merge_pid, (cfg.no_merge_pid ? 1 : 0));
-	}
-
-	for (int i = 0; i < (int)cfg.no_merge_vidpid[0]; i++) make_unique(cfg.no_merge_vidpid[i + 1] >> 16, (uint16_t)(cfg.no_merge_vidpid[i + 1]), 1);
+	uint16_t vid, pid;
+	int type;
+	for (int r = 0; unique_rule(r, &vid, &pid, &type); r++) make_unique(vid, pid, type);
 
 	// merge multifunctional devices by id
 	for (int i = 0; i < NUMDEV; i++)
@@ -3744,41 +4009,163 @@ void mergedevs()
 		{
 			if (!strcmp(input[i].id, input[j].id))
 			{
-				input[i].bind = j;
-				input[i].vid = input[j].vid;
-				input[i].pid = input[j].pid;
-				input[i].version = input[j].version;
-				input[i].bustype = input[j].bustype;
-				input[i].quirk = input[j].quirk;
-				memcpy(input[i].name, input[j].name, sizeof(input[i].name));
-				memcpy(input[i].idstr, input[j].idstr, sizeof(input[i].idstr));
-
-				if (!input[i].quirk)
-				{
-					//All mice as spinners
-					if ((cfg.spinner_vid == 0xFFFF && cfg.spinner_pid == 0xFFFF)
-						//Mouse as spinner
-						|| (cfg.spinner_vid && cfg.spinner_pid && input[i].vid == cfg.spinner_vid && input[i].pid == cfg.spinner_pid))
-					{
-						input[i].quirk = QUIRK_MSSP;
-						input[i].bind = i;
-						input[i].spinner_prediv = 1;
-					}
+				merge_mouse(i, j);
+				break;
+			}
+		}
+	}
+}
 
-					//Arcade Spinner TS-BSP01 (X axis) and Atari (Y axis)
-					if (input[i].vid == 0x32be && input[i].pid == 0x1420)
-					{
-						input[i].quirk = QUIRK_MSSP;
-						input[i].bind = i;
-						input[i].spinner_prediv = 3;
-					}
+// Open devices by id, used to merge a new node without scanning all devices.
+// Open addressing with device index + 1 in each entry, 0 - free.
+// Removed devices leave stale entries, so index is rebuilt on removal.
+static int *id_index = NULL;
+static uint32_t id_index_mask = 0;
+
+static void id_index_rebuild();
+
+static void id_index_add(int dev)
+{
+	if (!input[dev].id[0]) return;
+
+	// keep at least half of entries free
+	if (!id_index || (uint32_t)NUMDEV * 2 > id_index_mask + 1)
+	{
+		id_index_rebuild();
+		return;
+	}
+
+	uint32_t pos = str_hash(input[dev].id);
+	while (id_index[pos & id_index_mask]) pos++;
+	id_index[pos & id_index_mask] = dev + 1;
+}
+
+static void id_index_rebuild()
+{
+	uint32_t size = 32;
+	while (size < (uint32_t)NUMDEV * 2) size *= 2;
+
+	if (size != id_index_mask + 1)
+	{
+		int *tmp = (int *)realloc(id_index, size * sizeof(int));
+		if (!tmp) return;
+		id_index = tmp;
+		id_index_mask = size - 1;
+	}
+
+	memset(id_index, 0, size * sizeof(int));
+	for (int i = 0; i < NUMDEV; i++) if (pool[i].fd >= 0) id_index_add(i);
+}
+
+// Returns next open device with given id or -1. Start with pos = str_hash(id).
+static int id_index_next(const char *id, uint32_t *pos)
+{
+	if (!id_index) return -1;
+
+	while (int e = id_index[*pos & id_index_mask])
+	{
+		(*pos)++;
+		if (pool[e - 1].fd >= 0 && !strcmp(input[e - 1].id, id)) return e - 1;
+	}
+
+	return -1;
+}
+
+// Reads sysfs attribute of input device node, the same strings /proc/bus/input/devices shows.
+static void read_node_attr(const char *node, const char *attr, char *buf, int size)
+{
+	char path[128];
+	snprintf(path, sizeof(path), "/sys/class/input/%s/device/%s", node, attr);
+
+	buf[0] = 0;
+	FILE *f = fopen(path, "r");
+	if (!f) return;
+	if (!fgets(buf, size, f)) buf[0] = 0;
+	fclose(f);
+
+	int len = strlen(buf);
+	while (len && buf[len - 1] == '\n') buf[--len] = 0;
+}
+
+// mergedevs() for a single new device. Existing devices are not touched except
+// mice of the same device opened before it, they get the missing fields.
+// Returns false if full merge is required.
+static bool mergedev(int n)
+{
+	const char *node = strrchr(input[n].devname, '/') + 1;
+
+	char phys[64];
+	char uniq[64];
+	char id[64];
+	read_node_attr(node, "phys", phys, sizeof(phys));
+	read_node_attr(node, "uniq", uniq, sizeof(uniq));
+
+	if (strlen(phys) && strlen(uniq)) snprintf(id, sizeof(id), "%s/%s", phys, uniq);
+	else if (strlen(phys)) strcpy(id, phys);
+	else strcpy(id, uniq);
+
+	if (id[0])
+	{
+		char path[128];
+		snprintf(path, sizeof(path), "/sys/class/input/%s/device", node);
+
+		// same as Sysfs in /proc/bus/input/devices
+		static char sysfs[512];
+		char *real = realpath(path, NULL);
+		snprintf(sysfs, sizeof(sysfs), "%s", !real ? "" : strncmp(real, "/sys/", 5) ? real : real + 4);
+		free(real);
+
+		set_dev_id(n, id, sysfs, uniq);
+	}
+
+	if (!make_unique_dev(n)) return false;
+
+	input[n].bind = n;
+	if (input[n].id[0])
+	{
+		uint32_t pos = str_hash(input[n].id);
+		int found = -1;
+		int i;
+		while ((i = id_index_next(input[n].id, &pos)) >= 0)
+		{
+			if (i == n || input[i].mouse) continue;
+			if (found < 0 || input[i].bind == i) found = i;
+		}
+
+		if (!input[n].mouse)
+		{
+			if (found >= 0)
+			{
+				input[n].bind = input[found].bind;
+			}
+			else
+			{
+				// first node of the device, take mice opened before it
+				bool changed = false;
+				pos = str_hash(input[n].id);
+				while ((i = id_index_next(input[n].id, &pos)) >= 0)
+				{
+					if (i == n || !input[i].mouse || input[i].bind != i || input[i].quirk) continue;
+					merge_mouse(i, n);
+					changed = true;
+				}
 
-					if (input[i].quirk == QUIRK_MSSP) strcat(input[i].id, "_sp");
+				// ids of mice used as spinners are changed
+				if (changed)
+				{
+					id_index_rebuild();
+					return true;
 				}
-				break;
 			}
 		}
+		else if (found >= 0)
+		{
+			merge_mouse(n, found);
+		}
 	}
+
+	id_index_add(n);
+	return true;
 }
 
 // Jammasd/J-PAC/I-PAC have shifted keys: when 1P start is kept pressed, it acts as a shift key,
@@ -3969,7 +4356,7 @@ static void touchscreen_proc(int dev, input_event *ev)
 		mice_btn = 0;
 		mouse_btn_req();
 		input[dev].lightgun = !input[dev].lightgun;
-		Info(input[dev].lightgun ? "Light Gun mode is ON" : "Light Gun mode is OFF");
+		input_info(input[dev].lightgun ? "Light Gun mode is ON" : "Light Gun mode is OFF");
 	}
 
 	if (input[dev].lightgun)
@@ -4120,7 +4507,7 @@ static int vcs_proc(int dev, input_event *ev)
 				inp->mod = !inp->mod;
 				inp->has_map = 0;
 				inp->has_mmap = 0;
-				Info(inp->mod ? "8-button mode" : "5-button mode");
+				input_info(inp->mod ? "8-button mode" : "5-button mode");
 			}
 		}
 		if (ev->code == 0x131 && inp->mod) return 0;
@@ -4152,7 +4539,7 @@ static int vcs_proc(int dev, input_event *ev)
 			if ((inp->misc_flags & 0x1F) == 0xB && ((inp->misc_flags & 0x20) ? (diff < -30) : (diff > 30)))
 			{
 				inp->misc_flags ^= 0x20;
-				Info((inp->misc_flags & 0x20) ? "Spinner: Enabled" : "Spinner: Disabled");
+				input_info((inp->misc_flags & 0x20) ? "Spinner: Enabled" : "Spinner: Disabled");
 			}
 
 			if (inp->misc_flags & 0x20)
@@ -4433,13 +4820,14 @@ static void set_wheel_range(int dev, int range)
 	}
 }
 
-static void setup_wheels()
+// dev < 0 - all devices
+static void setup_wheels(int dev = -1)
 {
 	if (cfg.wheel_force > 100) cfg.wheel_force = 100;
 
 	for (int i = 0; i < NUMDEV; i++)
 	{
-		if (pool[i].fd != -1)
+		if (pool[i].fd != -1 && (dev < 0 || dev == i))
 		{
 			// steering wheel axis
 			input[i].wh_steer = 0;
@@ -4603,363 +4991,702 @@ static void setup_wheels()
 	}
 }
 
-int input_test(int getchar)
+static void input_watch_fd(int fd, uint32_t events)
 {
-	static char cur_leds = 0;
-	static int state = 0;
-	struct input_absinfo absinfo;
-	struct input_event ev;
-	static uint32_t timeout = 0;
+	scheduler_watch_fd(fd, events);
+	inputthread_watch_fd(fd, events);
+}
 
-	if (touch_rel && CheckTimer(touch_rel))
+// Reads all pending events of the device at once.
+// Within one SYN_REPORT frame only the last value of each axis is kept,
+// earlier ones are cleared (type 0 is skipped by the caller).
+// Multi-touch axes are reported per slot, so they are never collapsed.
+#define EVBUF_SIZE 64
+static int input_read_events(int dev, struct input_event *evbuf, int size)
+{
+	int len = read(pool[dev].fd, evbuf, size * sizeof(struct input_event));
+	if (len < (int)sizeof(struct input_event)) return 0;
+
+	int cnt = len / sizeof(struct input_event);
+	inputrec_events(dev, input[dev].gen, evbuf, cnt);
+
+	int frame = 0;
+	for (int n = 0; n < cnt; n++)
 	{
-		touch_rel = 0;
-		mice_btn = 0;
-		mouse_btn_req();
+		if (evbuf[n].type == EV_SYN)
+		{
+			if (evbuf[n].code == SYN_REPORT) frame = n + 1;
+		}
+		else if (evbuf[n].type == EV_ABS && evbuf[n].code < ABS_MT_SLOT)
+		{
+			for (int k = frame; k < n; k++)
+			{
+				if (evbuf[k].type == EV_ABS && evbuf[k].code == evbuf[n].code)
+				{
+					evbuf[k].type = 0;
+					evbuf[k].code = SYN_CONFIG;
+					break;
+				}
+			}
+		}
 	}
 
-	if (state == 0)
-	{
-		input_uinp_setup();
-		memset(pool, -1, sizeof(pool));
+	return cnt;
+}
 
-		signal(SIGINT, INThandler);
-		pool[NUMDEV].fd = set_watch();
-		pool[NUMDEV].events = POLLIN;
+#ifdef PROFILING
+/*
+ * End-to-end input latency.
+ * Event timestamps are switched to CLOCK_MONOTONIC, so kernel receive time
+ * can be compared with the time the event is dispatched and the time the
+ * resulting state has been written to the core by user_io.
+ */
 
-		unlink(CMD_FIFO);
-		mkfifo(CMD_FIFO, 0666);
+static uint64_t *input_lat_pending = NULL;         // kernel time of first event not yet sent to the core
+static const char *(*input_lat_hist)[2] = NULL;    // dispatch, sent
 
-		pool[NUMDEV+1].fd = open(CMD_FIFO, O_RDWR | O_NONBLOCK | O_CLOEXEC);
-		pool[NUMDEV+1].events = POLLIN;
+static uint64_t input_lat_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-		pool[NUMDEV + 2].fd = open(LED_MONITOR, O_RDONLY | O_CLOEXEC);
-		pool[NUMDEV + 2].events = POLLPRI;
+// Histogram names must be persistent, same device type reuses the same histogram.
+static const char *input_lat_name(const char *name)
+{
+	static char names[64][48];
+	static int count = 0;
 
-		state++;
-	}
+	for (int i = 0; i < count; i++) if (!strcmp(names[i], name)) return names[i];
+	if (count >= 64) return "input other";
 
-	if (state == 1)
-	{
-		timeout = 0;
-		printf("Open up to %d input devices.\n", NUMDEV);
-		for (int i = 0; i < NUMDEV; i++)
-		{
-			pool[i].fd = -1;
-			pool[i].events = 0;
-		}
+	strcpyz(names[count], name);
+	return names[count++];
+}
 
-		memset(input, 0, sizeof(input));
+static void input_lat_open(int dev)
+{
+	int clk = CLOCK_MONOTONIC;
+	ioctl(pool[dev].fd, EVIOCSCLOCKID, &clk);
+
+	const char *bus = (input[dev].bustype == BUS_USB) ? "usb" : (input[dev].bustype == BUS_BLUETOOTH) ? "bt" : "other";
+	char name[48];
+	snprintf(name, sizeof(name), "input %s %04x:%04x dispatch", bus, input[dev].vid, input[dev].pid);
+	input_lat_hist[dev][0] = input_lat_name(name);
+	snprintf(name, sizeof(name), "input %s %04x:%04x sent", bus, input[dev].vid, input[dev].pid);
+	input_lat_hist[dev][1] = input_lat_name(name);
+	input_lat_pending[dev] = 0;
+}
 
-		int n = 0;
-		DIR *d = opendir("/dev/input");
-		if (d)
+static void input_lat_event(int dev, const struct input_event *ev)
+{
+	if (!input_lat_hist[dev][0]) return;
+
+	uint64_t now = input_lat_now();
+	uint64_t kernel = (uint64_t)ev->time.tv_sec * 1000000000ULL + (uint64_t)ev->time.tv_usec * 1000;
+	if (kernel > now) return;
+
+	profiling_histogram_add(input_lat_hist[dev][0], now - kernel);
+	if (!input_lat_pending[dev]) input_lat_pending[dev] = kernel;
+}
+
+// Device whose events input_test is dispatching, -1 outside of it.
+static int input_lat_dev = -1;
+
+// Called by user_io after state has been written to the core. While a device
+// is dispatched only its own sample completes, deferred sends from input_poll
+// (mouse throttle, autofire, analog flush) complete every pending sample.
+void input_lat_sent()
+{
+	InputLock input_lock;
+	if (!input_lat_pending) return;
+
+	uint64_t now = 0;
+	for (int i = 0; i < NUMDEV; i++)
+	{
+		if (!input_lat_pending[i]) continue;
+		if (input_lat_dev >= 0 && input_lat_dev != i) continue;
+
+		if (!now) now = input_lat_now();
+		profiling_histogram_add(input_lat_hist[i][1], now - input_lat_pending[i]);
+		input_lat_pending[i] = 0;
+	}
+}
+
+static void input_lat_poll()
+{
+	static uint64_t prev = 0;
+	uint64_t now = input_lat_now();
+	if (prev) profiling_histogram_add("input poll interval", now - prev);
+	prev = now;
+}
+#endif
+
+// Grows device table to hold at least count devices, existing entries keep their index.
+static bool input_grow(int count)
+{
+	if (count <= numdev) return true;
+
+	int size = numdev ? numdev : NUMDEV_INIT;
+	while (size < count) size *= 2;
+
+	devInput *new_input = (devInput *)realloc(input, size * sizeof(devInput));
+	if (!new_input) return false;
+	input = new_input;
+	memset(&input[numdev], 0, (size - numdev) * sizeof(devInput));
+
+	uint32_t *new_crtgun = (uint32_t *)realloc(crtgun_timeout, size * sizeof(uint32_t));
+	if (!new_crtgun) return false;
+	crtgun_timeout = new_crtgun;
+	memset(&crtgun_timeout[numdev], 0, (size - numdev) * sizeof(uint32_t));
+
+#ifdef PROFILING
+	uint64_t *new_pending = (uint64_t *)realloc(input_lat_pending, size * sizeof(uint64_t));
+	if (!new_pending) return false;
+	input_lat_pending = new_pending;
+	memset(&input_lat_pending[numdev], 0, (size - numdev) * sizeof(uint64_t));
+
+	const char *(*new_hist)[2] = (const char *(*)[2])realloc(input_lat_hist, size * sizeof(*input_lat_hist));
+	if (!new_hist) return false;
+	input_lat_hist = new_hist;
+	memset(&input_lat_hist[numdev], 0, (size - numdev) * sizeof(*input_lat_hist));
+#endif
+
+	struct pollfd *new_pool = (struct pollfd *)realloc(pool, (size + 3) * sizeof(struct pollfd));
+	if (!new_pool) return false;
+	pool = new_pool;
+
+	// move service descriptors to the new end
+	if (numdev) memmove(&pool[size], &pool[numdev], 3 * sizeof(struct pollfd));
+	else memset(&pool[size], -1, 3 * sizeof(struct pollfd));
+
+	for (int i = numdev; i < size; i++)
+	{
+		pool[i].fd = -1;
+		pool[i].events = 0;
+		pool[i].revents = 0;
+	}
+
+	if (numdev) printf("Input device table grown to %d entries.\n", size);
+	numdev = size;
+	return true;
+}
+
+// Opens /dev/input/<name> into slot n and applies device quirks.
+// Returns 0 if device can't be opened or isn't used.
+static int input_open_device(int n, const char *name)
+{
+	// new generation for every open, slots and node names are reused after hotplug
+	static uint32_t open_gen = 0;
+
+	memset(&input[n], 0, sizeof(input[n]));
+	input[n].gen = ++open_gen;
+	sprintf(input[n].devname, "/dev/input/%s", name);
+	int fd = open(input[n].devname, O_RDWR | O_CLOEXEC);
+	//printf("open(%s): %d\n", input[n].devname, fd);
+
+	if (fd <= 0) return 0;
+
+	pool[n].fd = fd;
+	pool[n].events = POLLIN;
+	input[n].mouse = !strncmp(name, "mouse", 5);
+
+	char uniq[32] = {};
+	if (!input[n].mouse)
+	{
+		struct input_id id;
+		memset(&id, 0, sizeof(id));
+		ioctl(pool[n].fd, EVIOCGID, &id);
+		input[n].vid = id.vendor;
+		input[n].pid = id.product;
+		input[n].version = id.version;
+		input[n].bustype = id.bustype;
+
+		ioctl(pool[n].fd, EVIOCGUNIQ(sizeof(uniq)), uniq);
+		ioctl(pool[n].fd, EVIOCGNAME(sizeof(input[n].name)), input[n].name);
+		input[n].led = has_led(pool[n].fd);
+#ifdef PROFILING
+		input_lat_open(n);
+#endif
+	}
+
+	//skip our virtual device
+	if (!strcmp(input[n].name, UINPUT_NAME))
+	{
+		close(pool[n].fd);
+
+		pool[n].fd = -1;
+		return 0;
+	}
+
+	input[n].bind = -1;
+
+	int effects;
+	input[n].has_rumble = false;
+	if (cfg.rumble)
+	{
+		if (ioctl(fd, EVIOCGEFFECTS, &effects) >= 0)
 		{
-			struct dirent *de;
-			while ((de = readdir(d)))
+			unsigned char ff_features[(FF_MAX + 7) / 8] = {};
+
+			if (ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ff_features)), ff_features) != -1)
 			{
-				if (!strncmp(de->d_name, "event", 5) || !strncmp(de->d_name, "mouse", 5))
+				if (test_bit(FF_RUMBLE, ff_features)) {
+					input[n].rumble_effect.id = -1;
+					input[n].has_rumble = true;
+				}
+			}
+		}
+	}
+
+	// enable scroll wheel reading
+	if (input[n].mouse)
+	{
+		unsigned char buffer[4];
+		static const unsigned char mousedev_imps_seq[] = { 0xf3, 200, 0xf3, 100, 0xf3, 80 };
+		if (write(pool[n].fd, mousedev_imps_seq, sizeof(mousedev_imps_seq)) != sizeof(mousedev_imps_seq))
+		{
+			printf("Cannot switch %s to ImPS/2 protocol(1)\n", input[n].devname);
+		}
+		else if (read(pool[n].fd, buffer, sizeof buffer) != 1 || buffer[0] != 0xFA)
+		{
+			printf("Failed to switch %s to ImPS/2 protocol(2)\n", input[n].devname);
+		}
+	}
+
+	// RasPad3 touchscreen
+	if (input[n].vid == 0x222a && input[n].pid == 1)
+	{
+		input[n].quirk = QUIRK_TOUCHGUN;
+		input[n].num = 1;
+		input[n].map_shown = 1;
+
+		input[n].lightgun = 0;
+		input[n].guncal[0] = 0;
+		input[n].guncal[1] = 16383;
+		input[n].guncal[2] = 2047;
+		input[n].guncal[3] = 14337;
+		input_lightgun_load(n);
+	}
+
+	if (input[n].vid == 0x054c)
+	{
+		if (strcasestr(input[n].name, "Motion"))
+		{
+			// don't use Accelerometer
+			close(pool[n].fd);
+			pool[n].fd = -1;
+			return 0;
+		}
+
+		if (input[n].pid == 0x0268)  input[n].quirk = QUIRK_DS3;
+		else if (input[n].pid == 0x05c4 || input[n].pid == 0x09cc || input[n].pid == 0x0ba0 || input[n].pid == 0x0ce6)
+		{
+			input[n].quirk = QUIRK_DS4;
+			if (strcasestr(input[n].name, "Touchpad"))
+			{
+				input[n].quirk = QUIRK_DS4TOUCH;
+			}
+		}
+	}
+
+	if (input[n].vid == 0x0079 && input[n].pid == 0x1802)
+	{
+		input[n].lightgun = 1;
+		input[n].num = 2; // force mayflash mode 1/2 as second joystick.
+	}
+
+	if (input[n].vid == 0x057e && (input[n].pid == 0x0306 || input[n].pid == 0x0330))
+	{
+		if (strcasestr(input[n].name, "Accelerometer"))
+		{
+			// don't use Accelerometer
+			close(pool[n].fd);
+			pool[n].fd = -1;
+			return 0;
+		}
+		else if (strcasestr(input[n].name, "Motion Plus"))
+		{
+			// don't use Accelerometer
+			close(pool[n].fd);
+			pool[n].fd = -1;
+			return 0;
+		}
+		else
+		{
+			input[n].quirk = QUIRK_WIIMOTE;
+			input[n].guncal[0] = 0;
+			input[n].guncal[1] = 767;
+			input[n].guncal[2] = 1;
+			input[n].guncal[3] = 1023;
+			input_lightgun_load(n);
+		}
+	}
+
+	if (input[n].vid == 0x057e)
+	{
+		if (strstr(input[n].name, " IMU"))
+		{
+			// don't use Accelerometer
+			close(pool[n].fd);
+			pool[n].fd = -1;
+			return 0;
+		}
+	}
+
+	if (input[n].vid == 0x057e && input[n].pid == 0x2006)
+	{
+		input[n].misc_flags = 1 << 30;
+		input[n].quirk = QUIRK_JOYCON;
+	}
+	if (input[n].vid == 0x057e && input[n].pid == 0x2007)
+	{
+		input[n].misc_flags = 1 << 29;
+		input[n].quirk = QUIRK_JOYCON;
+	}
+
+	//Ultimarc lightgun
+	if (input[n].vid == 0xd209 && input[n].pid == 0x1601)
+	{
+		input[n].lightgun = 1;
+	}
+
+	//Namco Guncon via Arduino, RetroZord or Reflex Adapt
+	if (((input[n].vid == 0x2341 || (input[n].vid == 0x1209 && input[n].pid == 0x595A)) && (strstr(uniq, "RZordPsGun") || strstr(input[n].name, "RZordPsGun"))) ||
+		(input[n].vid == 0x16D0 && input[n].pid == 0x127E && (strstr(uniq, "ReflexPSGun") || strstr(input[n].name, "ReflexPSGun"))))
+	{
+		input[n].quirk = QUIRK_LIGHTGUN;
+		input[n].lightgun = 1;
+		input[n].guncal[0] = 0;
+		input[n].guncal[1] = 32767;
+		input[n].guncal[2] = 0;
+		input[n].guncal[3] = 32767;
+		input_lightgun_load(n);
+	}
+
+	//Namco GunCon 2
+	if (input[n].vid == 0x0b9a && input[n].pid == 0x016a)
+	{
+		input[n].quirk = QUIRK_LIGHTGUN_CRT;
+		input[n].lightgun = 1;
+		input[n].guncal[0] = 25;
+		input[n].guncal[1] = 245;
+		input[n].guncal[2] = 145;
+		input[n].guncal[3] = 700;
+		input_lightgun_load(n);
+	}
+
+	//Namco GunCon 3
+	if (input[n].vid == 0x0b9a && input[n].pid == 0x0800)
+	{
+		input[n].quirk = QUIRK_LIGHTGUN;
+		input[n].lightgun = 1;
+		input[n].guncal[0] = -32768;
+		input[n].guncal[1] = 32767;
+		input[n].guncal[2] = -32768;
+		input[n].guncal[3] = 32767;
+		input_lightgun_load(n);
+	}
+
+	//GUN4IR Lightgun
+	if (input[n].vid == 0x2341 && input[n].pid >= 0x8042 && input[n].pid <= 0x8049)
+	{
+		input[n].quirk = QUIRK_LIGHTGUN;
+		input[n].lightgun = 1;
+		input[n].guncal[0] = 0;
+		input[n].guncal[1] = 32767;
+		input[n].guncal[2] = 0;
+		input[n].guncal[3] = 32767;
+		input_lightgun_load(n);
+	}
+
+	//Madcatz Arcade Stick 360
+	if (input[n].vid == 0x0738 && input[n].pid == 0x4758) input[n].quirk = QUIRK_MADCATZ360;
+
+	// mr.Spinner
+	// 0x120  - Button
+	// Axis 7 - EV_REL is spinner
+	// Axis 8 - EV_ABS is Paddle
+	// Overlays on other existing gamepads
+	if (strstr(uniq, "MiSTer-S1")) input[n].quirk = QUIRK_PDSP;
+	if (strstr(input[n].name, "MiSTer-S1")) input[n].quirk = QUIRK_PDSP;
+
+	// Arcade with spinner and/or paddle:
+	// Axis 7 - EV_REL is spinner
+	// Axis 8 - EV_ABS is Paddle
+	// Includes other buttons and axes, works as a full featured gamepad.
+	if (strstr(uniq, "MiSTer-A1")) input[n].quirk = QUIRK_PDSP_ARCADE;
+	if (strstr(input[n].name, "MiSTer-A1")) input[n].quirk = QUIRK_PDSP_ARCADE;
+
+	//Jamma
+	if (cfg.jamma_vid && cfg.jamma_pid && input[n].vid == cfg.jamma_vid && input[n].pid == cfg.jamma_pid)
+	{
+		input[n].quirk = QUIRK_JAMMA;
+	}
+
+	//Jamma2
+	if (cfg.jamma2_vid && cfg.jamma2_pid && input[n].vid == cfg.jamma2_vid && input[n].pid == cfg.jamma2_pid)
+	{
+		input[n].quirk = QUIRK_JAMMA2;
+	}
+
+	//Atari VCS wireless joystick with spinner
+	if (input[n].vid == 0x3250 && input[n].pid == 0x1001)
+	{
+		input[n].quirk = QUIRK_VCS;
+		input[n].spinner_acc = -1;
+		input[n].misc_flags = 0;
+	}
+
+	//Arduino and Teensy devices may share the same VID:PID, so additional field UNIQ is used to differentiate them
+	//Reflex Adapt also uses the UNIQ field to differentiate between device modes
+	//RetroZord Adapter also uses the UNIQ field to differentiate between device modes
+	if ((input[n].vid == 0x2341 || (input[n].vid == 0x16C0 && (input[n].pid>>8) == 0x4) || (input[n].vid == 0x16D0 && input[n].pid == 0x127E) || (input[n].vid == 0x1209 && input[n].pid == 0x595A)) && strlen(uniq))
+	{
+		snprintf(input[n].idstr, sizeof(input[n].idstr), "%04x_%04x_%s", input[n].vid, input[n].pid, uniq);
+		char *p;
+		while ((p = strchr(input[n].idstr, '/'))) *p = '_';
+		while ((p = strchr(input[n].idstr, ' '))) *p = '_';
+		while ((p = strchr(input[n].idstr, '*'))) *p = '_';
+		while ((p = strchr(input[n].idstr, ':'))) *p = '_';
+		strcpy(input[n].name, uniq);
+	}
+	else if (input[n].vid == 0x1209 && (input[n].pid == 0xFACE || input[n].pid == 0xFACA))
+	{
+		int sum = 0;
+		for (uint32_t i = 0; i < sizeof(input[n].name); i++)
+		{
+			if (!input[n].name[i]) break;
+			sum += (uint8_t)input[n].name[i];
+		}
+		snprintf(input[n].idstr, sizeof(input[n].idstr), "%04x_%04x_%d", input[n].vid, input[n].pid, sum);
+	}
+	else
+	{
+		snprintf(input[n].idstr, sizeof(input[n].idstr), "%04x_%04x", input[n].vid, input[n].pid);
+	}
+
+	ioctl(pool[n].fd, EVIOCGRAB, (grabbed | user_io_osd_is_visible()) ? 1 : 0);
+	pool[n].revents = 0;
+	inputrec_device(n, input[n].gen, pool[n].fd, input[n].devname);
+	return 1;
+}
+
+// Applies device nodes created/removed since last check_devs() without touching other devices.
+// Returns false if full rescan is required to keep device bindings consistent.
+static bool input_hotplug()
+{
+	int added[HOTPLUG_MAX * 2];
+	int added_cnt = 0;
+
+	for (int k = 0; k < hotplug_cnt; k++)
+	{
+		char devname[64];
+		snprintf(devname, sizeof(devname), "/dev/input/%s", hotplug_ops[k].name);
+
+		int n = -1;
+		for (int i = 0; i < NUMDEV; i++) if (pool[i].fd >= 0 && !strcmp(input[i].devname, devname)) n = i;
+
+		if (!hotplug_ops[k].add)
+		{
+			if (n < 0) continue;
+
+			int orphan[HOTPLUG_MAX];
+			int orphan_cnt = 0;
+
+			if (input[n].quirk == QUIRK_JOYCON)
+			{
+				// joycon pairs are combined by check_joycon() on full scan only
+				for (int i = 0; i < NUMDEV; i++) if (i != n && pool[i].fd >= 0 && input[i].bind == n) return false;
+			}
+			else if (input[n].bind == n && input[n].id[0])
+			{
+				// other nodes of the device are bound to the same id, next node takes over
+				int p = -1;
+				int i;
+				uint32_t pos = str_hash(input[n].id);
+				while ((i = id_index_next(input[n].id, &pos)) >= 0)
 				{
-					memset(&input[n], 0, sizeof(input[n]));
-					sprintf(input[n].devname, "/dev/input/%s", de->d_name);
-					int fd = open(input[n].devname, O_RDWR | O_CLOEXEC);
-					//printf("open(%s): %d\n", input[n].devname, fd);
+					if (i != n && input[i].bind == n && !input[i].mouse && (p < 0 || i < p)) p = i;
+				}
 
-					if (fd > 0)
-					{
-						pool[n].fd = fd;
-						pool[n].events = POLLIN;
-						input[n].mouse = !strncmp(de->d_name, "mouse", 5);
+				pos = str_hash(input[n].id);
+				while ((i = id_index_next(input[n].id, &pos)) >= 0)
+				{
+					if (i == n || input[i].bind != n) continue;
+					if (p >= 0) input[i].bind = p;
+					else if (orphan_cnt < HOTPLUG_MAX) orphan[orphan_cnt++] = i;
+					else return false;
+				}
 
-						char uniq[32] = {};
-						if (!input[n].mouse)
-						{
-							struct input_id id;
-							memset(&id, 0, sizeof(id));
-							ioctl(pool[n].fd, EVIOCGID, &id);
-							input[n].vid = id.vendor;
-							input[n].pid = id.product;
-							input[n].version = id.version;
-							input[n].bustype = id.bustype;
-
-							ioctl(pool[n].fd, EVIOCGUNIQ(sizeof(uniq)), uniq);
-							ioctl(pool[n].fd, EVIOCGNAME(sizeof(input[n].name)), input[n].name);
-							input[n].led = has_led(pool[n].fd);
-						}
+				if (p >= 0)
+				{
+					printf("bound %d: %s\n", p, input[p].devname);
+					input[p].bind = p;
+					input[p].num = input[n].num;
+					input[p].map_shown = input[n].map_shown;
+					restore_player(p);
+				}
+			}
 
-						//skip our virtual device
-						if (!strcmp(input[n].name, UINPUT_NAME))
-						{
-							close(pool[n].fd);
+			printf("closed %d: %s\n", n, input[n].devname);
+			inputrec_remove(n, input[n].gen);
+			ioctl(pool[n].fd, EVIOCGRAB, 0);
+			close(pool[n].fd);
+			pool[n].fd = -1;
+			pool[n].events = 0;
+			memset(&input[n], 0, sizeof(input[n]));
 
-							pool[n].fd = -1;
-							continue;
-						}
+			for (int i = 0; i < added_cnt; i++) if (added[i] == n) added[i--] = added[--added_cnt];
+			id_index_rebuild();
 
-						input[n].bind = -1;
+			// mice left without device are opened again as standalone mice
+			for (int o = 0; o < orphan_cnt; o++)
+			{
+				int m = orphan[o];
+				char name[32];
+				snprintf(name, sizeof(name), "%s", strrchr(input[m].devname, '/') + 1);
 
-						int effects;
-						input[n].has_rumble = false;
-						if (cfg.rumble)
-						{
-							if (ioctl(fd, EVIOCGEFFECTS, &effects) >= 0)
-							{
-								unsigned char ff_features[(FF_MAX + 7) / 8] = {};
+				ioctl(pool[m].fd, EVIOCGRAB, 0);
+				close(pool[m].fd);
+				pool[m].fd = -1;
+				pool[m].events = 0;
+				id_index_rebuild();
 
-								if (ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ff_features)), ff_features) != -1)
-								{
-									if (test_bit(FF_RUMBLE, ff_features)) {
-										input[n].rumble_effect.id = -1;
-										input[n].has_rumble = true;
-									}
-								}
-							}
-						}
+				bool found = false;
+				for (int i = 0; i < added_cnt; i++) if (added[i] == m) found = true;
 
-						// enable scroll wheel reading
-						if (input[n].mouse)
-						{
-							unsigned char buffer[4];
-							static const unsigned char mousedev_imps_seq[] = { 0xf3, 200, 0xf3, 100, 0xf3, 80 };
-							if (write(pool[n].fd, mousedev_imps_seq, sizeof(mousedev_imps_seq)) != sizeof(mousedev_imps_seq))
-							{
-								printf("Cannot switch %s to ImPS/2 protocol(1)\n", input[n].devname);
-							}
-							else if (read(pool[n].fd, buffer, sizeof buffer) != 1 || buffer[0] != 0xFA)
-							{
-								printf("Failed to switch %s to ImPS/2 protocol(2)\n", input[n].devname);
-							}
-						}
+				if (!input_open_device(m, name))
+				{
+					memset(&input[m], 0, sizeof(input[m]));
+					if (found) for (int i = 0; i < added_cnt; i++) if (added[i] == m) added[i--] = added[--added_cnt];
+					continue;
+				}
 
-						// RasPad3 touchscreen
-						if (input[n].vid == 0x222a && input[n].pid == 1)
-						{
-							input[n].quirk = QUIRK_TOUCHGUN;
-							input[n].num = 1;
-							input[n].map_shown = 1;
-
-							input[n].lightgun = 0;
-							input[n].guncal[0] = 0;
-							input[n].guncal[1] = 16383;
-							input[n].guncal[2] = 2047;
-							input[n].guncal[3] = 14337;
-							input_lightgun_load(n);
-						}
+				if (!mergedev(m) || (!found && added_cnt >= HOTPLUG_MAX * 2)) return false;
+				if (!found) added[added_cnt++] = m;
+			}
+			continue;
+		}
 
-						if (input[n].vid == 0x054c)
-						{
-							if (strcasestr(input[n].name, "Motion"))
-							{
-								// don't use Accelerometer
-								close(pool[n].fd);
-								pool[n].fd = -1;
-								continue;
-							}
+		if (n >= 0) continue;
 
-							if (input[n].pid == 0x0268)  input[n].quirk = QUIRK_DS3;
-							else if (input[n].pid == 0x05c4 || input[n].pid == 0x09cc || input[n].pid == 0x0ba0 || input[n].pid == 0x0ce6)
-							{
-								input[n].quirk = QUIRK_DS4;
-								if (strcasestr(input[n].name, "Touchpad"))
-								{
-									input[n].quirk = QUIRK_DS4TOUCH;
-								}
-							}
-						}
+		for (n = 0; n < NUMDEV; n++) if (pool[n].fd < 0) break;
+		if (n >= NUMDEV && !input_grow(n + 1)) return false;
 
-						if (input[n].vid == 0x0079 && input[n].pid == 0x1802)
-						{
-							input[n].lightgun = 1;
-							input[n].num = 2; // force mayflash mode 1/2 as second joystick.
-						}
+		if (!input_open_device(n, hotplug_ops[k].name))
+		{
+			memset(&input[n], 0, sizeof(input[n]));
+			continue;
+		}
 
-						if (input[n].vid == 0x057e && (input[n].pid == 0x0306 || input[n].pid == 0x0330))
-						{
-							if (strcasestr(input[n].name, "Accelerometer"))
-							{
-								// don't use Accelerometer
-								close(pool[n].fd);
-								pool[n].fd = -1;
-								continue;
-							}
-							else if (strcasestr(input[n].name, "Motion Plus"))
-							{
-								// don't use Accelerometer
-								close(pool[n].fd);
-								pool[n].fd = -1;
-								continue;
-							}
-							else
-							{
-								input[n].quirk = QUIRK_WIIMOTE;
-								input[n].guncal[0] = 0;
-								input[n].guncal[1] = 767;
-								input[n].guncal[2] = 1;
-								input[n].guncal[3] = 1023;
-								input_lightgun_load(n);
-							}
-						}
+		if (input[n].quirk == QUIRK_JOYCON || added_cnt >= HOTPLUG_MAX * 2 || !mergedev(n)) return false;
+		added[added_cnt++] = n;
+	}
 
-						if (input[n].vid == 0x057e)
-						{
-							if (strstr(input[n].name, " IMU"))
-							{
-								// don't use Accelerometer
-								close(pool[n].fd);
-								pool[n].fd = -1;
-								continue;
-							}
-						}
+	hotplug_cnt = 0;
 
-						if (input[n].vid == 0x057e && input[n].pid == 0x2006)
-						{
-							input[n].misc_flags = 1 << 30;
-							input[n].quirk = QUIRK_JOYCON;
-						}
-						if (input[n].vid == 0x057e && input[n].pid == 0x2007)
-						{
-							input[n].misc_flags = 1 << 29;
-							input[n].quirk = QUIRK_JOYCON;
-						}
+	struct input_event ev;
+	for (int k = 0; k < added_cnt; k++)
+	{
+		int i = added[k];
 
-						//Ultimarc lightgun
-						if (input[n].vid == 0xd209 && input[n].pid == 0x1601)
-						{
-							input[n].lightgun = 1;
-						}
+		setup_wheels(i);
+		printf("opened %d(%2d): %s (%04x:%04x:%08x) %d \"%s\" \"%s\"\n", i, input[i].bind, input[i].devname, input[i].vid, input[i].pid, input[i].unique_hash, input[i].quirk, input[i].id, input[i].name);
+		restore_player(i);
+		setup_deadzone(&ev, i);
+		input_watch_fd(pool[i].fd, EPOLLIN);
+	}
+	unflag_players();
 
-						//Namco Guncon via Arduino, RetroZord or Reflex Adapt
-						if (((input[n].vid == 0x2341 || (input[n].vid == 0x1209 && input[n].pid == 0x595A)) && (strstr(uniq, "RZordPsGun") || strstr(input[n].name, "RZordPsGun"))) ||
-							(input[n].vid == 0x16D0 && input[n].pid == 0x127E && (strstr(uniq, "ReflexPSGun") || strstr(input[n].name, "ReflexPSGun"))))
-						{
-							input[n].quirk = QUIRK_LIGHTGUN;
-							input[n].lightgun = 1;
-							input[n].guncal[0] = 0;
-							input[n].guncal[1] = 32767;
-							input[n].guncal[2] = 0;
-							input[n].guncal[3] = 32767;
-							input_lightgun_load(n);
-						}
+	return true;
+}
 
-						//Namco GunCon 2
-						if (input[n].vid == 0x0b9a && input[n].pid == 0x016a)
-						{
-							input[n].quirk = QUIRK_LIGHTGUN_CRT;
-							input[n].lightgun = 1;
-							input[n].guncal[0] = 25;
-							input[n].guncal[1] = 245;
-							input[n].guncal[2] = 145;
-							input[n].guncal[3] = 700;
-							input_lightgun_load(n);
-						}
+int input_test(int getchar)
+{
+	static char cur_leds = 0;
+	static int state = 0;
+	struct input_absinfo absinfo;
+	struct input_event ev;
+	static uint32_t timeout = 0;
 
-						//Namco GunCon 3
-						if (input[n].vid == 0x0b9a && input[n].pid == 0x0800)
-						{
-							input[n].quirk = QUIRK_LIGHTGUN;
-							input[n].lightgun = 1;
-							input[n].guncal[0] = -32768;
-							input[n].guncal[1] = 32767;
-							input[n].guncal[2] = -32768;
-							input[n].guncal[3] = 32767;
-							input_lightgun_load(n);
-						}
+	// input thread only processes device events, setup and hotplug are done by main loop
+	bool on_thread = inputthread_self();
+	if (on_thread && state != 2) return 0;
 
-						//GUN4IR Lightgun
-						if (input[n].vid == 0x2341 && input[n].pid >= 0x8042 && input[n].pid <= 0x8049)
-						{
-							input[n].quirk = QUIRK_LIGHTGUN;
-							input[n].lightgun = 1;
-							input[n].guncal[0] = 0;
-							input[n].guncal[1] = 32767;
-							input[n].guncal[2] = 0;
-							input[n].guncal[3] = 32767;
-							input_lightgun_load(n);
-						}
+	if (touch_rel && CheckTimer(touch_rel))
+	{
+		touch_rel = 0;
+		mice_btn = 0;
+		mouse_btn_req();
+	}
 
-						//Madcatz Arcade Stick 360
-						if (input[n].vid == 0x0738 && input[n].pid == 0x4758) input[n].quirk = QUIRK_MADCATZ360;
-
-						// mr.Spinner
-						// 0x120  - Button
-						// Axis 7 - EV_REL is spinner
-						// Axis 8 - EV_ABS is Paddle
-						// Overlays on other existing gamepads
-						if (strstr(uniq, "MiSTer-S1")) input[n].quirk = QUIRK_PDSP;
-						if (strstr(input[n].name, "MiSTer-S1")) input[n].quirk = QUIRK_PDSP;
-
-						// Arcade with spinner and/or paddle:
-						// Axis 7 - EV_REL is spinner
-						// Axis 8 - EV_ABS is Paddle
-						// Includes other buttons and axes, works as a full featured gamepad.
-						if (strstr(uniq, "MiSTer-A1")) input[n].quirk = QUIRK_PDSP_ARCADE;
-						if (strstr(input[n].name, "MiSTer-A1")) input[n].quirk = QUIRK_PDSP_ARCADE;
-
-						//Jamma
-						if (cfg.jamma_vid && cfg.jamma_pid && input[n].vid == cfg.jamma_vid && input[n].pid == cfg.jamma_pid)
-						{
-							input[n].quirk = QUIRK_JAMMA;
-						}
+	if (state == 0)
+	{
+		input_uinp_setup();
+		input_grow(NUMDEV_INIT);
+		memset(pool, -1, (NUMDEV + 3) * sizeof(struct pollfd));
 
-						//Jamma2
-						if (cfg.jamma2_vid && cfg.jamma2_pid && input[n].vid == cfg.jamma2_vid && input[n].pid == cfg.jamma2_pid)
-						{
-							input[n].quirk = QUIRK_JAMMA2;
-						}
+		signal(SIGINT, INThandler);
+		pool[NUMDEV].fd = set_watch();
+		pool[NUMDEV].events = POLLIN;
 
-						//Atari VCS wireless joystick with spinner
-						if (input[n].vid == 0x3250 && input[n].pid == 0x1001)
-						{
-							input[n].quirk = QUIRK_VCS;
-							input[n].spinner_acc = -1;
-							input[n].misc_flags = 0;
-						}
+		unlink(CMD_FIFO);
+		mkfifo(CMD_FIFO, 0666);
 
-						//Arduino and Teensy devices may share the same VID:PID, so additional field UNIQ is used to differentiate them
-						//Reflex Adapt also uses the UNIQ field to differentiate between device modes
-						//RetroZord Adapter also uses the UNIQ field to differentiate between device modes
-						if ((input[n].vid == 0x2341 || (input[n].vid == 0x16C0 && (input[n].pid>>8) == 0x4) || (input[n].vid == 0x16D0 && input[n].pid == 0x127E) || (input[n].vid == 0x1209 && input[n].pid == 0x595A)) && strlen(uniq))
-						{
-							snprintf(input[n].idstr, sizeof(input[n].idstr), "%04x_%04x_%s", input[n].vid, input[n].pid, uniq);
-							char *p;
-							while ((p = strchr(input[n].idstr, '/'))) *p = '_';
-							while ((p = strchr(input[n].idstr, ' '))) *p = '_';
-							while ((p = strchr(input[n].idstr, '*'))) *p = '_';
-							while ((p = strchr(input[n].idstr, ':'))) *p = '_';
-							strcpy(input[n].name, uniq);
-						}
-						else if (input[n].vid == 0x1209 && (input[n].pid == 0xFACE || input[n].pid == 0xFACA))
-						{
-							int sum = 0;
-							for (uint32_t i = 0; i < sizeof(input[n].name); i++)
-							{
-								if (!input[n].name[i]) break;
-								sum += (uint8_t)input[n].name[i];
-							}
-							snprintf(input[n].idstr, sizeof(input[n].idstr), "%04x_%04x_%d", input[n].vid, input[n].pid, sum);
-						}
-						else
-						{
-							snprintf(input[n].idstr, sizeof(input[n].idstr), "%04x_%04x", input[n].vid, input[n].pid);
-						}
+		pool[NUMDEV+1].fd = open(CMD_FIFO, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		pool[NUMDEV+1].events = POLLIN;
 
-						ioctl(pool[n].fd, EVIOCGRAB, (grabbed | user_io_osd_is_visible()) ? 1 : 0);
+		pool[NUMDEV + 2].fd = open(LED_MONITOR, O_RDONLY | O_CLOEXEC);
+		pool[NUMDEV + 2].events = POLLPRI;
 
-						n++;
-						if (n >= NUMDEV) break;
-					}
+		// hotplug, MiSTer_cmd and LED are handled by main loop only
+		scheduler_watch_fd(pool[NUMDEV].fd, EPOLLIN);
+		scheduler_watch_fd(pool[NUMDEV + 1].fd, EPOLLIN);
+		scheduler_watch_fd(pool[NUMDEV + 2].fd, EPOLLPRI);
+
+		state++;
+	}
+
+	if (state == 1)
+	{
+		timeout = 0;
+		printf("Open input devices.\n");
+		for (int i = 0; i < NUMDEV; i++)
+		{
+			pool[i].fd = -1;
+			pool[i].events = 0;
+		}
+
+		memset(input, 0, NUMDEV * sizeof(devInput));
+
+		int n = 0;
+		DIR *d = opendir("/dev/input");
+		if (d)
+		{
+			struct dirent *de;
+			while ((de = readdir(d)))
+			{
+				if (!strncmp(de->d_name, "event", 5) || !strncmp(de->d_name, "mouse", 5))
+				{
+					if (n >= NUMDEV && !input_grow(n + 1)) break;
+					if (input_open_device(n, de->d_name)) n++;
+					else memset(&input[n], 0, sizeof(input[n]));
 				}
 			}
 			closedir(d);
 
 			mergedevs();
 			check_joycon();
+			id_index_rebuild();
 			setup_wheels();
 			for (int i = 0; i < n; i++)
 			{
 				printf("opened %d(%2d): %s (%04x:%04x:%08x) %d \"%s\" \"%s\"\n", i, input[i].bind, input[i].devname, input[i].vid, input[i].pid, input[i].unique_hash, input[i].quirk, input[i].id, input[i].name);
 				restore_player(i);
 				setup_deadzone(&ev, i);
+				input_watch_fd(pool[i].fd, EPOLLIN);
 			}
 			unflag_players();
 		}
@@ -4967,7 +5694,7 @@ int input_test(int getchar)
 		state++;
 	}
 
-	if (cfg.bt_auto_disconnect)
+	if (cfg.bt_auto_disconnect && !on_thread)
 	{
 		if (!timeout) timeout = GetTimer(6000);
 		else if (CheckTimer(timeout))
@@ -5016,7 +5743,8 @@ int input_test(int getchar)
 				}
 			}
 
-			int return_value = poll(pool, NUMDEV + 3, timeout);
+			int return_value = poll(pool, on_thread ? NUMDEV : NUMDEV + 3, timeout);
+			if (on_thread) pool[NUMDEV].revents = pool[NUMDEV + 1].revents = pool[NUMDEV + 2].revents = 0;
 			if (!return_value) break;
 
 			if (return_value < 0)
@@ -5025,7 +5753,14 @@ int input_test(int getchar)
 				break;
 			}
 
-			if ((pool[NUMDEV].revents & POLLIN) && check_devs())
+			int hotplug = (pool[NUMDEV].revents & POLLIN) ? check_devs() : 0;
+			if (hotplug == 2)
+			{
+				hotplug = input_hotplug() ? 0 : 1;
+				cur_leds |= 0x80;
+			}
+
+			if (hotplug)
 			{
 				printf("Close all devices.\n");
 				for (int i = 0; i < NUMDEV; i++) if (pool[i].fd >= 0)
@@ -5040,16 +5775,23 @@ int input_test(int getchar)
 			for (int pos = 0; pos < NUMDEV; pos++)
 			{
 				int i = pos;
-
+#ifdef PROFILING
+				input_lat_dev = pos;
+#endif
 
 				if ((pool[i].fd >= 0) && (pool[i].revents & POLLIN))
 				{
 					if (!input[i].mouse)
 					{
+						struct input_event evbuf[EVBUF_SIZE];
+						int evcnt = input_read_events(i, evbuf, getchar ? 1 : EVBUF_SIZE);
+						analog_defer = !getchar;
 
-						memset(&ev, 0, sizeof(ev));
-						if (read(pool[i].fd, &ev, sizeof(ev)) == sizeof(ev))
+						for (int evn = 0; evn < evcnt; evn++)
 						{
+							i = pos;
+							ev = evbuf[evn];
+
 							if (getchar)
 							{
 								if (ev.type == EV_KEY && ev.value >= 1)
@@ -5057,8 +5799,15 @@ int input_test(int getchar)
 									return ev.code;
 								}
 							}
-							else if (ev.type)
+							else if (ev.type == EV_SYN)
+							{
+								if (ev.code == SYN_REPORT) joy_analog_flush();
+							}
+							else
 							{
+#ifdef PROFILING
+								input_lat_event(i, &ev);
+#endif
 								int dev = i;
 								if (!JOYCON_COMBINED(i) && input[dev].bind >= 0) dev = input[dev].bind;
 
@@ -5082,7 +5831,7 @@ int input_test(int getchar)
 												else if ((input[i].misc_flags & 0x6) == 2) input[i].misc_flags = 0x5; // Y
 												else input[i].misc_flags = 0x1; // None
 
-												Info(((input[i].misc_flags & 0x6) == 2) ? "Paddle mode" :
+												input_info(((input[i].misc_flags & 0x6) == 2) ? "Paddle mode" :
 													((input[i].misc_flags & 0x6) == 4) ? "Spinner mode" :
 													"Normal mode");
 											}
@@ -5525,8 +6274,11 @@ int input_test(int getchar)
 					else
 					{
 						uint8_t data[4] = {};
-						if (read(pool[i].fd, data, sizeof(data)))
+						int len = read(pool[i].fd, data, sizeof(data));
+						if (len)
 						{
+							inputrec_mouse(i, input[i].gen, data, len);
+
 							int edev = i;
 							int dev = i;
 							if (input[i].bind >= 0) edev = input[i].bind; // mouse to event
@@ -5627,12 +6379,28 @@ int input_test(int getchar)
 					{
 						user_io_screenshot_cmd(cmd);
 					}
+					else if (!strncmp(cmd, "input ", 6))
+					{
+						if (inputrec_cmd(cmd))
+						{
+							for (int n = 0; n < NUMDEV; n++)
+							{
+								if (pool[n].fd >= 0) inputrec_device(n, input[n].gen, pool[n].fd, input[n].devname, true);
+							}
+						}
+					}
 					else if (!strncmp(cmd, "volume ", 7))
 					{
 						if (!strcmp(cmd + 7, "mute")) set_volume(0x81);
 						else if (!strcmp(cmd + 7, "unmute")) set_volume(0x80);
 						else if (cmd[7] >= '0' && cmd[7] <= '7') set_volume(0x40 - 0x30 + cmd[7]);
 					}
+#ifdef PROFILING
+					else if (!strncmp(cmd, "profiling", 9))
+					{
+						profiling_cmd(cmd);
+					}
+#endif
 				}
 			}
 
@@ -5677,13 +6445,28 @@ int input_test(int getchar)
 
 int input_poll(int getchar)
 {
+	// UI calls queued by the input thread since last round
+	if (!inputthread_self()) inputthread_ui_poll();
+
+	InputLock input_lock;
 	PROFILE_FUNCTION();
+#ifdef PROFILING
+	if (!getchar) input_lat_poll();
+#endif
 
 	static int af[NUMPLAYERS] = {};
 	static uint32_t time[NUMPLAYERS] = {};
 	static uint64_t joy_prev[NUMPLAYERS] = {};
 
 	int ret = input_test(getchar);
+#ifdef PROFILING
+	input_lat_dev = -1;
+#endif
+
+	// send analog state left from incomplete frames
+	analog_defer = false;
+	joy_analog_flush();
+
 	if (getchar) return ret;
 
 	uinp_check_key();
@@ -5783,6 +6566,7 @@ int input_poll(int getchar)
 
 int is_key_pressed(int key)
 {
+	InputLock input_lock;
 	unsigned char bits[(KEY_MAX + 7) / 8];
 	for (int i = 0; i < NUMDEV; i++)
 	{
@@ -5811,6 +6595,7 @@ int is_key_pressed(int key)
 
 void input_notify_mode()
 {
+	InputLock input_lock;
 	//reset mouse parameters on any mode switch
 	kbd_mouse_emu = 1;
 	mouse_sniper = 0;
@@ -5824,6 +6609,7 @@ void input_notify_mode()
 
 void input_switch(int grab)
 {
+	InputLock input_lock;
 	if (grab >= 0) grabbed = grab;
 	//printf("input_switch(%d), grabbed = %d\n", grab, grabbed);
 
@@ -5876,6 +6662,7 @@ char *get_buttons(int type)
 
 void set_ovr_buttons(char *s, int type)
 {
+	InputLock input_lock;
 	switch (type)
 	{
 	case 0:
@@ -5894,6 +6681,7 @@ void set_ovr_buttons(char *s, int type)
 
 void parse_buttons()
 {
+	InputLock input_lock;
 	joy_bcount = 0;
 
 	char *str = get_buttons();
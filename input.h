@@ -78,6 +78,11 @@ void sysled_enable(int en);
 
 void input_notify_mode();
 int input_poll(int getchar);
+#ifdef PROFILING
+void input_lat_sent(); // user_io has written input state to the core
+#else
+#define input_lat_sent()
+#endif
 int is_key_pressed(int key);
 
 void start_map_setting(int cnt, int set = 0);
@@ -0,0 +1,178 @@
+#include "inputrec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#define TEST_BIT(bits, n) ((bits)[(n) / 8] & (1 << ((n) % 8)))
+
+static FILE *rec_file = NULL;
+static uint64_t rec_start_us = 0;
+
+static uint64_t rec_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void rec_write(uint16_t kind, int dev, uint32_t gen, const void *data, uint32_t size, bool initial = false)
+{
+	rec_header hdr = {};
+	hdr.kind = kind;
+	hdr.dev = dev;
+	hdr.size = size;
+	hdr.gen = gen;
+
+	// time 0 is reserved for devices open at start
+	hdr.time = initial ? 0 : rec_time() - rec_start_us;
+	if (!initial && !hdr.time) hdr.time = 1;
+
+	fwrite(&hdr, sizeof(hdr), 1, rec_file);
+	if (size) fwrite(data, size, 1, rec_file);
+}
+
+// the same strings /proc/bus/input/devices shows
+static void read_attr(const char *node, const char *attr, char *buf, int size)
+{
+	char path[128];
+	snprintf(path, sizeof(path), "/sys/class/input/%s/device/%s", node, attr);
+
+	buf[0] = 0;
+	FILE *f = fopen(path, "r");
+	if (!f) return;
+	if (!fgets(buf, size, f)) buf[0] = 0;
+	fclose(f);
+
+	int len = strlen(buf);
+	while (len && buf[len - 1] == '\n') buf[--len] = 0;
+}
+
+void inputrec_device(int dev, uint32_t gen, int fd, const char *devname, bool initial)
+{
+	if (!rec_file) return;
+
+	static rec_device desc;
+	memset(&desc, 0, sizeof(desc));
+
+	const char *node = strrchr(devname, '/');
+	snprintf(desc.node, sizeof(desc.node), "%s", node ? node + 1 : devname);
+	desc.mouse = !strncmp(desc.node, "mouse", 5);
+
+	read_attr(desc.node, "name", desc.name, sizeof(desc.name));
+	read_attr(desc.node, "phys", desc.phys, sizeof(desc.phys));
+	read_attr(desc.node, "uniq", desc.uniq, sizeof(desc.uniq));
+
+	char path[128];
+	snprintf(path, sizeof(path), "/sys/class/input/%s/device", desc.node);
+	char *real = realpath(path, NULL);
+	if (real) snprintf(desc.sysfs, sizeof(desc.sysfs), "%s", strncmp(real, "/sys/", 5) ? real : real + 4);
+	free(real);
+
+	if (!desc.mouse)
+	{
+		struct input_id id = {};
+		ioctl(fd, EVIOCGID, &id);
+		desc.bustype = id.bustype;
+		desc.vendor = id.vendor;
+		desc.product = id.product;
+		desc.version = id.version;
+
+		ioctl(fd, EVIOCGNAME(sizeof(desc.name) - 1), desc.name);
+		ioctl(fd, EVIOCGBIT(0, sizeof(desc.evbits)), desc.evbits);
+		ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(desc.keybits)), desc.keybits);
+		ioctl(fd, EVIOCGBIT(EV_REL, sizeof(desc.relbits)), desc.relbits);
+		ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(desc.absbits)), desc.absbits);
+		for (int i = 0; i < REC_ABS_CNT; i++)
+		{
+			if (!TEST_BIT(desc.absbits, i)) continue;
+
+			struct input_absinfo abs = {};
+			ioctl(fd, EVIOCGABS(i), &abs);
+			desc.abs[i] = { abs.value, abs.minimum, abs.maximum, abs.fuzz, abs.flat, abs.resolution };
+		}
+	}
+
+	rec_write(REC_DEVICE, dev, gen, &desc, sizeof(desc), initial);
+	printf("inputrec: recording %s %04x:%04x %s\n", desc.node, desc.vendor, desc.product, desc.name);
+}
+
+void inputrec_remove(int dev, uint32_t gen)
+{
+	if (!rec_file) return;
+	rec_write(REC_REMOVE, dev, gen, NULL, 0);
+}
+
+void inputrec_events(int dev, uint32_t gen, const struct input_event *ev, int count)
+{
+	if (!rec_file) return;
+
+	static rec_event buf[256];
+	if (count > (int)(sizeof(buf) / sizeof(buf[0]))) count = sizeof(buf) / sizeof(buf[0]);
+
+	for (int i = 0; i < count; i++)
+	{
+		buf[i].sec = ev[i].time.tv_sec;
+		buf[i].usec = ev[i].time.tv_usec;
+		buf[i].type = ev[i].type;
+		buf[i].code = ev[i].code;
+		buf[i].value = ev[i].value;
+	}
+
+	rec_write(REC_EVENTS, dev, gen, buf, count * sizeof(rec_event));
+}
+
+void inputrec_mouse(int dev, uint32_t gen, const uint8_t *data, int len)
+{
+	if (!rec_file || len <= 0) return;
+
+	rec_write(REC_MOUSE, dev, gen, data, len);
+}
+
+static bool rec_start(const char *name)
+{
+	if (rec_file) fclose(rec_file);
+
+	rec_file = fopen(name, "wb");
+	if (!rec_file)
+	{
+		printf("inputrec: cannot create %s\n", name);
+		return false;
+	}
+
+	fwrite(REC_MAGIC, 8, 1, rec_file);
+
+	rec_start_us = rec_time();
+	printf("inputrec: recording to %s\n", name);
+	return true;
+}
+
+static void rec_stop()
+{
+	if (!rec_file) return;
+
+	fclose(rec_file);
+	rec_file = NULL;
+	printf("inputrec: recording stopped\n");
+}
+
+bool inputrec_cmd(const char *cmd)
+{
+	char name[1024] = {};
+
+	if (!strcmp(cmd, "input record stop"))
+	{
+		rec_stop();
+	}
+	else if (sscanf(cmd, "input record %1023s", name) == 1)
+	{
+		return rec_start(name);
+	}
+	else
+	{
+		printf("inputrec: unknown command: %s\n", cmd);
+	}
+
+	return false;
+}
@@ -0,0 +1,85 @@
+#ifndef INPUTREC_H
+#define INPUTREC_H
+
+#include <inttypes.h>
+#include <linux/input.h>
+
+// Recording of raw input streams (evdev events and mouse packets) as they are
+// read by input_test. Recordings are replayed on the host by tools/inputrec,
+// which runs input.cpp against the recorded devices with a virtual clock.
+// Commands (MiSTer_cmd):
+//   input record <file>      - start recording of all input devices
+//   input record stop        - stop recording
+
+// returns true if recording has been started, caller adds the open devices then
+bool inputrec_cmd(const char *cmd);
+
+// input pipeline hooks, gen is unique for every open of a device node
+// initial - device was open before recording started
+void inputrec_device(int dev, uint32_t gen, int fd, const char *devname, bool initial = false);
+void inputrec_remove(int dev, uint32_t gen);
+void inputrec_events(int dev, uint32_t gen, const struct input_event *ev, int count);
+void inputrec_mouse(int dev, uint32_t gen, const uint8_t *data, int len);
+
+// File format. Fixed size little endian fields, so ARM recordings are read on any host.
+// Magic is followed by records: rec_header and size bytes of data.
+
+#define REC_MAGIC "MiSTrec2"
+
+enum
+{
+	REC_DEVICE = 1, // rec_device, devices open at start have time 0
+	REC_REMOVE,     // no data, device node removed
+	REC_EVENTS,     // rec_event[]
+	REC_MOUSE       // mouse packet as read from mouseX node
+};
+
+#define REC_EV_BYTES  4   // (EV_MAX + 1) / 8
+#define REC_KEY_BYTES 96  // (KEY_MAX + 1) / 8
+#define REC_REL_BYTES 2   // (REL_MAX + 1) / 8
+#define REC_ABS_CNT   64  // ABS_CNT
+
+#pragma pack(push, 1)
+struct rec_header
+{
+	uint16_t kind;
+	uint16_t dev;   // slot in input.cpp
+	uint32_t size;
+	uint32_t gen;
+	uint32_t reserved;
+	uint64_t time;  // us since recording start, when the data was read
+};
+
+struct rec_event
+{
+	uint32_t sec;
+	uint32_t usec;
+	uint16_t type;
+	uint16_t code;
+	int32_t  value;
+};
+
+struct rec_absinfo
+{
+	int32_t value, minimum, maximum, fuzz, flat, resolution;
+};
+
+struct rec_device
+{
+	char     node[16];   // eventX or mouseX
+	uint8_t  mouse;
+	uint8_t  reserved[3];
+	uint16_t bustype, vendor, product, version;
+	char     name[128];
+	char     phys[64];
+	char     uniq[64];
+	char     sysfs[256];
+	uint8_t  evbits[REC_EV_BYTES];
+	uint8_t  keybits[REC_KEY_BYTES];
+	uint8_t  relbits[REC_REL_BYTES];
+	uint8_t  absbits[REC_ABS_CNT / 8];
+	rec_absinfo abs[REC_ABS_CNT];
+};
+#pragma pack(pop)
+
+#endif
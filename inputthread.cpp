@@ -0,0 +1,188 @@
+#include "inputthread.h"
+#include "input.h"
+#include "user_io.h"
+#include "video.h"
+#include "fpga_io.h"
+#include "profiling.h"
+#include "scheduler.h"
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+
+// above iothread, input must not wait for disk servicing
+static constexpr int INPUTTHREAD_PRIORITY = 60;
+
+// UI calls pending from the thread, main loop runs them every round
+#define UI_QUEUE_SIZE 64
+
+struct ui_call_t
+{
+	inputthread_ui_fn fn;
+	char str[128];
+	bool has_str;
+	int arg1;
+	int arg2;
+};
+
+static pthread_t s_thread_handle;
+static pthread_mutex_t s_input_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static pthread_mutex_t s_ui_lock = PTHREAD_MUTEX_INITIALIZER;
+static ui_call_t s_ui_queue[UI_QUEUE_SIZE];
+static uint32_t s_ui_head = 0;
+static uint32_t s_ui_tail = 0;
+static bool s_running = false;
+static int s_epoll_fd = -1;
+static __thread bool t_input_thread = false;
+
+static void *inputthread_run(void *)
+{
+	PROFILE_THREAD_NAME("input");
+	t_input_thread = true;
+
+	while (true)
+	{
+		// no timeout: timers (autofire, mouse emulation, key repeat) are run by main loop
+		struct epoll_event events[8];
+		if (epoll_wait(s_epoll_fd, events, sizeof(events) / sizeof(events[0]), -1) <= 0) continue;
+
+		// OSD and menu input stay with the main loop, it picks up what is left here
+		if (!is_fpga_ready(1) || user_io_osd_is_visible() || is_menu() || video_fb_state()) continue;
+
+		SPIKE_SCOPE("inputthread", 1000);
+		input_poll(0);
+	}
+
+	return (void *)0;
+}
+
+void inputthread_start()
+{
+	if (s_running) return;
+
+	s_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (s_epoll_fd < 0)
+	{
+		printf("inputthread: epoll_create1 failed (%d). Input is processed from main loop.\n", errno);
+		return;
+	}
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	// Main runs on core #1. Input preempts disk servicing on core #0.
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(0, &set);
+	pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+
+	struct sched_param param = {};
+	param.sched_priority = INPUTTHREAD_PRIORITY;
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+
+	int err = pthread_create(&s_thread_handle, &attr, inputthread_run, nullptr);
+	if (err)
+	{
+		printf("inputthread: cannot use SCHED_FIFO (%s), using normal priority.\n", strerror(err));
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+		err = pthread_create(&s_thread_handle, &attr, inputthread_run, nullptr);
+	}
+
+	pthread_attr_destroy(&attr);
+
+	if (err)
+	{
+		printf("inputthread: failed to start (%s). Input is processed from main loop.\n", strerror(err));
+		return;
+	}
+
+	s_running = true;
+	printf("inputthread: started.\n");
+}
+
+bool inputthread_active()
+{
+	return s_running;
+}
+
+bool inputthread_self()
+{
+	return t_input_thread;
+}
+
+void inputthread_watch_fd(int fd, uint32_t events)
+{
+	if (fd < 0 || s_epoll_fd < 0) return;
+
+	// edge triggered: events skipped while OSD is visible are left to main loop and must not wake the thread again
+	struct epoll_event ev = {};
+	ev.events = events | EPOLLET;
+	ev.data.fd = fd;
+
+	// closed descriptors are dropped from the set by the kernel, so only add/modify is needed
+	if (epoll_ctl(s_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno == EEXIST)
+	{
+		epoll_ctl(s_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+}
+
+void inputthread_lock()
+{
+	pthread_mutex_lock(&s_input_lock);
+}
+
+void inputthread_unlock()
+{
+	pthread_mutex_unlock(&s_input_lock);
+}
+
+void inputthread_ui_call(inputthread_ui_fn fn, const char *str, int arg1, int arg2)
+{
+	if (!inputthread_self())
+	{
+		fn(str, arg1, arg2);
+		return;
+	}
+
+	pthread_mutex_lock(&s_ui_lock);
+	if (s_ui_head - s_ui_tail < UI_QUEUE_SIZE)
+	{
+		ui_call_t *call = &s_ui_queue[s_ui_head % UI_QUEUE_SIZE];
+		call->fn = fn;
+		call->has_str = (str != 0);
+		if (str) snprintf(call->str, sizeof(call->str), "%s", str);
+		call->arg1 = arg1;
+		call->arg2 = arg2;
+		s_ui_head++;
+	}
+	else
+	{
+		printf("inputthread: UI queue is full, call dropped.\n");
+	}
+	pthread_mutex_unlock(&s_ui_lock);
+
+	// main loop may sleep in scheduler_wait(): evdev fds it waits on are drained by this thread
+	scheduler_wake();
+}
+
+void inputthread_ui_poll()
+{
+	if (!s_running) return;
+
+	while (true)
+	{
+		ui_call_t call;
+
+		pthread_mutex_lock(&s_ui_lock);
+		bool empty = (s_ui_head == s_ui_tail);
+		if (!empty) call = s_ui_queue[s_ui_tail++ % UI_QUEUE_SIZE];
+		pthread_mutex_unlock(&s_ui_lock);
+
+		if (empty) break;
+		call.fn(call.has_str ? call.str : 0, call.arg1, call.arg2);
+	}
+}
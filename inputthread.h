@@ -0,0 +1,48 @@
+#ifndef INPUTTHREAD_H
+#define INPUTTHREAD_H
+
+#include <inttypes.h>
+
+// High priority thread processing evdev input as soon as it arrives.
+// Enabled by input_thread=1 in MiSTer.ini, otherwise input is processed
+// by input_poll() from the main loop as before.
+//
+// The thread runs input_poll() only while a core is running with OSD hidden,
+// so joystick and mouse state goes to the core without waiting for the main
+// loop. Main loop keeps calling input_poll() for OSD/menu input, hotplug,
+// MiSTer_cmd and timers. Input state is protected by the input lock, not by
+// the main loop: input_poll() and input functions changing state take it, as
+// do menu side readers walking input[]/pool[]. Getters returning a single int
+// (mapping progress, key modifiers, led state) are read without it, a torn
+// value is not possible and a stale one is picked up next UI round.
+// Calls into UI made from the thread are queued and run by the main loop,
+// which is woken for them through scheduler_wake().
+
+void inputthread_start();
+bool inputthread_active();
+
+// true when called from the input thread
+bool inputthread_self();
+
+// add device descriptor to the set the input thread waits on
+void inputthread_watch_fd(int fd, uint32_t events);
+
+// Input state lock. Lock is recursive.
+void inputthread_lock();
+void inputthread_unlock();
+
+struct InputLock
+{
+	InputLock() { inputthread_lock(); }
+	~InputLock() { inputthread_unlock(); }
+};
+
+// Run fn(str, arg1, arg2) in the main loop. Called directly when not on the input thread.
+// str is copied, so it may point to a temporary buffer.
+typedef void (*inputthread_ui_fn)(const char *str, int arg1, int arg2);
+void inputthread_ui_call(inputthread_ui_fn fn, const char *str = 0, int arg1 = 0, int arg2 = 0);
+
+// main loop side: run UI calls queued by the input thread
+void inputthread_ui_poll();
+
+#endif
@@ -0,0 +1,109 @@
+#include "iothread.h"
+#include "user_io.h"
+#include "fpga_io.h"
+#include "scheduler.h"
+#include "profiling.h"
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+
+// poll period while a disk is active and when idle
+static constexpr long POLL_BUSY_NS = 20000;
+static constexpr long POLL_IDLE_NS = 500000;
+
+static constexpr int IOTHREAD_PRIORITY = 50;
+
+static pthread_t s_thread_handle;
+static pthread_mutex_t s_io_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static volatile bool s_quit = false;
+static bool s_running = false;
+
+static void *iothread_run(void *)
+{
+	PROFILE_THREAD_NAME("iothread");
+
+	while (!s_quit)
+	{
+		if (is_fpga_ready(1))
+		{
+			SPIKE_SCOPE("iothread", 1000);
+
+			pthread_mutex_lock(&s_io_lock);
+			user_io_poll_io();
+			pthread_mutex_unlock(&s_io_lock);
+		}
+
+		struct timespec ts = {};
+		ts.tv_nsec = scheduler_has_activity() ? POLL_BUSY_NS : POLL_IDLE_NS;
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+	}
+
+	return (void *)0;
+}
+
+void iothread_start()
+{
+	if (s_running) return;
+
+	s_quit = false;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	// Main runs on core #1. Keep disk servicing away from UI work.
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(0, &set);
+	pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+
+	struct sched_param param = {};
+	param.sched_priority = IOTHREAD_PRIORITY;
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+
+	int err = pthread_create(&s_thread_handle, &attr, iothread_run, nullptr);
+	if (err)
+	{
+		printf("iothread: cannot use SCHED_FIFO (%s), using normal priority.\n", strerror(err));
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+		err = pthread_create(&s_thread_handle, &attr, iothread_run, nullptr);
+	}
+
+	pthread_attr_destroy(&attr);
+
+	if (err)
+	{
+		printf("iothread: failed to start (%s). Devices are serviced from main loop.\n", strerror(err));
+		return;
+	}
+
+	s_running = true;
+	printf("iothread: started.\n");
+}
+
+void iothread_stop()
+{
+	if (!s_running) return;
+
+	s_quit = true;
+	pthread_join(s_thread_handle, nullptr);
+	s_running = false;
+}
+
+bool iothread_active()
+{
+	return s_running;
+}
+
+void iothread_lock()
+{
+	pthread_mutex_lock(&s_io_lock);
+}
+
+void iothread_unlock()
+{
+	pthread_mutex_unlock(&s_io_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+// Real-time thread servicing disk and CD requests of the core.
+// Enabled by io_thread=1 in MiSTer.ini, otherwise devices are serviced
+// from user_io_poll() as before.
+
+void iothread_start();
+void iothread_stop();
+bool iothread_active();
+
+// Device state (mounted images, CD drives) must only be changed while
+// holding this lock when the thread is running. Lock is recursive.
+void iothread_lock();
+void iothread_unlock();
+
+struct IoThreadLock
+{
+	IoThreadLock() { iothread_lock(); }
+	~IoThreadLock() { iothread_unlock(); }
+};
+
+#endif
@@ -33,6 +33,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "scheduler.h"
 #include "osd.h"
 #include "offload.h"
+#include "iothread.h"
+#include "inputthread.h"
+#include "cfg.h"
+#include "profiling.h"
 
 const char *version = "$VER:" VDATE;
 
@@ -45,6 +49,7 @@ int main(int argc, char *argv[])
 	CPU_ZERO(&set);
 	CPU_SET(1, &set);
 	sched_setaffinity(0, sizeof(set), &set);
+	PROFILE_THREAD_NAME("main");
 
 	offload_start();
 
@@ -71,6 +76,9 @@ int main(int argc, char *argv[])
 	FindStorage();
 	user_io_init((argc > 1) ? argv[1] : "",(argc > 2) ? argv[2] : NULL);
 
+	if (cfg.io_thread) iothread_start();
+	if (cfg.input_thread) inputthread_start();
+
 #ifdef USE_SCHEDULER
 	scheduler_init();
 	scheduler_run();
@@ -86,6 +94,7 @@ int main(int argc, char *argv[])
 		input_poll(0);
 		HandleUI();
 		OsdUpdate();
+		scheduler_wait();
 	}
 #endif
 	return 0;
@@ -1,76 +1,100 @@
 #include "offload.h"
 #include "profiling.h"
+#include "scheduler.h"
 #include <pthread.h>
 #include <inttypes.h>
 #include <string.h>
 #include <stdio.h>
 
-static constexpr uint32_t QUEUE_SIZE = 8;
+static constexpr uint32_t MAX_WORK = 32;
 
-static pthread_t s_thread_handle;
-static pthread_cond_t s_cond_work, s_cond_available;
+// Worker #0 takes only high priority work, so I/O prefetch never waits behind
+// a long background job. Worker #1 takes high priority first, then low.
+static constexpr int NUM_WORKERS = 2;
+
+static pthread_t s_thread_handle[NUM_WORKERS];
+static pthread_cond_t s_cond_work, s_cond_done;
 static pthread_mutex_t s_queue_lock;
 
 struct Work
 {
-	std::function<void()> handler;
+	uint64_t storage[OFFLOAD_WORK_SIZE / sizeof(uint64_t)];
+	void (*run)(void *storage);
+	volatile uint32_t gen;
+	bool busy;
 };
 
-static Work s_queue[QUEUE_SIZE];
-static uint32_t s_queue_head, s_queue_tail;
+static Work s_work[MAX_WORK];
+
+// per priority FIFO of work slot indices
+static uint16_t s_queue[OFFLOAD_PRIO_COUNT][MAX_WORK];
+static uint32_t s_queue_head[OFFLOAD_PRIO_COUNT], s_queue_tail[OFFLOAD_PRIO_COUNT];
+
+static uint32_t s_free_count;
 static bool s_quit;
 
-static void *worker_thread(void *)
+static int take_work(int worker)
+{
+	int max_prio = worker ? OFFLOAD_PRIO_LOW : OFFLOAD_PRIO_HIGH;
+	for (int prio = OFFLOAD_PRIO_HIGH; prio <= max_prio; prio++)
+	{
+		if (s_queue_head[prio] != s_queue_tail[prio])
+		{
+			return s_queue[prio][s_queue_tail[prio]++ % MAX_WORK];
+		}
+	}
+
+	return -1;
+}
+
+static void *worker_thread(void *arg)
 {
+	const int worker = (int)(intptr_t)arg;
+	PROFILE_THREAD_NAME(worker ? "offload low" : "offload high");
+
+	pthread_mutex_lock(&s_queue_lock);
 	while (true)
 	{
-		Work *current_work = nullptr;
-		// Wait for work
-		pthread_mutex_lock(&s_queue_lock);
-		if (s_queue_head == s_queue_tail)
+		int idx = take_work(worker);
+		if (idx < 0)
 		{
-			// queue empty and quit flag set, exit
-			if (s_quit)
-			{
-				pthread_mutex_unlock(&s_queue_lock);
-				break;
-			}
+			// nothing left for this worker and quit flag set, exit
+			if (s_quit) break;
 
 			// wait for work signal
 			pthread_cond_wait(&s_cond_work, &s_queue_lock);
-			
-			// quit flag was set and queue still empty, quit
-			if (s_quit && (s_queue_head == s_queue_tail))
-			{
-				pthread_mutex_unlock(&s_queue_lock);
-				break;
-			}
+			continue;
 		}
 
-		// get work
-		current_work = &s_queue[s_queue_tail % QUEUE_SIZE];
 		pthread_mutex_unlock(&s_queue_lock);
 
 		// execute
-		current_work->handler();
-		current_work->handler = nullptr;
+		Work *current_work = &s_work[idx];
+		current_work->run(current_work->storage);
 
-		// lock and move tail forward
+		// mark as done and release the slot
 		pthread_mutex_lock(&s_queue_lock);
-		s_queue_tail++;
-		pthread_cond_signal(&s_cond_available);
-		pthread_mutex_unlock(&s_queue_lock);
+		current_work->run = nullptr;
+		current_work->busy = false;
+		__atomic_add_fetch(&current_work->gen, 1, __ATOMIC_RELEASE);
+		s_free_count++;
+		pthread_cond_broadcast(&s_cond_done);
 	}
+	pthread_mutex_unlock(&s_queue_lock);
+
 	return (void *)0;
 }
 
 void offload_start()
 {
-	pthread_cond_init(&s_cond_available, nullptr);
+	pthread_cond_init(&s_cond_done, nullptr);
 	pthread_cond_init(&s_cond_work, nullptr);
 	pthread_mutex_init(&s_queue_lock, nullptr);
 
-	s_queue_head = s_queue_tail = 0;
+	memset(s_work, 0, sizeof(s_work));
+	memset(s_queue_head, 0, sizeof(s_queue_head));
+	memset(s_queue_tail, 0, sizeof(s_queue_tail));
+	s_free_count = MAX_WORK;
 	s_quit = false;
 
 	pthread_attr_t attr;
@@ -83,7 +107,12 @@ void offload_start()
 	CPU_SET(0, &set);
 	pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
 
-	pthread_create(&s_thread_handle, &attr, worker_thread, nullptr);
+	for (int i = 0; i < NUM_WORKERS; i++)
+	{
+		pthread_create(&s_thread_handle[i], &attr, worker_thread, (void *)(intptr_t)i);
+	}
+
+	pthread_attr_destroy(&attr);
 }
 
 void offload_stop()
@@ -91,32 +120,96 @@ void offload_stop()
 	pthread_mutex_lock(&s_queue_lock);
 
 	s_quit = true;
-	pthread_cond_signal(&s_cond_work);
+	pthread_cond_broadcast(&s_cond_work);
 
 	pthread_mutex_unlock(&s_queue_lock);
 
 	printf("Waiting for offloaded work to finish...");
-	pthread_join(s_thread_handle, nullptr);
+	for (int i = 0; i < NUM_WORKERS; i++) pthread_join(s_thread_handle[i], nullptr);
 	printf("Done\n");
 }
 
-void offload_add_work(std::function<void()> handler)
+bool offload_done(OffloadHandle handle)
+{
+	return __atomic_load_n(&s_work[handle.slot].gen, __ATOMIC_ACQUIRE) != handle.gen;
+}
+
+// Called with s_queue_lock held. Drops the lock while yielding.
+static void wait_done_locked()
+{
+	if (scheduler_active())
+	{
+		pthread_mutex_unlock(&s_queue_lock);
+		scheduler_yield();
+		pthread_mutex_lock(&s_queue_lock);
+	}
+	else
+	{
+		pthread_cond_wait(&s_cond_done, &s_queue_lock);
+	}
+}
+
+void offload_wait(OffloadHandle handle)
 {
+	if (offload_done(handle)) return;
+
 	PROFILE_FUNCTION();
 
 	pthread_mutex_lock(&s_queue_lock);
+	while (!offload_done(handle)) wait_done_locked();
+	pthread_mutex_unlock(&s_queue_lock);
+}
 
-	if ((s_queue_head - s_queue_tail) == QUEUE_SIZE)
-	{
-		pthread_cond_wait(&s_cond_available, &s_queue_lock);
-	}
+// Called with s_queue_lock held and a free slot available.
+static void *alloc_work_locked(OffloadHandle *handle)
+{
+	uint32_t idx = 0;
+	while (s_work[idx].busy) idx++;
+
+	s_work[idx].busy = true;
+	s_free_count--;
+
+	handle->slot = idx;
+	handle->gen = s_work[idx].gen;
+
+	return s_work[idx].storage;
+}
+
+void *offload_alloc_work(OffloadHandle *handle)
+{
+	PROFILE_FUNCTION();
+
+	pthread_mutex_lock(&s_queue_lock);
+
+	while (!s_free_count) wait_done_locked();
+	void *storage = alloc_work_locked(handle);
 
-	Work *work = &s_queue[s_queue_head % QUEUE_SIZE];
-	work->handler = handler;
+	pthread_mutex_unlock(&s_queue_lock);
+
+	return storage;
+}
+
+void *offload_try_alloc_work(OffloadHandle *handle)
+{
+	pthread_mutex_lock(&s_queue_lock);
+
+	void *storage = s_free_count ? alloc_work_locked(handle) : nullptr;
+
+	pthread_mutex_unlock(&s_queue_lock);
+
+	return storage;
+}
+
+void offload_submit_work(OffloadHandle handle, int priority, void (*run)(void *storage))
+{
+	if (priority < 0 || priority >= OFFLOAD_PRIO_COUNT) priority = OFFLOAD_PRIO_LOW;
+
+	pthread_mutex_lock(&s_queue_lock);
 
-	s_queue_head++;
+	s_work[handle.slot].run = run;
+	s_queue[priority][s_queue_head[priority]++ % MAX_WORK] = handle.slot;
 
-	pthread_cond_signal(&s_cond_work);
+	pthread_cond_broadcast(&s_cond_work);
 
 	pthread_mutex_unlock(&s_queue_lock);
-}
\ No newline at end of file
+}
@@ -2,11 +2,87 @@
 #define OFFLOAD_H
 
 #include <stddef.h>
-#include <functional>
+#include <inttypes.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+enum
+{
+	OFFLOAD_PRIO_HIGH = 0, // latency critical work: I/O prefetch, readahead
+	OFFLOAD_PRIO_LOW,      // background work: hashing, compression, file writes
+
+	OFFLOAD_PRIO_COUNT
+};
+
+// Maximum size of the captured state of a work item. Work is stored inline,
+// so no allocation happens when work is queued.
+#define OFFLOAD_WORK_SIZE 64
+
+struct OffloadHandle
+{
+	uint16_t slot;
+	uint32_t gen;
+};
 
 void offload_start();
 void offload_stop();
 
-void offload_add_work(std::function<void()> work);
+// Returns true when work referenced by handle has finished.
+bool offload_done(OffloadHandle handle);
+
+// Wait for completion. When called from a scheduler coroutine it yields
+// instead of blocking, so the rest of the main loop keeps running.
+void offload_wait(OffloadHandle handle);
+
+// low level interface used by offload_add_work
+void *offload_alloc_work(OffloadHandle *handle);
+void *offload_try_alloc_work(OffloadHandle *handle);
+void offload_submit_work(OffloadHandle handle, int priority, void (*run)(void *storage));
+
+template <typename F>
+OffloadHandle offload_add_work(F &&work, int priority = OFFLOAD_PRIO_LOW)
+{
+	typedef typename std::decay<F>::type Fn;
+	static_assert(sizeof(Fn) <= OFFLOAD_WORK_SIZE, "offload work captures too much state");
+	static_assert(alignof(Fn) <= alignof(uint64_t), "offload work alignment is too big");
+
+	OffloadHandle handle;
+	void *storage = offload_alloc_work(&handle);
+	new (storage) Fn(std::forward<F>(work));
+	offload_submit_work(handle, priority, [](void *p)
+	{
+		Fn *fn = (Fn*)p;
+		(*fn)();
+		fn->~Fn();
+	});
+
+	return handle;
+}
+
+// Same as offload_add_work, but returns false instead of waiting when all work
+// slots are taken. Must be used for work queued from inside offloaded work:
+// workers waiting for a free slot can block the whole pool.
+template <typename F>
+bool offload_try_add_work(F &&work, int priority = OFFLOAD_PRIO_LOW)
+{
+	typedef typename std::decay<F>::type Fn;
+	static_assert(sizeof(Fn) <= OFFLOAD_WORK_SIZE, "offload work captures too much state");
+	static_assert(alignof(Fn) <= alignof(uint64_t), "offload work alignment is too big");
+
+	OffloadHandle handle;
+	void *storage = offload_try_alloc_work(&handle);
+	if (!storage) return false;
+
+	new (storage) Fn(std::forward<F>(work));
+	offload_submit_work(handle, priority, [](void *p)
+	{
+		Fn *fn = (Fn*)p;
+		(*fn)();
+		fn->~Fn();
+	});
+
+	return true;
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -45,6 +45,7 @@ as rotated copies of the first 128 entries.  -- AMR
 #include "logo.h"
 #include "user_io.h"
 #include "hardware.h"
+#include "iothread.h"
 #include "profiling.h"
 
 #include "support.h"
@@ -671,10 +672,13 @@ void OsdUpdate()
 			spi_osd_cmd_cont(OSD_CMD_WRITE | i);
 			spi_write(osdbuf + i * 256, 256, 0);
 			DisableOsd();
-			if (is_megacd()) mcd_poll();
-			if (is_pce()) pcecd_poll();
-			if (is_saturn()) saturn_poll();
-			if (is_neogeo_cd()) neocd_poll();
+			if (!iothread_active())
+			{
+				if (is_megacd()) mcd_poll();
+				if (is_pce()) pcecd_poll();
+				if (is_saturn()) saturn_poll();
+				if (is_neogeo_cd()) neocd_poll();
+			}
 		}
 	}
 
@@ -5,8 +5,12 @@
 #include "str_util.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
 
 struct Event
 {
@@ -15,34 +19,117 @@ struct Event
 	struct timespec ts;
 };
 
+// Events are kept per thread, so begin/end pairs of different threads never interleave
 static constexpr int MAX_EVENTS = 512; // must be pow2
-static Event s_events[MAX_EVENTS]; // circular buffer
-static uint32_t s_event_tail = 0;
+static thread_local Event s_events[MAX_EVENTS]; // circular buffer
+static thread_local uint32_t s_event_tail = 0;
 
-static constexpr Event *get_event(uint32_t idx)
+static inline Event *get_event(uint32_t idx)
 {
 	return &s_events[idx % MAX_EVENTS];
 }
 
-uint32_t profiling_event_begin(const char *name)
+static void trace_add(const char *name, char phase, uint64_t ts_ns);
+
+static uint64_t ts_to_ns(const struct timespec *ts)
+{
+	return (ts->tv_sec * 1000000000ULL) + ts->tv_nsec;
+}
+
+// Log-bucketed histogram: 4 buckets per power of 2, so bucket width is
+// within 25% of its value. Covers up to ~18 minutes.
+static constexpr int HIST_BUCKETS = 160;
+static constexpr int MAX_HISTOGRAMS = 256; // must be pow2
+
+struct Histogram
+{
+	const char *name;
+	uint32_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint32_t buckets[HIST_BUCKETS];
+};
+
+static Histogram s_histograms[MAX_HISTOGRAMS];
+
+static int hist_bucket(uint64_t ns)
+{
+	if (ns < 4) return (int)ns;
+
+	int msb = 63 - __builtin_clzll(ns);
+	int idx = ((msb - 1) * 4) + (int)((ns >> (msb - 2)) & 3);
+	return (idx < HIST_BUCKETS) ? idx : (HIST_BUCKETS - 1);
+}
+
+static uint64_t hist_bucket_max(int idx)
+{
+	idx++;
+	if (idx < 4) return idx;
+
+	int msb = (idx / 4) + 1;
+	return (uint64_t)(4 + (idx % 4)) << (msb - 2);
+}
+
+// Scope names are string literals, so the pointer is used as the key.
+static Histogram *hist_get(const char *name)
+{
+	uint32_t pos = (uint32_t)(((uintptr_t)name >> 2) * 2654435761U);
+	for (int i = 0; i < MAX_HISTOGRAMS; i++)
+	{
+		Histogram *hist = &s_histograms[(pos + i) % MAX_HISTOGRAMS];
+		const char *cur = __atomic_load_n(&hist->name, __ATOMIC_ACQUIRE);
+		if (cur == name) return hist;
+		if (!cur)
+		{
+			const char *expected = nullptr;
+			if (__atomic_compare_exchange_n(&hist->name, &expected, name, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || expected == name)
+			{
+				return hist;
+			}
+		}
+	}
+
+	return nullptr; // table is full
+}
+
+static void hist_add(const char *name, uint64_t ns)
+{
+	Histogram *hist = hist_get(name);
+	if (!hist) return;
+
+	__atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->total_ns, ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->buckets[hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+
+	uint64_t max = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+	while (ns > max && !__atomic_compare_exchange_n(&hist->max_ns, &max, ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+uint32_t profiling_event_begin(const char *name, uint64_t *begin_ns)
 {
 	Event *newEvent = get_event(s_event_tail);
 	newEvent->begin_idx = s_event_tail;
 	newEvent->name = name;
 	clock_gettime(CLOCK_MONOTONIC, &newEvent->ts);
+	*begin_ns = ts_to_ns(&newEvent->ts);
+	trace_add(name, 'B', *begin_ns);
 
 	uint32_t r = s_event_tail;
 	s_event_tail++;
 	return r;
 }
 
-void profiling_event_end(uint32_t begin_idx, const char *name)
+void profiling_event_end(uint32_t begin_idx, const char *name, uint64_t begin_ns)
 {
 	Event *newEvent = get_event(s_event_tail);
 	newEvent->begin_idx = begin_idx;
 	newEvent->name = name;
 	clock_gettime(CLOCK_MONOTONIC, &newEvent->ts);
 	s_event_tail++;
+
+	const uint64_t end_ns = ts_to_ns(&newEvent->ts);
+	trace_add(name, 'E', end_ns);
+	hist_add(name, end_ns - begin_ns);
 }
 
 // result_ns = a - b
@@ -65,9 +152,9 @@ static uint64_t delta_ns(const struct timespec *a, const struct timespec *b)
 
 
 // Bookkeeping data for spike report
-static uint64_t inclusive_times[MAX_EVENTS];
-static uint64_t other_times[MAX_EVENTS];
-static uint32_t pair_stack[MAX_EVENTS / 2];
+static thread_local uint64_t inclusive_times[MAX_EVENTS];
+static thread_local uint64_t other_times[MAX_EVENTS];
+static thread_local uint32_t pair_stack[MAX_EVENTS / 2];
 
 void profiling_spike_report(uint32_t begin_idx, uint32_t spike_us)
 {
@@ -127,4 +214,337 @@ void profiling_spike_report(uint32_t begin_idx, uint32_t spike_us)
 	fflush(stdout);
 }
 
+static uint64_t hist_percentile(const Histogram *hist, uint32_t count, uint32_t pct)
+{
+	uint64_t target = ((uint64_t)count * pct + 99) / 100;
+	uint64_t seen = 0;
+	for (int i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += hist->buckets[i];
+		if (seen >= target) return (hist_bucket_max(i) < hist->max_ns) ? hist_bucket_max(i) : hist->max_ns;
+	}
+
+	return hist->max_ns;
+}
+
+void profiling_histogram_dump(const char *filename)
+{
+	FILE *fp = stdout;
+	if (filename && *filename)
+	{
+		fp = fopen(filename, "wt");
+		if (!fp)
+		{
+			printf("profiling: cannot create %s\n", filename);
+			return;
+		}
+	}
+
+	fprintf(fp, "\n+----- Name -----------------------------------------+---------+----------+----------+----------+----------+----------+\n");
+	fprintf(fp, "|                                                    |   Count |  Avg(us) |  p50(us) |  p90(us) |  p99(us) |  Max(us) |\n");
+	fprintf(fp, "+----------------------------------------------------+---------+----------+----------+----------+----------+----------+\n");
+	for (int i = 0; i < MAX_HISTOGRAMS; i++)
+	{
+		const Histogram *hist = &s_histograms[i];
+		uint32_t count = hist->count;
+		if (!hist->name || !count) continue;
+
+		fprintf(fp, "| %-50s | %7u | %8.1f | %8.1f | %8.1f | %8.1f | %8.1f |\n", hist->name, count,
+			hist->total_ns / (count * 1000.0),
+			hist_percentile(hist, count, 50) / 1000.0,
+			hist_percentile(hist, count, 90) / 1000.0,
+			hist_percentile(hist, count, 99) / 1000.0,
+			hist->max_ns / 1000.0);
+	}
+	fprintf(fp, "+----------------------------------------------------+---------+----------+----------+----------+----------+----------+\n\n");
+
+	if (fp != stdout)
+	{
+		fclose(fp);
+		printf("profiling: histograms saved to %s\n", filename);
+	}
+	else
+	{
+		fflush(stdout);
+	}
+}
+
+void profiling_histogram_add(const char *name, uint64_t ns)
+{
+	hist_add(name, ns);
+}
+
+void profiling_histogram_reset()
+{
+	// keep the names, so slots stay assigned to the same scopes
+	for (int i = 0; i < MAX_HISTOGRAMS; i++)
+	{
+		Histogram *hist = &s_histograms[i];
+		hist->count = 0;
+		hist->total_ns = 0;
+		hist->max_ns = 0;
+		memset(hist->buckets, 0, sizeof(hist->buckets));
+	}
+
+	printf("profiling: histograms reset\n");
+}
+
+/*
+ * Trace capture in Chrome trace-event JSON format (also loads in Perfetto UI).
+ * Events are appended lock free into a ring of chunks, complete chunks are
+ * written to the file by a separate thread, so capture runs continuously.
+ */
+
+struct TraceEvent
+{
+	const char *name;
+	uint64_t ts_ns;
+	uint32_t tid;
+	char phase;
+};
+
+static constexpr uint32_t TRACE_CHUNK_EVENTS = 8192;
+static constexpr uint32_t TRACE_CHUNKS = 8;
+
+struct TraceChunk
+{
+	TraceEvent events[TRACE_CHUNK_EVENTS];
+	uint32_t committed;
+};
+
+struct TraceThread
+{
+	uint32_t tid;
+	const char *name;
+};
+
+static constexpr int MAX_TRACE_THREADS = 16;
+static TraceThread s_trace_threads[MAX_TRACE_THREADS];
+static uint32_t s_trace_thread_count = 0;
+
+static TraceChunk *s_trace_chunks = nullptr;
+static bool s_tracing = false;
+static volatile bool s_trace_stop = false;
+static uint32_t s_trace_pos = 0;
+static uint32_t s_trace_flushed = 0;
+static uint32_t s_trace_overflow = 0;
+static uint32_t s_trace_written = 0;
+static FILE *s_trace_file = nullptr;
+static bool s_trace_first = true;
+static pthread_t s_trace_thread;
+static char s_trace_filename[256];
+
+static uint32_t trace_tid()
+{
+	static thread_local uint32_t tid = 0;
+	if (!tid) tid = (uint32_t)syscall(SYS_gettid);
+	return tid;
+}
+
+void profiling_thread_name(const char *name)
+{
+	uint32_t tid = trace_tid();
+	for (uint32_t i = 0; i < s_trace_thread_count; i++)
+	{
+		if (s_trace_threads[i].tid == tid)
+		{
+			s_trace_threads[i].name = name;
+			return;
+		}
+	}
+
+	uint32_t idx = __atomic_fetch_add(&s_trace_thread_count, 1, __ATOMIC_ACQ_REL);
+	if (idx < MAX_TRACE_THREADS)
+	{
+		s_trace_threads[idx].tid = tid;
+		s_trace_threads[idx].name = name;
+	}
+	else
+	{
+		s_trace_thread_count = MAX_TRACE_THREADS;
+	}
+}
+
+static void trace_add(const char *name, char phase, uint64_t ts_ns)
+{
+	if (!__atomic_load_n(&s_tracing, __ATOMIC_ACQUIRE)) return;
+
+	uint32_t pos = __atomic_fetch_add(&s_trace_pos, 1, __ATOMIC_ACQ_REL);
+	uint32_t seq = pos / TRACE_CHUNK_EVENTS;
+	if (seq >= __atomic_load_n(&s_trace_flushed, __ATOMIC_ACQUIRE) + TRACE_CHUNKS)
+	{
+		// writer can't keep up, stop the capture instead of losing events in the middle
+		__atomic_store_n(&s_tracing, false, __ATOMIC_RELEASE);
+		__atomic_store_n(&s_trace_overflow, 1, __ATOMIC_RELEASE);
+		return;
+	}
+
+	TraceChunk *chunk = &s_trace_chunks[seq % TRACE_CHUNKS];
+	TraceEvent *event = &chunk->events[pos % TRACE_CHUNK_EVENTS];
+	event->name = name;
+	event->ts_ns = ts_ns;
+	event->tid = trace_tid();
+	event->phase = phase;
+	__atomic_add_fetch(&chunk->committed, 1, __ATOMIC_RELEASE);
+}
+
+static void trace_write_events(const TraceEvent *events, uint32_t count)
+{
+	const int pid = getpid();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const TraceEvent *event = &events[i];
+		fprintf(s_trace_file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%u}",
+			s_trace_first ? "" : ",", event->name, event->phase,
+			(unsigned long long)(event->ts_ns / 1000), (uint32_t)(event->ts_ns % 1000), pid, event->tid);
+		s_trace_first = false;
+	}
+	s_trace_written += count;
+}
+
+static void *trace_writer_thread(void *)
+{
+	while (true)
+	{
+		const bool stop = s_trace_stop;
+
+		// write all complete chunks
+		while (true)
+		{
+			TraceChunk *chunk = &s_trace_chunks[s_trace_flushed % TRACE_CHUNKS];
+			if (__atomic_load_n(&chunk->committed, __ATOMIC_ACQUIRE) < TRACE_CHUNK_EVENTS) break;
+
+			trace_write_events(chunk->events, TRACE_CHUNK_EVENTS);
+			chunk->committed = 0;
+			__atomic_add_fetch(&s_trace_flushed, 1, __ATOMIC_RELEASE);
+		}
+
+		if (stop)
+		{
+			// capture is disabled already, give in-flight events time to land
+			usleep(10000);
+
+			uint32_t end = __atomic_load_n(&s_trace_pos, __ATOMIC_ACQUIRE);
+			uint32_t limit = (s_trace_flushed + TRACE_CHUNKS) * TRACE_CHUNK_EVENTS;
+			if (end > limit) end = limit;
+
+			for (uint32_t pos = s_trace_flushed * TRACE_CHUNK_EVENTS; pos < end; pos += TRACE_CHUNK_EVENTS)
+			{
+				TraceChunk *chunk = &s_trace_chunks[(pos / TRACE_CHUNK_EVENTS) % TRACE_CHUNKS];
+				uint32_t count = end - pos;
+				if (count > TRACE_CHUNK_EVENTS) count = TRACE_CHUNK_EVENTS;
+				if (count > chunk->committed) count = chunk->committed;
+				trace_write_events(chunk->events, count);
+			}
+			break;
+		}
+
+		usleep(10000);
+	}
+
+	const int pid = getpid();
+	for (uint32_t i = 0; i < s_trace_thread_count && i < MAX_TRACE_THREADS; i++)
+	{
+		fprintf(s_trace_file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			s_trace_first ? "" : ",", pid, s_trace_threads[i].tid, s_trace_threads[i].name);
+		s_trace_first = false;
+	}
+
+	fprintf(s_trace_file, "\n]}\n");
+	fclose(s_trace_file);
+	s_trace_file = nullptr;
+
+	return (void *)0;
+}
+
+void profiling_trace_start(const char *filename)
+{
+	if (s_trace_file)
+	{
+		printf("profiling: trace capture is already running\n");
+		return;
+	}
+
+	strcpyz(s_trace_filename, (filename && *filename) ? filename : "/tmp/MiSTer_trace.json");
+
+	if (!s_trace_chunks) s_trace_chunks = (TraceChunk *)malloc(sizeof(TraceChunk) * TRACE_CHUNKS);
+	if (!s_trace_chunks)
+	{
+		printf("profiling: cannot allocate trace buffer\n");
+		return;
+	}
+
+	s_trace_file = fopen(s_trace_filename, "wt");
+	if (!s_trace_file)
+	{
+		printf("profiling: cannot create %s\n", s_trace_filename);
+		return;
+	}
+
+	fprintf(s_trace_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	s_trace_first = true;
+
+	for (uint32_t i = 0; i < TRACE_CHUNKS; i++) s_trace_chunks[i].committed = 0;
+	s_trace_pos = 0;
+	s_trace_flushed = 0;
+	s_trace_overflow = 0;
+	s_trace_written = 0;
+	s_trace_stop = false;
+
+	if (pthread_create(&s_trace_thread, nullptr, trace_writer_thread, nullptr))
+	{
+		printf("profiling: cannot start trace writer\n");
+		fclose(s_trace_file);
+		s_trace_file = nullptr;
+		return;
+	}
+
+	__atomic_store_n(&s_tracing, true, __ATOMIC_RELEASE);
+	printf("profiling: trace capture started to %s\n", s_trace_filename);
+}
+
+void profiling_trace_stop()
+{
+	if (!s_trace_file)
+	{
+		printf("profiling: trace capture is not running\n");
+		return;
+	}
+
+	__atomic_store_n(&s_tracing, false, __ATOMIC_RELEASE);
+	s_trace_stop = true;
+	pthread_join(s_trace_thread, nullptr);
+
+	printf("profiling: trace capture stopped, %u events saved to %s%s\n", s_trace_written, s_trace_filename,
+		s_trace_overflow ? " (capture stopped early: buffer overflow)" : "");
+}
+
+void profiling_cmd(const char *cmd)
+{
+	if (!strncmp(cmd, "profiling trace start", 21))
+	{
+		const char *arg = cmd + 21;
+		while (*arg == ' ') arg++;
+		profiling_trace_start(arg);
+	}
+	else if (!strcmp(cmd, "profiling trace stop"))
+	{
+		profiling_trace_stop();
+	}
+	else if (!strncmp(cmd, "profiling dump", 14))
+	{
+		const char *arg = cmd + 14;
+		while (*arg == ' ') arg++;
+		profiling_histogram_dump(arg);
+	}
+	else if (!strcmp(cmd, "profiling reset"))
+	{
+		profiling_histogram_reset();
+	}
+	else
+	{
+		printf("profiling: unknown command: %s\n", cmd);
+	}
+}
+
 #endif // PROFILING
\ No newline at end of file
@@ -5,33 +5,51 @@
 
 #ifdef PROFILING
 
-uint32_t profiling_event_begin(const char *name);
-void profiling_event_end(uint32_t begin_idx, const char *name);
+uint32_t profiling_event_begin(const char *name, uint64_t *begin_ns);
+void profiling_event_end(uint32_t begin_idx, const char *name, uint64_t begin_ns);
 void profiling_spike_report(uint32_t begin_idx, uint32_t spike_us);
 
+// Per scope latency histograms.
+// Commands: "profiling dump [file]", "profiling reset"
+void profiling_histogram_dump(const char *filename);
+void profiling_histogram_reset();
+
+// Adds a sample to a histogram outside of a scope.
+// Histograms are keyed by name pointer, so name must stay valid and unique.
+void profiling_histogram_add(const char *name, uint64_t ns);
+
+// Chrome trace-event capture.
+// Commands: "profiling trace start [file]", "profiling trace stop"
+void profiling_trace_start(const char *filename);
+void profiling_trace_stop();
+void profiling_thread_name(const char *name);
+
+void profiling_cmd(const char *cmd);
+
 struct ProfilingScopedEvent
 {
 	const char *name;
 	uint32_t spike_us;
 	uint32_t begin_idx;
+	uint64_t begin_ns;
 
 	ProfilingScopedEvent(const char *name)
 		: name(name)
 		, spike_us(0)
 	{
-		begin_idx = profiling_event_begin(name);
+		begin_idx = profiling_event_begin(name, &begin_ns);
 	}
 
 	ProfilingScopedEvent(const char *name, uint32_t spike_us)
 		: name(name)
 		, spike_us(spike_us)
 	{
-		begin_idx = profiling_event_begin(name);
+		begin_idx = profiling_event_begin(name, &begin_ns);
 	}
 
 	~ProfilingScopedEvent()
 	{
-		profiling_event_end(begin_idx, name);
+		profiling_event_end(begin_idx, name, begin_ns);
 		if (spike_us > 0) profiling_spike_report(begin_idx, spike_us);
 	}
 };
@@ -40,6 +58,7 @@ struct ProfilingScopedEvent
 #define PROFILE_FUNCTION() ProfilingScopedEvent __scope_timer(__FUNCTION__)
 #define SPIKE_SCOPE(name, us) ProfilingScopedEvent __scope_timer(name, us)
 #define SPIKE_FUNCTION(us) ProfilingScopedEvent __scope_timer(__FUNCTION__, us)
+#define PROFILE_THREAD_NAME(name) profiling_thread_name(name)
 
 #else // PROFILING
 
@@ -47,6 +66,7 @@ struct ProfilingScopedEvent
 #define PROFILE_FUNCTION()
 #define SPIKE_SCOPE(name, us)
 #define SPIKE_FUNCTION(us)
+#define PROFILE_THREAD_NAME(name)
 
 #endif // PROFILING
 
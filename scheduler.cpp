@@ -1,17 +1,36 @@
 #include "scheduler.h"
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
 #include "libco.h"
 #include "menu.h"
 #include "user_io.h"
 #include "input.h"
 #include "fpga_io.h"
 #include "osd.h"
+#include "hardware.h"
+#include "cfg.h"
 #include "profiling.h"
 
+// keep polling without sleep for this long (ms) after the last disk request
+static constexpr unsigned long ACTIVITY_HOLDOFF = 200;
+
 static cothread_t co_scheduler = nullptr;
 static cothread_t co_poll = nullptr;
 static cothread_t co_ui = nullptr;
 static cothread_t co_last = nullptr;
+static pthread_t main_thread;
+
+static bool ui_round_done = false;
+
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int wake_fd = -1;
+static unsigned long activity_timer = 0;
 
 static void scheduler_wait_fpga_ready(void)
 {
@@ -47,6 +66,7 @@ static void scheduler_co_ui(void)
 			OsdUpdate();
 		}
 
+		ui_round_done = true;
 		scheduler_yield();
 	}
 }
@@ -60,21 +80,72 @@ static void scheduler_schedule(void)
 	}
 	else
 	{
+		// sleep only between complete rounds, not while UI is in the middle of a long operation
+		if (ui_round_done)
+		{
+			ui_round_done = false;
+			scheduler_wait();
+		}
+
 		co_last = co_poll;
 		co_switch(co_poll);
 	}
 }
 
+static int scheduler_epoll_init(void)
+{
+	if (epoll_fd < 0)
+	{
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0)
+		{
+			printf("scheduler: epoll_create1 failed (%d)\n", errno);
+			return -1;
+		}
+
+		timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (timer_fd < 0)
+		{
+			printf("scheduler: timerfd_create failed (%d)\n", errno);
+		}
+		else
+		{
+			struct epoll_event ev = {};
+			ev.events = EPOLLIN;
+			ev.data.fd = timer_fd;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+		}
+
+		wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (wake_fd < 0)
+		{
+			printf("scheduler: eventfd failed (%d)\n", errno);
+		}
+		else
+		{
+			struct epoll_event ev = {};
+			ev.events = EPOLLIN;
+			ev.data.fd = wake_fd;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+		}
+	}
+
+	return epoll_fd;
+}
+
 void scheduler_init(void)
 {
 	const unsigned int co_stack_size = 262144 * sizeof(void*);
 
+	scheduler_epoll_init();
+
 	co_poll = co_create(co_stack_size, scheduler_co_poll);
 	co_ui = co_create(co_stack_size, scheduler_co_ui);
 }
 
 void scheduler_run(void)
 {
+	main_thread = pthread_self();
 	co_scheduler = co_active();
 
 	for (;;)
@@ -89,5 +160,81 @@ void scheduler_run(void)
 
 void scheduler_yield(void)
 {
-	co_switch(co_scheduler);
+	// no-op outside of scheduled coroutines (e.g. from worker threads)
+	if (scheduler_active()) co_switch(co_scheduler);
+}
+
+bool scheduler_active(void)
+{
+	return co_scheduler && pthread_equal(main_thread, pthread_self()) && co_active() != co_scheduler;
+}
+
+void scheduler_watch_fd(int fd, uint32_t events)
+{
+	if (fd < 0 || scheduler_epoll_init() < 0) return;
+
+	struct epoll_event ev = {};
+	ev.events = events;
+	ev.data.fd = fd;
+
+	// closed descriptors are dropped from the set by the kernel, so only add/modify is needed
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno == EEXIST)
+	{
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+}
+
+void scheduler_wake(void)
+{
+	if (wake_fd < 0) return;
+
+	uint64_t val = 1;
+	write(wake_fd, &val, sizeof(val));
+}
+
+void scheduler_activity(void)
+{
+	activity_timer = GetTimer(ACTIVITY_HOLDOFF);
+}
+
+bool scheduler_has_activity(void)
+{
+	return activity_timer && GetTimer(0) < activity_timer;
+}
+
+void scheduler_wait(void)
+{
+	// always consume, so deadlines from previous rounds don't accumulate
+	unsigned long next_timer = FetchNextTimer();
+
+	if (!cfg.fpga_poll_latency || timer_fd < 0) return;
+
+	if (scheduler_has_activity()) return;
+
+	unsigned long now = GetTimer(0);
+
+	uint32_t timeout_us = cfg.fpga_poll_latency;
+	if (next_timer)
+	{
+		if (next_timer <= now) return;
+		if ((next_timer - now) < (timeout_us / 1000)) timeout_us = (next_timer - now) * 1000;
+	}
+
+	PROFILE_FUNCTION();
+
+	struct itimerspec its = {};
+	its.it_value.tv_sec = timeout_us / 1000000;
+	its.it_value.tv_nsec = (timeout_us % 1000000) * 1000;
+	timerfd_settime(timer_fd, 0, &its, NULL);
+
+	struct epoll_event events[8];
+	epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), -1);
+
+	// disarming also clears the expiration count
+	its = {};
+	timerfd_settime(timer_fd, 0, &its, NULL);
+
+	// the round following this wait handles whatever woke it
+	uint64_t val;
+	if (wake_fd >= 0) read(wake_fd, &val, sizeof(val));
 }
@@ -1,10 +1,27 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
+#include <inttypes.h>
+
 #define USE_SCHEDULER
 
 void scheduler_init(void);
 void scheduler_run(void);
 void scheduler_yield(void);
 
+// true when called from one of the scheduled coroutines, so scheduler_yield() is allowed
+bool scheduler_active(void);
+
+// Event driven idle: sleep until one of the watched fds becomes ready,
+// the nearest CheckTimer deadline passes or fpga_poll_latency expires.
+void scheduler_wait(void);
+void scheduler_watch_fd(int fd, uint32_t events);
+
+// wake scheduler_wait() from another thread, main loop runs a round right away
+void scheduler_wake(void);
+
+// report disk/CD activity, so polling stays continuous while core is busy
+void scheduler_activity(void);
+bool scheduler_has_activity(void);
+
 #endif
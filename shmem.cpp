@@ -10,6 +10,7 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "shmem.h"
 
@@ -71,3 +72,111 @@ int shmem_get(uint32_t address, uint32_t size, void *buf)
 
 	return shmem != 0;
 }
+
+#define SHMEM_REG_MAX 32
+
+typedef struct
+{
+	uint32_t address;
+	uint32_t size;
+	uint8_t *map;
+	int      refs;
+	uint32_t used;
+	uint32_t hits;
+} shmem_reg_t;
+
+static shmem_reg_t shmem_reg[SHMEM_REG_MAX] = {};
+static uint32_t shmem_reg_stamp = 0;
+static pthread_mutex_t shmem_reg_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *shmem_acquire(uint32_t address, uint32_t size)
+{
+	uint64_t end = (uint64_t)address + size;
+	void *res = 0;
+
+	pthread_mutex_lock(&shmem_reg_lock);
+
+	shmem_reg_t *reg = 0;
+	for (int i = 0; i < SHMEM_REG_MAX; i++)
+	{
+		shmem_reg_t *r = &shmem_reg[i];
+		if (r->map && r->address <= address && end <= (uint64_t)r->address + r->size)
+		{
+			reg = r;
+			r->hits++;
+			break;
+		}
+	}
+
+	if (!reg)
+	{
+		// empty slot or least recently used one nobody holds
+		for (int i = 0; i < SHMEM_REG_MAX; i++)
+		{
+			shmem_reg_t *r = &shmem_reg[i];
+			if (!r->map)
+			{
+				reg = r;
+				break;
+			}
+
+			if (!r->refs && (!reg || r->used < reg->used)) reg = r;
+		}
+
+		if (!reg)
+		{
+			printf("shmem: no free mapping slot for 0x%X!\n", address);
+		}
+		else
+		{
+			if (reg->map)
+			{
+				printf("shmem: unmap 0x%X (%u hits)\n", reg->address, reg->hits);
+				shmem_unmap(reg->map, reg->size);
+			}
+
+			memset(reg, 0, sizeof(shmem_reg_t));
+
+			uint32_t start = address & ~(SHMEM_WINDOW - 1);
+			uint64_t map_end = (end + SHMEM_WINDOW - 1) & ~(uint64_t)(SHMEM_WINDOW - 1);
+			reg->map = (uint8_t*)shmem_map(start, (uint32_t)(map_end - start));
+			if (reg->map)
+			{
+				reg->address = start;
+				reg->size = (uint32_t)(map_end - start);
+				printf("shmem: map 0x%X, %uMB\n", reg->address, reg->size >> 20);
+			}
+			else
+			{
+				reg = 0;
+			}
+		}
+	}
+
+	if (reg)
+	{
+		reg->refs++;
+		reg->used = ++shmem_reg_stamp;
+		res = reg->map + (address - reg->address);
+	}
+
+	pthread_mutex_unlock(&shmem_reg_lock);
+	return res;
+}
+
+void shmem_release(void *ptr)
+{
+	if (!ptr) return;
+
+	pthread_mutex_lock(&shmem_reg_lock);
+	for (int i = 0; i < SHMEM_REG_MAX; i++)
+	{
+		shmem_reg_t *r = &shmem_reg[i];
+		if (r->map && (uint8_t*)ptr >= r->map && (uint8_t*)ptr < r->map + r->size && r->refs)
+		{
+			r->refs--;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&shmem_reg_lock);
+}
@@ -9,5 +9,14 @@ int shmem_unmap(void* map, uint32_t size);
 int shmem_put(uint32_t address, uint32_t size, void *buf);
 int shmem_get(uint32_t address, uint32_t size, void *buf);
 
+// Long-lived mappings of FPGA DDR windows for paths accessing the same area repeatedly.
+// Memory is mapped in SHMEM_WINDOW aligned windows on first use and kept mapped,
+// acquire/release only count the users. Unused windows are unmapped when the
+// registry is full.
+#define SHMEM_WINDOW (16 * 1024 * 1024)
+
+void *shmem_acquire(uint32_t address, uint32_t size);
+void shmem_release(void *ptr);
+
 #define fpga_mem(x) (0x20000000 | ((x) & 0x1FFFFFFF))
 #endif
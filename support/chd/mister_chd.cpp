@@ -9,15 +9,6 @@
 #include "../../cd.h"
 #include "mister_chd.h"
 
-void lba_to_hunkinfo(chd_file *chd_f, int lba, int *hunknumber, int *hunkoffset)
-{
-	const chd_header *chd_header = chd_get_header(chd_f);
-	int sectors_per_hunk = chd_header->hunkbytes / chd_header->unitbytes;
-	*hunknumber = lba / sectors_per_hunk;
-	*hunkoffset = lba % sectors_per_hunk;
-	return;
-}
-
 int mister_chd_log(const char *format, ...)
 {
 	char logline[1024];
@@ -28,10 +19,8 @@ int mister_chd_log(const char *format, ...)
 	return printf("\x1b[32m%s\x1b[0m", logline);
 }
 
-chd_error mister_load_chd(const char *filename, toc_t *cd_toc)
+chd_error mister_open_chd(const char *filename, toc_t *cd_toc)
 {
-	cd_toc->last = -1;
-	
 	chd_error err = chd_open(getFullPath(filename), CHD_OPEN_READ, NULL, &cd_toc->chd_f);
 	if (err != CHDERR_NONE)
 	{
@@ -54,6 +43,16 @@ chd_error mister_load_chd(const char *filename, toc_t *cd_toc)
 	int chd_fd = fileno((FILE *)chd_core_file(cd_toc->chd_f)->argp);
 	if (chd_fd) fcntl(chd_fd, F_SETFD, FD_CLOEXEC);
 
+	return CHDERR_NONE;
+}
+
+chd_error mister_load_chd(const char *filename, toc_t *cd_toc)
+{
+	cd_toc->last = -1;
+
+	chd_error err = mister_open_chd(filename, cd_toc);
+	if (err != CHDERR_NONE) return err;
+
 	//Load track info
 	int sector_cnt = 0;
 	for (cd_toc->last = 0; cd_toc->last < 99; cd_toc->last++)
@@ -159,28 +158,3 @@ chd_error mister_load_chd(const char *filename, toc_t *cd_toc)
 	}
 	return CHDERR_NONE;
 }
-
-chd_error mister_chd_read_sector(chd_file *chd_f, int lba, uint32_t d_offset, uint32_t s_offset, int length, uint8_t *destbuf, uint8_t *hunkbuf, int *hunknum)
-{
-
-	int tmphnum = 0;
-	int hunkofs = 0;
-
-	lba_to_hunkinfo(chd_f, lba, &tmphnum, &hunkofs);
-
-
-	//mister_chd_log("READ LBA: %d, dest_offset: %d sector offset: %d length %d chd_f %p\n", lba, d_offset, s_offset, length, chd_f);
-	if (tmphnum != *hunknum)
-	{
-		chd_error err = chd_read(chd_f, tmphnum, hunkbuf);
-		if (err != CHDERR_NONE)
-		{
-			mister_chd_log("ERROR %s\n", chd_error_string(err));
-			return err;
-		}
-		*hunknum = tmphnum;
-	}
-	int sector_offset = hunkofs * CD_FRAME_SIZE;
-	memcpy(destbuf + d_offset, hunkbuf + sector_offset + s_offset, length);
-	return CHDERR_NONE;
-}
@@ -10,6 +10,7 @@
 #include "../../hardware.h"
 #include "../../menu.h"
 #include "../../cheats.h"
+#include "../../iothread.h"
 #include "megacd.h"
 
 #define SAVE_IO_INDEX 5 // fake download to trigger save loading
@@ -118,6 +119,8 @@ static int mcd_load_rom(const char *basename, const char *name, int sub_index)
 
 void mcd_set_image(int num, const char *filename)
 {
+	IoThreadLock io_lock;
+
 	static char last_dir[1024] = {};
 
 	(void)num;
@@ -182,6 +185,7 @@ void mcd_set_image(int num, const char *filename)
 }
 
 void mcd_reset() {
+	IoThreadLock io_lock;
 	need_reset = 1;
 }
 
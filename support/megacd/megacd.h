@@ -69,9 +69,8 @@ private:
 	int scanOffset;
 	int audioLength;
 	int audioOffset;
-	int chd_hunknum;
-	uint8_t *chd_hunkbuf;
-	int chd_audio_read_lba;
+	int audio_read_lba;
+	cd_cdda_stream_t cdda;
 	uint8_t stat[10];
 	uint8_t comm[10];
 
@@ -6,7 +6,6 @@
 #include <time.h>
 
 #include "megacd.h"
-#include "../chd/mister_chd.h"
 
 cdd_t cdd;
 
@@ -20,8 +19,6 @@ cdd_t::cdd_t() {
 	status = CD_STAT_NO_DISC;
 	audioLength = 0;
 	audioOffset = 0;
-	chd_hunkbuf = NULL;
-	chd_hunknum = -1;
 	SendData = NULL;
 	CanSendData = NULL;
 
@@ -37,44 +34,11 @@ cdd_t::cdd_t() {
 	stat[9] = 0x4;
 }
 
-static int sgets(char *out, int sz, char **in)
-{
-	*out = 0;
-	do
-	{
-		char *instr = *in;
-		int cnt = 0;
-
-		while (*instr && *instr != 10)
-		{
-			if (*instr == 13)
-			{
-				instr++;
-				continue;
-			}
-
-			if (cnt < sz - 1)
-			{
-				out[cnt++] = *instr;
-				out[cnt] = 0;
-			}
-
-			instr++;
-		}
-
-		if(*instr == 10) instr++;
-		*in = instr;
-	}
-	while (!*out && **in);
-
-	return *out;
-}
-
 
 int cdd_t::LoadCUE(const char* filename) {
 	static char fname[1024 + 10];
 	static char line[128];
-	char *ptr, *lptr;
+	char *lptr;
 	static char header[1024];
 	static char toc[100 * 1024];
 
@@ -88,7 +52,7 @@ int cdd_t::LoadCUE(const char* filename) {
 	int mm, ss, bb, pregap = 0;
 
 	char *buf = toc;
-	while (sgets(line, sizeof(line), &buf))
+	while (cd_sgets(line, sizeof(line), &buf))
 	{
 		lptr = line;
 		while (*lptr == 0x20) lptr++;
@@ -96,27 +60,9 @@ int cdd_t::LoadCUE(const char* filename) {
 		/* decode FILE commands */
 		if (!(memcmp(lptr, "FILE", 4)))
 		{
-			ptr = fname + strlen(fname) - 1;
-			while ((ptr - fname) && (*ptr != '/') && (*ptr != '\\')) ptr--;
-			if (ptr - fname) ptr++;
+			const char *ftype = cd_cue_file(fname, 1024, lptr + 4);
 
-			lptr += 4;
-			while (*lptr == 0x20) lptr++;
-
-			if (*lptr == '\"')
-			{
-				lptr++;
-				while ((*lptr != '\"') && (lptr <= (line + 128)) && (ptr < (fname + 1023)))
-					*ptr++ = *lptr++;
-			}
-			else
-			{
-				while ((*lptr != 0x20) && (lptr <= (line + 128)) && (ptr < (fname + 1023)))
-					*ptr++ = *lptr++;
-			}
-			*ptr = 0;
-
-			if(!FileOpen(&this->toc.tracks[this->toc.last].f, fname)) return -1;
+			if(!cd_track_open(&this->toc.tracks[this->toc.last], fname)) return -1;
 
 			printf("\x1b[32mMCD: Open track file: %s\n\x1b[0m", fname);
 
@@ -124,7 +70,7 @@ int cdd_t::LoadCUE(const char* filename) {
 
 			this->toc.tracks[this->toc.last].offset = 0;
 
-			if (!strstr(lptr, "BINARY") && !strstr(lptr, "MOTOROLA") && !strstr(lptr, "WAVE"))
+			if (!strstr(ftype, "BINARY") && !strstr(ftype, "MOTOROLA") && !strstr(ftype, "WAVE"))
 			{
 				FileClose(&this->toc.tracks[this->toc.last].f);
 				printf("\x1b[32mMCD: unsupported file: %s\n\x1b[0m", fname);
@@ -195,7 +141,7 @@ int cdd_t::LoadCUE(const char* filename) {
 
 			if (!this->toc.tracks[this->toc.last].f.opened())
 			{
-				FileOpen(&this->toc.tracks[this->toc.last].f, fname);
+				cd_track_open(&this->toc.tracks[this->toc.last], fname);
 				this->toc.tracks[this->toc.last].start = bb + ss * 75 + mm * 60 * 75 + pregap;
 				if (this->toc.last && !this->toc.tracks[this->toc.last - 1].end)
 				{
@@ -248,24 +194,20 @@ int cdd_t::Load(const char *filename)
 	const char *ext = filename+strlen(filename)-4;
 	if (!strncasecmp(".cue", ext, 4))
 	{
-		if (LoadCUE(filename)) {
-			return (-1);
+		if (!cd_toc_load(filename, "MCD", &this->toc))
+		{
+			if (LoadCUE(filename)) {
+				return (-1);
+			}
+			cd_toc_save(filename, "MCD", &this->toc);
 		}
 	} else if (!strncasecmp(".chd", ext, 4))  {
-		chd_error err = mister_load_chd(filename, &this->toc);
+		chd_error err = cd_chd_open(filename, &this->toc);
 		if (err != CHDERR_NONE)
 		{
 			printf("ERROR %s\n", chd_error_string(err));
 			return -1;
 		}
-
-		if (this->chd_hunkbuf)
-		{
-			free(this->chd_hunkbuf);
-		}
-
-		this->chd_hunkbuf = (uint8_t *)malloc(this->toc.chd_hunksize);
-		this->chd_hunknum = -1;
  	} else {
 		return (-1);
 
@@ -273,7 +215,7 @@ int cdd_t::Load(const char *filename)
 
 	if (this->toc.chd_f)
 	{
-		mister_chd_read_sector(this->toc.chd_f, 0, 0, 0, 0x10, (uint8_t *)header, this->chd_hunkbuf, &this->chd_hunknum);
+		cd_chd_read(this->toc.chd_f, 0, 0, 0x10, (uint8_t *)header);
 	} else {
 		fd_img = &this->toc.tracks[0].f;
 
@@ -293,6 +235,7 @@ int cdd_t::Load(const char *filename)
 	{
 		this->sectorSize = 2352;
 	}
+	this->toc.tracks[0].sector_size = this->sectorSize;
 
 	printf("\x1b[32mMCD: Sector size = %u, Track 0 end = %u\n\x1b[0m", this->sectorSize, this->toc.tracks[0].end);
 
@@ -311,33 +254,9 @@ int cdd_t::Load(const char *filename)
 
 void cdd_t::Unload()
 {
-	if (this->loaded)
-	{
-		if (this->toc.chd_f)
-		{
-			chd_close(this->toc.chd_f);
-		}
-
-		if (this->chd_hunkbuf)
-		{
-			free(this->chd_hunkbuf);
-			this->chd_hunkbuf = NULL;
-		}
-
-		for (int i = 0; i < this->toc.last; i++)
-		{
-			if (this->toc.tracks[i].f.opened())
-			{
-				FileClose(&this->toc.tracks[i].f);
-			}
-		}
-
-		if (this->toc.sub.opened()) FileClose(&this->toc.sub);
-
-		this->loaded = 0;
-	}
-
-	memset(&this->toc, 0x00, sizeof(this->toc));
+	cd_cdda_stop(&this->cdda);
+	cd_unload(&this->toc);
+	this->loaded = 0;
 	this->sectorSize = 0;
 }
 
@@ -350,7 +269,7 @@ void cdd_t::Reset() {
 	status = CD_STAT_STOP;
 	audioLength = 0;
 	audioOffset = 0;
-	chd_audio_read_lba = 0;
+	audio_read_lba = 0;
 
 	stat[0] = 0x0;
 	stat[1] = 0x0;
@@ -431,7 +350,7 @@ void cdd_t::Update() {
 		}
 
 		this->lba++;
-		this->chd_audio_read_lba++;
+		this->audio_read_lba++;
 
 		if (this->lba >= this->toc.tracks[this->index].end)
 		{
@@ -459,7 +378,7 @@ void cdd_t::Update() {
 			else
 			{
 				this->lba = this->toc.end;
-				this->chd_audio_read_lba = this->lba;
+				this->audio_read_lba = this->lba;
 				this->status = CD_STAT_END;
 				this->isData = 0x01;
 				return;
@@ -478,7 +397,7 @@ void cdd_t::Update() {
 			}
 		}
 
-		this->chd_audio_read_lba = this->lba;
+		this->audio_read_lba = this->lba;
 
 		this->isData = this->toc.tracks[this->index].type;
 
@@ -907,7 +826,7 @@ void cdd_t::SeekToLBA(int lba, int play) {
 
 	if (play)
 	{
-		this->chd_audio_read_lba = this->lba;
+		this->audio_read_lba = this->lba;
 		this->audioOffset = 0;
 	}
 
@@ -919,25 +838,7 @@ void cdd_t::ReadData(uint8_t *buf)
 {
 	if (this->toc.tracks[this->index].type && (this->lba >= 0))
 	{
-
-		if (this->toc.chd_f)
-		{
-			int read_offset = 0;
-			if (this->sectorSize != 2048)
-			{
-				read_offset += 16;
-			}
-
-			mister_chd_read_sector(this->toc.chd_f, this->lba + this->toc.tracks[0].offset, 0, read_offset, 2048, buf, this->chd_hunkbuf, &this->chd_hunknum);
-		} else {
-			if (this->sectorSize == 2048)
-			{
-				FileSeek(&this->toc.tracks[0].f, this->lba * 2048, SEEK_SET);
-			} else {
-			FileSeek(&this->toc.tracks[0].f, this->lba * 2352 + 16, SEEK_SET);
-			}
-			FileReadAdv(&this->toc.tracks[0].f, buf, 2048);
-		}
+		cd_read_sector(&this->toc, 0, this->lba, CD_READ_COOKED, buf);
 	}
 }
 
@@ -954,29 +855,14 @@ int cdd_t::ReadCDDA(uint8_t *buf)
 		return this->audioLength;
 	}
 
-	if (this->toc.chd_f)
+	for (int i = 0; i < this->audioLength / 2352; i++)
 	{
-		for(int i = 0; i < this->audioLength / 2352; i++)
-		{
-			mister_chd_read_sector(this->toc.chd_f, this->chd_audio_read_lba + this->toc.tracks[this->index].offset, 2352*i, 0, 2352, buf, this->chd_hunkbuf, &this->chd_hunknum);
-		}
-
-		//CHD audio requires byteswap. There's probably a better way to do this...
-
-		for (int swapidx = 0; swapidx < this->audioLength; swapidx += 2)
-		{
-			uint8_t temp = buf[swapidx];
-			buf[swapidx] = buf[swapidx+1];
-			buf[swapidx+1] = temp;
-		}
-
-		if ((this->audioLength / 2352) > 1)
-		{
-			this->chd_audio_read_lba++;
-		}
+		cd_cdda_read(&this->cdda, &this->toc, this->index, this->audio_read_lba + i, buf + 2352 * i);
+	}
 
-	} else if (this->toc.tracks[this->index].f.opened()) {
-		FileReadAdv(&this->toc.tracks[this->index].f, buf, this->audioLength);
+	if ((this->audioLength / 2352) > 1)
+	{
+		this->audio_read_lba++;
 	}
 
 	return this->audioLength;
@@ -1005,9 +891,9 @@ int cdd_t::ReadSubcode(uint16_t* buf)
 	{
 		//Just use the read sector call with an offset, since we previously read that sector, it is already in the hunk cache
 		if (this->toc.tracks[this->index].sbc_type == SUBCODE_RW_RAW) {
-			mister_chd_read_sector(this->toc.chd_f, this->chd_audio_read_lba + this->toc.tracks[this->index].offset, 0, CD_MAX_SECTOR_DATA, 96, (uint8_t *)buf, this->chd_hunkbuf, &this->chd_hunknum);
+			cd_chd_read_sector(this->toc.chd_f, this->audio_read_lba + this->toc.tracks[this->index].offset, CD_READ_SUBCODE, 0, (uint8_t *)buf);
 		} else if (this->toc.tracks[this->index].sbc_type == SUBCODE_RW) {
-			mister_chd_read_sector(this->toc.chd_f, this->chd_audio_read_lba + this->toc.tracks[this->index].offset, 0, CD_MAX_SECTOR_DATA, 96, subc, this->chd_hunkbuf, &this->chd_hunknum);
+			cd_chd_read_sector(this->toc.chd_f, this->audio_read_lba + this->toc.tracks[this->index].offset, CD_READ_SUBCODE, 0, subc);
 			InterleaveSubcode(subc, buf);
 		} else {
 			err = -1;
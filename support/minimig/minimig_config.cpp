@@ -13,6 +13,7 @@
 #include "../../input.h"
 #include "../../cfg.h"
 #include "../../ide.h"
+#include "../../iothread.h"
 #include "minimig_boot.h"
 #include "minimig_fdd.h"
 #include "minimig_config.h"
@@ -521,6 +522,7 @@ int minimig_cfg_load(int num)
 
 void minimig_reset()
 {
+	IoThreadLock io_lock;
 	ApplyConfiguration(0);
 	user_io_rtc_reset();
 	minimig_share_reset();
@@ -31,6 +31,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "minimig_config.h"
 #include "../../debug.h"
 #include "../../user_io.h"
+#include "../../iothread.h"
 #include "../../menu.h"
 
 unsigned char drives = 0; // number of active drives reported by FPGA (may change only during reset)
@@ -629,6 +630,8 @@ void HandleFDD(unsigned char c1, unsigned char c2)
 // insert floppy image pointed to to by global <file> into <drive>
 void InsertFloppy(adfTYPE *drive, char* path)
 {
+	IoThreadLock io_lock;
+
 	int writable = FileCanWrite(path);
 
 	if (!FileOpenEx(&drive->file, path, writable ? O_RDWR | O_SYNC : O_RDONLY))
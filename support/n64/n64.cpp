@@ -1218,7 +1218,7 @@ void n64_load_savedata(uint64_t lba, int ack, uint64_t& buffer_lba, uint8_t* buf
 }
 
 void n64_save_savedata(uint64_t lba, int ack, uint64_t& buffer_lba, uint8_t* buffer, uint32_t blksz, uint32_t sz) {
-	menu_process_save();
+	user_io_save_written();
 
 	buffer_lba = -1;
 	int invalid = 0;
@@ -246,7 +246,7 @@ static uint32_t load_crom_to_mem(const char* path, const char* name, uint8_t ind
 		if (partsz > LOADBUF_SZ) partsz = LOADBUF_SZ;
 
 		//printf("partsz=%d, map_addr=0x%X\n", partsz, map_addr);
-		void *base = shmem_map(map_addr, partsz);
+		void *base = shmem_acquire(map_addr, partsz);
 		if (!base)
 		{
 			FileClose(&f);
@@ -258,7 +258,7 @@ static uint32_t load_crom_to_mem(const char* path, const char* name, uint8_t ind
 
 		ProgressMessage("Loading", dispname, size - (remain - partsz), size);
 
-		shmem_unmap(base, partsz);
+		shmem_release(base);
 		remain -= partsz;
 		map_addr += partsz;
 	}
@@ -309,7 +309,7 @@ static uint32_t load_rom_to_mem(const char* path, const char* name, uint8_t neo_
 		if (partszf > LOADBUF_SZ) partszf = LOADBUF_SZ;
 
 		//printf("partsz=%d, map_addr=0x%X\n", partsz, map_addr);
-		void *base = shmem_map(map_addr, partsz);
+		void *base = shmem_acquire(map_addr, partsz);
 		if (!base)
 		{
 			FileClose(&f);
@@ -337,7 +337,7 @@ static uint32_t load_rom_to_mem(const char* path, const char* name, uint8_t neo_
 
 		ProgressMessage("Loading", dispname, size - (remain - partsz), size);
 
-		shmem_unmap(base, partsz);
+		shmem_release(base);
 		remain -= partsz;
 		map_addr += partsz;
 	}
@@ -380,10 +380,10 @@ static void notify_core(uint8_t index, uint32_t size, uint32_t memcp_force = 0)
 
 static uint32_t fill_ram(uint32_t size, uint8_t pattern)
 {
-	void *base = shmem_map(0x38000000, size);
+	void *base = shmem_acquire(0x38000000, size);
 	if (!base) return 0;
 	memset(base, pattern, size);
-	shmem_unmap(base, size);
+	shmem_release(base);
 
 	notify_core(18, size, 1);
 	return 1;
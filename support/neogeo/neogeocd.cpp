@@ -10,6 +10,7 @@
 #include "../../hardware.h"
 #include "../../menu.h"
 #include "../../cheats.h"
+#include "../../iothread.h"
 #include "../megacd/megacd.h"
 #include "neogeocd.h"
 #include "neogeo_loader.h"
@@ -112,6 +113,8 @@ void set_poll_timer()
 
 void neocd_set_image(char *filename)
 {
+	IoThreadLock io_lock;
+
 	cdd.Unload();
 	cdd.status = CD_STAT_OPEN;
 
@@ -136,6 +139,7 @@ void neocd_set_image(char *filename)
 }
 
 void neocd_reset() {
+	IoThreadLock io_lock;
 	need_reset = 1;
 }
 
@@ -9,6 +9,7 @@
 #include "../../spi.h"
 #include "../../hardware.h"
 #include "../../menu.h"
+#include "../../iothread.h"
 #include "pcecd.h"
 
 
@@ -103,6 +104,7 @@ void pcecd_poll()
 }
 
 void pcecd_reset() {
+	IoThreadLock io_lock;
 	need_reset = 1;
 }
 
@@ -191,6 +193,8 @@ static int load_bios(char *biosname, const char *cuename, int sgx)
 
 void pcecd_set_image(int num, const char *filename)
 {
+	IoThreadLock io_lock;
+
 	(void)num;
 
 	pcecdd.Unload();
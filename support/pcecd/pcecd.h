@@ -101,13 +101,12 @@ private:
 	uint8_t CDDAMode;
 	sense_t sense;
 	uint8_t region;
-	uint8_t *chd_hunkbuf;
-	int chd_hunknum;
 
 	uint16_t stat;
 	uint8_t comm[14];
 
 	uint8_t sec_buf[2352 + 2];
+	cd_cdda_stream_t cdda;
 
 	int LoadCUE(const char* filename);
 	int SectorSend(uint8_t* header);
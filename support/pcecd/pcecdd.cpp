@@ -6,8 +6,6 @@
 
 #include "../../file_io.h"
 #include "../../user_io.h"
-
-#include "../chd/mister_chd.h"
 #include "pcecd.h"
 
 #define PCECD_DATA_IO_INDEX 2
@@ -40,43 +38,10 @@ pcecdd_t::pcecdd_t() {
 
 }
 
-static int sgets(char *out, int sz, char **in)
-{
-	*out = 0;
-	do
-	{
-		char *instr = *in;
-		int cnt = 0;
-
-		while (*instr && *instr != 10)
-		{
-			if (*instr == 13)
-			{
-				instr++;
-				continue;
-			}
-
-			if (cnt < sz - 1)
-			{
-				out[cnt++] = *instr;
-				out[cnt] = 0;
-			}
-
-			instr++;
-		}
-
-		if(*instr == 10) instr++;
-		*in = instr;
-	}
-	while (!*out && **in);
-
-	return *out;
-}
-
 int pcecdd_t::LoadCUE(const char* filename) {
 	static char fname[1024 + 10];
 	static char line[128];
-	char *ptr, *lptr;
+	char *lptr;
 	static char toc[100 * 1024];
 	int hdr = 0;
 
@@ -90,7 +55,7 @@ int pcecdd_t::LoadCUE(const char* filename) {
 	int mm, ss, bb, pregap = 0;
 
 	char *buf = toc;
-	while (sgets(line, sizeof(line), &buf))
+	while (cd_sgets(line, sizeof(line), &buf))
 	{
 		lptr = line;
 		while (*lptr == 0x20) lptr++;
@@ -98,27 +63,9 @@ int pcecdd_t::LoadCUE(const char* filename) {
 		/* decode FILE commands */
 		if (!(memcmp(lptr, "FILE", 4)))
 		{
-			ptr = fname + strlen(fname) - 1;
-			while ((ptr - fname) && (*ptr != '/') && (*ptr != '\\')) ptr--;
-			if (ptr - fname) ptr++;
+			const char *ftype = cd_cue_file(fname, 1024, lptr + 4);
 
-			lptr += 4;
-			while (*lptr == 0x20) lptr++;
-
-			if (*lptr == '\"')
-			{
-				lptr++;
-				while ((*lptr != '\"') && (lptr <= (line + 128)) && (ptr < (fname + 1023)))
-					*ptr++ = *lptr++;
-			}
-			else
-			{
-				while ((*lptr != 0x20) && (lptr <= (line + 128)) && (ptr < (fname + 1023)))
-					*ptr++ = *lptr++;
-			}
-			*ptr = 0;
-
-			if(!FileOpen(&this->toc.tracks[this->toc.last].f, fname)) return -1;
+			if(!cd_track_open(&this->toc.tracks[this->toc.last], fname)) return -1;
 
 			printf("\x1b[32mPCECD: Open track file: %s\n\x1b[0m", fname);
 
@@ -129,7 +76,7 @@ int pcecdd_t::LoadCUE(const char* filename) {
 
 			this->toc.tracks[this->toc.last].offset = 0;
 
-			if (!strstr(lptr, "BINARY") && !strstr(lptr, "MOTOROLA") && !strstr(lptr, "WAVE"))
+			if (!strstr(ftype, "BINARY") && !strstr(ftype, "MOTOROLA") && !strstr(ftype, "WAVE"))
 			{
 				FileClose(&this->toc.tracks[this->toc.last].f);
 				printf("\x1b[32mPCECD: unsupported file: %s\n\x1b[0m", fname);
@@ -208,7 +155,7 @@ int pcecdd_t::LoadCUE(const char* filename) {
 		{
 			if (!this->toc.tracks[this->toc.last].f.opened())
 			{
-				FileOpen(&this->toc.tracks[this->toc.last].f, fname);
+				cd_track_open(&this->toc.tracks[this->toc.last], fname);
 				this->toc.tracks[this->toc.last].start = bb + ss * 75 + mm * 60 * 75 + pregap;
 				this->toc.tracks[this->toc.last].offset = (pregap * this->toc.tracks[this->toc.last].sector_size) - hdr;
 				if (this->toc.last && !this->toc.tracks[this->toc.last - 1].end)
@@ -255,17 +202,18 @@ int pcecdd_t::Load(const char *filename)
 	const char *ext = filename+strlen(filename)-4;
 	if (!strncasecmp(".cue", ext, 4))
 	{
-		if (LoadCUE(filename)) return -1;
+		if (!cd_toc_load(filename, "PCECD", &this->toc))
+		{
+			if (LoadCUE(filename)) return -1;
+			cd_toc_save(filename, "PCECD", &this->toc);
+		}
 	} else if (!strncasecmp(".chd", ext, 4)) {
-		mister_load_chd(filename, &this->toc);
-		if (this->chd_hunkbuf)
+		chd_error err = cd_chd_open(filename, &this->toc);
+		if (err != CHDERR_NONE)
 		{
-			free(this->chd_hunkbuf);
-			this->chd_hunkbuf = NULL;
+			printf("\x1b[32mPCECD: CHD error %s\n\x1b[0m", chd_error_string(err));
+			return -1;
 		}
-
-		this->chd_hunkbuf = (uint8_t *)malloc(this->toc.chd_hunksize);
-		this->chd_hunknum = -1;
 	} else {
 		return -1;
 	}
@@ -287,31 +235,9 @@ int pcecdd_t::Load(const char *filename)
 
 void pcecdd_t::Unload()
 {
-	if (this->loaded)
-	{
-		if (this->toc.chd_f)
-		{
-			chd_close(this->toc.chd_f);
-			this->toc.chd_f = NULL;
-			if (this->chd_hunkbuf)
-			{
-				free(this->chd_hunkbuf);
-				this->chd_hunkbuf = NULL;
-				this->chd_hunknum = -1;
-			}
-		} else {
-			for (int i = 0; i < this->toc.last; i++)
-			{
-				FileClose(&this->toc.tracks[i].f);
-			}
-		}
-
-		//if (this->toc.sub) fclose(this->toc.sub);
-
-		this->loaded = 0;
-	}
-
-	memset(&this->toc, 0x00, sizeof(this->toc));
+	cd_cdda_stop(&this->cdda);
+	cd_unload(&this->toc);
+	this->loaded = 0;
 }
 
 void pcecdd_t::Reset() {
@@ -424,10 +350,6 @@ void pcecdd_t::Update() {
 		{
 			if (!this->toc.tracks[this->index].type)
 			{
-				if (this->toc.tracks[this->index].f.opened()) 
-				{
-					FileSeek(&this->toc.tracks[index].f, (this->lba * 2352) - this->toc.tracks[index].offset, SEEK_SET);
-				}
 				sec_buf[0] = 0x30;
 				sec_buf[1] = 0x09;
 				ReadCDDA(sec_buf + 2);
@@ -846,24 +768,7 @@ void pcecdd_t::ReadData(uint8_t *buf)
 {
 	if (this->toc.tracks[this->index].type && (this->lba >= 0))
 	{
-		if (this->toc.chd_f)
-		{
-			int s_offset = 0;
-			if (this->toc.tracks[this->index].sector_size != 2048)
-			{
-				s_offset += 16;
-			}
-
-			mister_chd_read_sector(this->toc.chd_f, this->lba + this->toc.tracks[this->index].offset, 0, s_offset, 2048, buf, this->chd_hunkbuf, &this->chd_hunknum);
-		} else {
-			if (this->toc.tracks[this->index].sector_size == 2048)
-			{
-				FileSeek(&this->toc.tracks[this->index].f, this->lba * 2048 - this->toc.tracks[this->index].offset, SEEK_SET);
-			} else {
-				FileSeek(&this->toc.tracks[this->index].f, this->lba * 2352 + 16 - this->toc.tracks[this->index].offset, SEEK_SET);
-			}
-			FileReadAdv(&this->toc.tracks[this->index].f, buf, 2048);
-		}
+		cd_read_sector(&this->toc, this->index, this->lba, CD_READ_COOKED, buf);
 	}
 }
 
@@ -872,19 +777,7 @@ int pcecdd_t::ReadCDDA(uint8_t *buf)
 	this->audioLength = 2352;// 2352 + 2352 - this->audioOffset;
 	this->audioOffset = 0;// 2352;
 
-
-	if (this->toc.chd_f)
-	{
-		mister_chd_read_sector(this->toc.chd_f, this->lba + this->toc.tracks[this->index].offset, 0, 0, this->audioLength, buf, this->chd_hunkbuf, &this->chd_hunknum);
-		for (int swapidx = 0; swapidx < this->audioLength; swapidx += 2)
-		{
-			uint8_t temp = buf[swapidx];
-			buf[swapidx] = buf[swapidx+1];
-			buf[swapidx+1] = temp;
-		}
-	} else if (this->toc.tracks[this->index].f.opened()) {
-		FileReadAdv(&this->toc.tracks[this->index].f, buf, this->audioLength);
-	}
+	cd_cdda_read(&this->cdda, &this->toc, this->index, this->lba, buf);
 
 	return this->audioLength;
 }
@@ -12,44 +12,10 @@
 #include "psx.h"
 #include "mcdheader.h"
 #include "../../cd.h"
-#include "../chd/mister_chd.h"
+#include "../../iothread.h"
 #include <libchdr/chd.h>
 
 static char buf[1024];
-static uint8_t *chd_hunkbuf = NULL;
-static int chd_hunknum;
-
-static int sgets(char *out, int sz, char **in)
-{
-	*out = 0;
-	do
-	{
-		char *instr = *in;
-		int cnt = 0;
-
-		while (*instr && *instr != 10)
-		{
-			if (*instr == 13)
-			{
-				instr++;
-				continue;
-			}
-
-			if (cnt < sz - 1)
-			{
-				out[cnt++] = *instr;
-				out[cnt] = 0;
-			}
-
-			instr++;
-		}
-
-		if (*instr == 10) instr++;
-		*in = instr;
-	} while (!*out && **in);
-
-	return *out;
-}
 
 static uint32_t libCryptSectors[16] =
 {
@@ -102,32 +68,16 @@ static uint16_t libCryptMask(fileTYPE* sbi_file)
 	return mask;
 }
 
-static void unload_chd(toc_t *table)
+static void unload_cd_image(toc_t *table)
 {
-	if (table->chd_f)
-	{
-		chd_close(table->chd_f);
-	}
-	if (chd_hunkbuf) free(chd_hunkbuf);
-	memset(table, 0, sizeof(toc_t));
-	chd_hunknum = -1;
-
-}
-
-static void unload_cue(toc_t *table)
-{
-	for (int i = 0; i < table->last; i++)
-	{
-		FileClose(&table->tracks[i].f);
-	}
-	memset(table, 0, sizeof(toc_t));
+	cd_unload(table);
 }
 
 static int load_chd(const char *filename, toc_t *table)
 {
 
-	unload_chd(table);
-	chd_error err = mister_load_chd(filename, table);
+	unload_cd_image(table);
+	chd_error err = cd_chd_open(filename, table);
 	if (err != CHDERR_NONE)
 	{
 		return 0;
@@ -154,9 +104,6 @@ static int load_chd(const char *filename, toc_t *table)
 
 	table->end = table->tracks[table->last - 1].end + 1;
 
-	chd_hunkbuf = (uint8_t *)malloc(table->chd_hunksize);
-	chd_hunknum = -1;
-
 	return 1;
 }
 
@@ -164,10 +111,10 @@ static int load_cue(const char* filename, toc_t *table)
 {
 	static char fname[1024 + 10];
 	static char line[128];
-	char *ptr, *lptr;
+	char *lptr;
 	static char toc[100 * 1024];
 
-	unload_cue(table);
+	unload_cd_image(table);
 	printf("\x1b[32mPSX: Open CUE: %s\n\x1b[0m", fname);
 
 	strcpy(fname, filename);
@@ -183,7 +130,7 @@ static int load_cue(const char* filename, toc_t *table)
 	int pregap = 0;
 
 	char *buf = toc;
-	while (sgets(line, sizeof(line), &buf))
+	while (cd_sgets(line, sizeof(line), &buf))
 	{
 		lptr = line;
 		while (*lptr == 0x20) lptr++;
@@ -191,25 +138,7 @@ static int load_cue(const char* filename, toc_t *table)
 		/* decode FILE commands */
 		if (!(memcmp(lptr, "FILE", 4)))
 		{
-			ptr = fname + strlen(fname) - 1;
-			while ((ptr - fname) && (*ptr != '/') && (*ptr != '\\')) ptr--;
-			if (ptr - fname) ptr++;
-
-			lptr += 4;
-			while (*lptr == 0x20) lptr++;
-
-			if (*lptr == '\"')
-			{
-				lptr++;
-				while ((*lptr != '\"') && (lptr <= (line + 128)) && (ptr < (fname + 1023)))
-					*ptr++ = *lptr++;
-			}
-			else
-			{
-				while ((*lptr != 0x20) && (lptr <= (line + 128)) && (ptr < (fname + 1023)))
-					*ptr++ = *lptr++;
-			}
-			*ptr = 0;
+			const char *ftype = cd_cue_file(fname, 1024, lptr + 4);
 
 			if (!FileOpen(&table->tracks[table->last].f, fname)) return 0;
 
@@ -217,7 +146,7 @@ static int load_cue(const char* filename, toc_t *table)
 
 			table->tracks[table->last].offset = 0;
 
-			if (!strstr(lptr, "BINARY"))
+			if (!strstr(ftype, "BINARY"))
 			{
 				FileClose(&table->tracks[table->last].f);
 				printf("\x1b[32mPSX: unsupported file: %s\n\x1b[0m", fname);
@@ -341,7 +270,12 @@ static int load_cd_image(const char *filename, toc_t *table)
 	}
 	else if (!strncasecmp(".cue", ext, 4))
 	{
-		return load_cue(filename, table);
+		unload_cd_image(table);
+		if (cd_toc_load(filename, "PSX", table)) return 1;
+
+		if (!load_cue(filename, table)) return 0;
+		cd_toc_save(filename, "PSX", table);
+		return 1;
 	}
 
 	return 0;
@@ -476,80 +410,65 @@ void psx_read_cd(uint8_t *buffer, int lba, int cnt)
 
 	while (cnt > 0)
 	{
-		if (lba < toc.tracks[0].start || !toc.last)
+		int i = 0;
+		if (lba >= toc.tracks[0].start && toc.last)
 		{
-			memset(buffer, 0, CD_SECTOR_LEN);
+			while (i < toc.last && (lba < toc.tracks[i].start || lba > toc.tracks[i].end)) i++;
 		}
-		else
+
+		if (lba < toc.tracks[0].start || !toc.last || i == toc.last)
+		{
+			memset(buffer, (lba < toc.tracks[0].start || !toc.last) ? 0 : 0xAA, CD_SECTOR_LEN);
+			buffer += CD_SECTOR_LEN;
+			cnt--;
+			lba++;
+			continue;
+		}
+
+		// sectors of the request within this track, read at once
+		int n = toc.tracks[i].end - lba + 1;
+		if (n > cnt) n = cnt;
+
+		if (toc.tracks[i + 1].pregap)
 		{
-			memset(buffer, 0xAA, CD_SECTOR_LEN);
-			for (int i = 0; i < toc.last; i++)
+			//The TOC is setup so that pregap sectors are actually part of the
+			//PREVIOUS track. If the pregap field is set the file doesn't contain
+			//this data, so we have to fake it.
+			//Check the next track's pregap and indexes[1] values to determine
+			//if we're reading pregap sectors
+			int pregap_lba = toc.tracks[i + 1].start - toc.tracks[i + 1].indexes[1];
+			if (lba > pregap_lba)
 			{
-				if (lba >= toc.tracks[i].start && lba <= toc.tracks[i].end)
-				{
-					if (!toc.chd_f)
-					{
-						if (toc.tracks[i].offset)
-            {
-							FileSeek(&toc.tracks[0].f, toc.tracks[i].offset+((lba-toc.tracks[i].start)*CD_SECTOR_LEN), SEEK_SET);
+				memset(buffer, 0, n * CD_SECTOR_LEN);
+				buffer += n * CD_SECTOR_LEN;
+				cnt -= n;
+				lba += n;
+				continue;
+			}
 
-            }else {
-							FileSeek(&toc.tracks[i].f, (lba - toc.tracks[i].start) * CD_SECTOR_LEN, SEEK_SET);
-            }
-					}
-					while (cnt)
-					{
-            if (toc.tracks[i+1].pregap && lba > (toc.tracks[i+1].start-toc.tracks[i+1].indexes[1]))
-            {
-              //The TOC is setup so that pregap sectors are actually part of the
-              //PREVIOUS track. If the pregap field is set the file doesn't contain
-              //this data, so we have to fake it. 
-              //Check the next track's pregap and indexes[1] values to determine
-              //if we're reading pregap sectors
-              
-
-              memset(buffer, 0x0, CD_SECTOR_LEN);
-            }
-            else if (toc.chd_f)
-						{
+			if (lba + n - 1 > pregap_lba) n = pregap_lba - lba + 1;
+		}
 
-							// The "fake" 150 sector pregap moves all the LBAs up by 150, so adjust here to read where the core actually wants data from
-							int read_lba = lba - toc.tracks[0].indexes[1];
-							if (mister_chd_read_sector(toc.chd_f, (read_lba + toc.tracks[i].offset), 0, 0, CD_SECTOR_LEN, buffer, chd_hunkbuf, &chd_hunknum) == CHDERR_NONE)
-							{
-								if (!toc.tracks[i].type) //CHD requires byteswap of audio data
-								{
-									for (int swapidx = 0; swapidx < CD_SECTOR_LEN; swapidx += 2)
-									{
-										uint8_t temp = buffer[swapidx];
-										buffer[swapidx] = buffer[swapidx + 1];
-										buffer[swapidx + 1] = temp;
-									}
-								}
-							}
-							else {
-								printf("\x1b[32mPSX: CHD read error: %d\n\x1b[0m", lba);
-							}
-						}
-						else {
-							if (toc.tracks[i].offset)
-								FileReadAdv(&toc.tracks[0].f, buffer, CD_SECTOR_LEN);
-							else
-								FileReadAdv(&toc.tracks[i].f, buffer, CD_SECTOR_LEN);
-						}
-						if ((lba + 1) > toc.tracks[i].end) break;
-						buffer += CD_SECTOR_LEN;
-						cnt--;
-						lba++;
-					}
-					break;
-				}
+		if (toc.chd_f)
+		{
+			// The "fake" 150 sector pregap moves all the LBAs up by 150, so adjust here to read where the core actually wants data from
+			int read_lba = lba - toc.tracks[0].indexes[1];
+			if (cd_chd_read_sectors(toc.chd_f, read_lba + toc.tracks[i].offset, n, !toc.tracks[i].type, buffer) != CHDERR_NONE)
+			{
+				printf("\x1b[32mPSX: CHD read error: %d\n\x1b[0m", lba);
 			}
 		}
+		else
+		{
+			// single BIN keeps track offsets, otherwise every track has its own file
+			fileTYPE *f = toc.tracks[i].offset ? &toc.tracks[0].f : &toc.tracks[i].f;
+			FileSeek(f, toc.tracks[i].offset + ((lba - toc.tracks[i].start) * CD_SECTOR_LEN), SEEK_SET);
+			FileReadAdv(f, buffer, n * CD_SECTOR_LEN);
+		}
 
-		buffer += CD_SECTOR_LEN;
-		cnt--;
-		lba++;
+		buffer += n * CD_SECTOR_LEN;
+		cnt -= n;
+		lba += n;
 	}
 }
 
@@ -682,6 +601,8 @@ static int load_bios(const char* filename)
 
 void psx_mount_cd(int f_index, int s_index, const char *filename)
 {
+	IoThreadLock io_lock;
+
 	static char last_dir[1024] = {};
 
 	int loaded = 0;
@@ -788,8 +709,7 @@ void psx_mount_cd(int f_index, int s_index, const char *filename)
 	if (!loaded)
 	{
 		printf("Unmount CD\n");
-		unload_cue(&toc);
-		unload_chd(&toc);
+		unload_cd_image(&toc);
 		mount_cd(0, s_index);
 	}
 }
@@ -9,6 +9,7 @@
 #include "../../hardware.h"
 #include "../../menu.h"
 #include "../../cheats.h"
+#include "../../iothread.h"
 #include "saturn.h"
 
 static int need_reset = 0;
@@ -144,6 +145,8 @@ static int saturn_load_rom(const char *basename, const char *name, int sub_index
 
 void saturn_set_image(int num, const char *filename)
 {
+	IoThreadLock io_lock;
+
 	static char last_dir[1024] = {};
 
 	(void)num;
@@ -201,6 +204,7 @@ void saturn_set_image(int num, const char *filename)
 }
 
 void saturn_reset() {
+	IoThreadLock io_lock;
 	need_reset = 1;
 }
 
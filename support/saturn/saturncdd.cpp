@@ -6,7 +6,6 @@
 
 #include "saturn.h"
 #include "../../shmem.h"
-#include "../chd/mister_chd.h"
 
 #define SHMEM_ADDR  0x31000000
 
@@ -28,8 +27,6 @@ satcdd_t::satcdd_t() {
 	speed = 0;
 	audioLength = 0;
 	audioFirst = 0;
-	chd_hunkbuf = NULL;
-	chd_hunknum = -1;
 	SendData = NULL;
 
 	stat[0] = SATURN_STAT_OPEN;
@@ -46,42 +43,10 @@ satcdd_t::satcdd_t() {
 	SetChecksum(stat);
 }
 
-static int sgets(char *out, int sz, char **in)
-{
-	*out = 0;
-	do
-	{
-		char *instr = *in;
-		int cnt = 0;
-
-		while (*instr && *instr != 10)
-		{
-			if (*instr == 13)
-			{
-				instr++;
-				continue;
-			}
-
-			if (cnt < sz - 1)
-			{
-				out[cnt++] = *instr;
-				out[cnt] = 0;
-			}
-
-			instr++;
-		}
-
-		if (*instr == 10) instr++;
-		*in = instr;
-	} while (!*out && **in);
-
-	return *out;
-}
-
 int satcdd_t::LoadCUE(const char* filename) {
 	static char fname[1024 + 10];
 	static char line[128];
-	char *ptr, *lptr;
+	char *lptr;
 	static char cue[100 * 1024];
 	int new_file = 0;
 	int file_size = 0;
@@ -99,7 +64,7 @@ int satcdd_t::LoadCUE(const char* filename) {
 	int idx, mm, ss, bb, pregap = 0;
 
 	char *buf = cue;
-	while (sgets(line, sizeof(line), &buf))
+	while (cd_sgets(line, sizeof(line), &buf))
 	{
 		lptr = line;
 		while (*lptr == 0x20) lptr++;
@@ -109,27 +74,9 @@ int satcdd_t::LoadCUE(const char* filename) {
 		{
 			if (this->toc.last == 99) break;
 
-			ptr = fname + strlen(fname) - 1;
-			while ((ptr - fname) && (*ptr != '/') && (*ptr != '\\')) ptr--;
-			if (ptr - fname) ptr++;
-
-			lptr += 4;
-			while (*lptr == 0x20) lptr++;
+			const char *ftype = cd_cue_file(fname, 1024, lptr + 4);
 
-			if (*lptr == '\"')
-			{
-				lptr++;
-				while ((*lptr != '\"') && (lptr <= (line + 128)) && (ptr < (fname + 1023)))
-					*ptr++ = *lptr++;
-			}
-			else
-			{
-				while ((*lptr != 0x20) && (lptr <= (line + 128)) && (ptr < (fname + 1023)))
-					*ptr++ = *lptr++;
-			}
-			*ptr = 0;
-
-			if (!FileOpen(&this->toc.tracks[this->toc.last + 1].f, fname)) return -1;
+			if (!cd_track_open(&this->toc.tracks[this->toc.last + 1], fname)) return -1;
 			FileSeek(&this->toc.tracks[this->toc.last + 1].f, 0, SEEK_SET);
 			file_size = this->toc.tracks[this->toc.last + 1].f.size;
 
@@ -141,7 +88,7 @@ int satcdd_t::LoadCUE(const char* filename) {
 
 			this->toc.tracks[this->toc.last + 1].offset = 0;
 
-			if (!strstr(lptr, "BINARY") && !strstr(lptr, "MOTOROLA") && !strstr(lptr, "WAVE"))
+			if (!strstr(ftype, "BINARY") && !strstr(ftype, "MOTOROLA") && !strstr(ftype, "WAVE"))
 			{
 				FileClose(&this->toc.tracks[this->toc.last + 1].f);
 #ifdef SATURN_DEBUG
@@ -170,11 +117,13 @@ int satcdd_t::LoadCUE(const char* filename) {
 			if (strstr(lptr, "MODE1/2048"))
 			{
 				this->sectorSize = 2048;
+				this->toc.tracks[this->toc.last].sector_size = 2048;
 				this->toc.tracks[this->toc.last].type = 1;
 			}
 			else if (strstr(lptr, "MODE1/2352"))
 			{
 				this->sectorSize = 2352;
+				this->toc.tracks[this->toc.last].sector_size = 2352;
 				this->toc.tracks[this->toc.last].type = 1;
 
 				//FileSeek(&this->toc.tracks[0].f, 0x10, SEEK_SET);
@@ -182,6 +131,7 @@ int satcdd_t::LoadCUE(const char* filename) {
 			else if (strstr(lptr, "MODE2/2352"))
 			{
 				this->sectorSize = 2352;
+				this->toc.tracks[this->toc.last].sector_size = 2352;
 				this->toc.tracks[this->toc.last].type = 2;
 
 				//FileSeek(&this->toc.tracks[0].f, 0x10, SEEK_SET);
@@ -221,7 +171,7 @@ int satcdd_t::LoadCUE(const char* filename) {
 			new_file = 1;
 			if (!this->toc.tracks[this->toc.last].f.opened())
 			{
-				FileOpen(&this->toc.tracks[this->toc.last].f, fname);
+				cd_track_open(&this->toc.tracks[this->toc.last], fname);
 				new_file = 0;
 			}
 
@@ -322,25 +272,27 @@ int satcdd_t::Load(const char *filename)
 	const char *ext = filename + strlen(filename) - 4;
 	if (!strncasecmp(".cue", ext, 4))
 	{
-		if (LoadCUE(filename)) {
-			return (-1);
+		if (cd_toc_load(filename, "SATURN", &this->toc))
+		{
+			this->sectorSize = this->toc.sectorSize;
+		}
+		else
+		{
+			if (LoadCUE(filename)) {
+				return (-1);
+			}
+			this->toc.sectorSize = this->sectorSize;
+			cd_toc_save(filename, "SATURN", &this->toc);
 		}
 	}
 	else if (!strncasecmp(".chd", ext, 4)) {
-		chd_error err = mister_load_chd(filename, &this->toc);
+		chd_error err = cd_chd_open(filename, &this->toc);
 		if (err != CHDERR_NONE)
 		{
 			printf("ERROR %s\n", chd_error_string(err));
 			return -1;
 		}
 
-		if (this->chd_hunkbuf)
-		{
-			free(this->chd_hunkbuf);
-		}
-
-		this->chd_hunkbuf = (uint8_t *)malloc(this->toc.chd_hunksize);
-		this->chd_hunknum = -1;
 		if (this->toc.tracks[0].sector_size)
 		{
 			this->sectorSize = this->toc.tracks[0].sector_size;
@@ -394,31 +346,9 @@ int satcdd_t::Load(const char *filename)
 
 void satcdd_t::Unload()
 {
-	if (this->loaded)
-	{
-		if (this->toc.chd_f)
-		{
-			chd_close(this->toc.chd_f);
-		}
-
-		if (this->chd_hunkbuf)
-		{
-			free(this->chd_hunkbuf);
-			this->chd_hunkbuf = NULL;
-		}
-
-		for (int i = 0; i < this->toc.last; i++)
-		{
-			if (this->toc.tracks[i].f.opened())
-			{
-				FileClose(&this->toc.tracks[i].f);
-			}
-		}
-
-		this->loaded = 0;
-	}
-
-	memset(&this->toc, 0x00, sizeof(this->toc));
+	cd_cdda_stop(&this->cdda);
+	cd_unload(&this->toc);
+	this->loaded = 0;
 	this->sectorSize = 0;
 
 #ifdef SATURN_DEBUG
@@ -439,7 +369,7 @@ int satcdd_t::GetBootHeader(uint8_t *buf) {
 
 	if (this->toc.chd_f)
 	{
-		mister_chd_read_sector(this->toc.chd_f, 0, 0, offset, 256, buf, this->chd_hunkbuf, &this->chd_hunknum);
+		cd_chd_read(this->toc.chd_f, 0, offset, 256, buf);
 	}
 	else 
 	{
@@ -1115,39 +1045,12 @@ void satcdd_t::MakeSecureRingData(uint8_t *buf) {
 
 void satcdd_t::ReadData(uint8_t *buf)
 {
-	int offs = 0; 
-	
 	if (this->toc.tracks[this->track].type)
 	{
 		int lba_ = this->lba >= 0 ? this->lba : 0;
-		if (this->toc.chd_f)
-		{
-			int read_offset = 0;
-			if (this->sectorSize == 2048)
-			{
-				read_offset += 16;
-			}
 
-			mister_chd_read_sector(this->toc.chd_f, lba_ + this->toc.tracks[this->track].offset, read_offset, 0, this->sectorSize, buf, this->chd_hunkbuf, &this->chd_hunknum);
-		}
-		else {
-			if (this->sectorSize == 2048)
-			{
-				offs = (lba_ * 2048) - this->toc.tracks[this->track].offset;
-				FileSeek(&this->toc.tracks[this->track].f, offs, SEEK_SET);
-				FileReadAdv(&this->toc.tracks[this->track].f, buf + 16, 2048);
-			}
-			else {
-				offs = (lba_ * 2352) - this->toc.tracks[this->track].offset;
-				FileSeek(&this->toc.tracks[this->track].f, offs, SEEK_SET);
-				FileReadAdv(&this->toc.tracks[this->track].f, buf, 2352);
-			}
-#ifdef SATURN_DEBUG
-			//printf("\x1b[32mSaturn: ");
-			//printf("Read data, lba = %i, track = %i, offset = %i", lba_, this->track, offs);
-			//printf(" (%u)\n\x1b[0m", frame_cnt);
-#endif // SATURN_DEBUG
-		}
+		// 2048 byte sectors are placed at user data position of a raw frame
+		cd_read_sector(&this->toc, this->track, lba_, CD_READ_RAW, (this->sectorSize == 2048) ? buf + 16 : buf);
 	}
 }
 
@@ -1156,33 +1059,10 @@ int satcdd_t::ReadCDDA(uint8_t *buf, int first)
 	int sec_offs = first ? 0 : 1;
 
 	uint8_t *dest = buf;
-	if (this->toc.chd_f)
+	for (int i = sec_offs; i < 2; i++, dest += 4096)
 	{
-		for (int i = sec_offs; i < 2; i++, dest += 4096)
-		{
-			mister_chd_read_sector(this->toc.chd_f, this->chd_audio_read_lba + this->toc.tracks[this->track].offset + i, 0, 0, 2352, dest, this->chd_hunkbuf, &this->chd_hunknum);
-
-			//CHD audio requires byteswap. There's probably a better way to do this...
-			for (int swapidx = 0; swapidx < 2352; swapidx += 2)
-			{
-				uint8_t temp = dest[swapidx];
-				dest[swapidx] = dest[swapidx + 1];
-				dest[swapidx + 1] = temp;
-			}
-		}
-
-		/*if ((len / 2352) > 1)
-		{
-			this->chd_audio_read_lba++;
-		}*/
-	}
-	else if (this->toc.tracks[this->track].f.opened()) {
-		int offs = (this->lba * 2352) - this->toc.tracks[this->track].offset;
-		for (int i = sec_offs; i < 2; i++, dest += 4096)
-		{
-			FileSeek(&this->toc.tracks[this->track].f, offs + (i * 2352), SEEK_SET);
-			FileReadAdv(&this->toc.tracks[this->track].f, dest, 2352);
-		}
+		int lba = this->toc.chd_f ? this->chd_audio_read_lba : this->lba;
+		cd_cdda_read(&this->cdda, &this->toc, this->track, lba + i, dest);
 	}
 
 #ifdef SATURN_DEBUG
@@ -1198,7 +1078,7 @@ int satcdd_t::DataSectorSend(uint8_t* header, int speed)
 {
 	static int buf_num_read = 0, buf_num_write = 0;
 
-	uint8_t *shmem_ptr = (uint8_t*)shmem_map(SHMEM_ADDR, 4096 * 4);
+	uint8_t *shmem_ptr = (uint8_t*)shmem_acquire(SHMEM_ADDR, 4096 * 4);
 	uint8_t *data_ptr = shmem_ptr + (buf_num_write * 4096);
 	if (header) {
 		ReadData(data_ptr);
@@ -1208,7 +1088,7 @@ int satcdd_t::DataSectorSend(uint8_t* header, int speed)
 		ReadData(data_ptr);
 	}
 	int boot = (data_ptr[12] == 0x00 && data_ptr[13] == 0x02 && data_ptr[14] == 0x00 && data_ptr[15] == 0x01);
-	shmem_unmap(shmem_ptr, 4096 * 4);
+	shmem_release(shmem_ptr);
 
 
 	buf_num_write++;
@@ -1227,14 +1107,14 @@ int satcdd_t::DataSectorSend(uint8_t* header, int speed)
 
 int satcdd_t::RingDataSend(uint8_t* header, int speed)
 {
-	uint8_t *shmem_ptr = (uint8_t*)shmem_map(SHMEM_ADDR, 4096 * 4);
+	uint8_t *shmem_ptr = (uint8_t*)shmem_acquire(SHMEM_ADDR, 4096 * 4);
 	uint8_t *data_ptr = shmem_ptr;
 	if (header) {
 		MakeSecureRingData(data_ptr);
 		memcpy(data_ptr + 12, header, 12);
 		memset(data_ptr + 2348, 0, 4);
 	}
-	shmem_unmap(shmem_ptr, 4096 * 4);
+	shmem_release(shmem_ptr);
 
 	uint16_t mode = (speed == 2 ? 0x0101 : 0x0000) | 0x0404;
 
@@ -1250,11 +1130,11 @@ int satcdd_t::AudioSectorSend(int first)
 
 	if (first) buf_num_read = buf_num_write = 0;
 
-	uint8_t *shmem_ptr = (uint8_t*)shmem_map(SHMEM_ADDR, 4096 * 4);
+	uint8_t *shmem_ptr = (uint8_t*)shmem_acquire(SHMEM_ADDR, 4096 * 4);
 	uint8_t *data_ptr = shmem_ptr + (buf_num_write * 4096);
 
 	ReadCDDA(data_ptr, first);
-	shmem_unmap(shmem_ptr, 4096 * 4);
+	shmem_release(shmem_ptr);
 
 	if (first) buf_num_write++;
 	buf_num_write++;
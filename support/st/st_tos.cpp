@@ -7,6 +7,7 @@
 #include "../../file_io.h"
 #include "../../debug.h"
 #include "../../user_io.h"
+#include "../../iothread.h"
 #include "../../fpga_io.h"
 #include "st_tos.h"
 
@@ -438,11 +439,16 @@ char tos_cartridge_is_inserted()
 	return tos_cart_img[0];
 }
 
+// ACSI DMA servicing, called from user_io_poll_io()
 void tos_poll()
 {
-	static unsigned long timer = 0;
-
 	get_dmastate();
+}
+
+// main loop only: long press of user button (or keyboard reset) ejects floppies and resets
+void tos_poll_button()
+{
+	static unsigned long timer = 0;
 
 	// check the user button
 	if (!user_io_osd_is_visible() && (user_io_user_button() || user_io_get_kbd_reset()))
@@ -526,6 +532,7 @@ static void tos_select_hdd_image(int i, const char *name)
 
 void tos_insert_disk(int index, const char *name)
 {
+	IoThreadLock io_lock;
 	static int wpins = 0;
 
 	if (index <= 1)
@@ -555,6 +562,8 @@ void tos_eject_all()
 
 void tos_reset(char cold)
 {
+	IoThreadLock io_lock;
+
 	tos_update_sysctrl(config.system_ctrl | TOS_CONTROL_CPU_RESET);  // set reset
 	if (cold)
 	{
@@ -81,6 +81,7 @@ const char* tos_get_cfg_string(int num);
 unsigned long tos_system_ctrl();
 void tos_upload(const char *);
 void tos_poll();
+void tos_poll_button();
 void tos_update_sysctrl(uint32_t ctrl);
 char tos_disk_is_inserted(int index);
 void tos_insert_disk(int index, const char *name);
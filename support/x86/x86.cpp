@@ -38,6 +38,7 @@
 #include "../../fpga_io.h"
 #include "../../shmem.h"
 #include "../../ide.h"
+#include "../../iothread.h"
 #include "x86_share.h"
 
 #define FDD0_BASE   0xF200
@@ -510,11 +511,15 @@ static uint8_t bin2bcd(unsigned val)
 
 void x86_ide_set()
 {
+	IoThreadLock io_lock;
+
 	for (int i = 0; i < 4; i++) hdd_set(i, config.img_name[i + 2]);
 }
 
 void x86_init()
 {
+	IoThreadLock io_lock;
+
 	user_io_status_set("[0]", 1);
 
 	const char *home = HomeDir();
@@ -744,6 +749,8 @@ void x86_poll(int only_ide)
 
 void x86_set_image(int num, char *filename)
 {
+	IoThreadLock io_lock;
+
 	memset(config.img_name[num], 0, sizeof(config.img_name[0]));
 	strcpy(config.img_name[num], filename);
 	if (num < 2) fdd_set(num, filename);
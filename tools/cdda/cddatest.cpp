@@ -0,0 +1,159 @@
+// CDDA mix check and benchmark.
+//
+// cdda.cpp is included, so the NEON kernel and the scalar fallback are
+// reachable. The kernel must give the same output as the fallback for every
+// volume pair 0..256 with and without byteswap. Then the scalar fallback and
+// cd_cdda_mix() (NEON kernel) are timed against the former double precision
+// volume loop of ide_cdrom.cpp (with the separate byteswap pass CHD audio
+// needed) and the largest difference to it is reported.
+// make && ./cddatest [rounds]
+
+#include "../../cdda.cpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef CD_NEON
+#error "NEON kernel is not built, see Makefile"
+#endif
+
+// one CDDA frame plus an odd tail, so the scalar tail runs as well
+#define SAMPLES (2352 / 2 + 5)
+
+static int16_t src[SAMPLES];
+
+static void fill_src()
+{
+	static const int16_t edge[] = { 0, 1, -1, 255, -256, 32767, -32768, 0x1234, (int16_t)0x8001 };
+	const int edges = sizeof(edge) / sizeof(edge[0]);
+
+	for (int i = 0; i < edges; i++) src[i] = edge[i];
+
+	uint32_t seed = 1;
+	for (int i = edges; i < SAMPLES; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		src[i] = (int16_t)(seed >> 16);
+	}
+}
+
+// former ide_cdda_send_sector: byteswap pass for CHD, then volume in double
+static void old_mix(int16_t *buf, int samples, float vol0, float vol1, bool swap)
+{
+	if (swap) for (int i = 0; i < samples; i++) buf[i] = (int16_t)bswap_16((uint16_t)buf[i]);
+
+	for (int i = 0; i < samples; i++)
+	{
+		double tmps = (double)buf[i];
+		buf[i] = (int16_t)(tmps * ((i & 1) ? vol1 : vol0));
+	}
+}
+
+static int check()
+{
+	static int16_t neon[SAMPLES], scalar[SAMPLES];
+	int err = 0;
+
+	for (int swap = 0; swap < 2; swap++)
+	{
+		for (int vol0 = 0; vol0 <= 256; vol0++)
+		{
+			for (int vol1 = 0; vol1 <= 256; vol1++)
+			{
+				memcpy(neon, src, sizeof(src));
+				memcpy(scalar, src, sizeof(src));
+
+				int i = cdda_mix_neon(neon, SAMPLES, vol0, vol1, swap);
+				cdda_mix_scalar(neon, i, SAMPLES, vol0, vol1, swap);
+				cdda_mix_scalar(scalar, 0, SAMPLES, vol0, vol1, swap);
+
+				if (memcmp(neon, scalar, sizeof(neon)))
+				{
+					if (err < 10) printf("mismatch: vol %d/%d swap %d\n", vol0, vol1, swap);
+					err++;
+				}
+			}
+		}
+	}
+
+	return err;
+}
+
+// ATAPI volume is (n + 1) / 256, 8.8 fixed point is n + 1
+static int old_diff()
+{
+	static int16_t cur[SAMPLES], old[SAMPLES];
+	int diff = 0;
+
+	for (int swap = 0; swap < 2; swap++)
+	{
+		for (int vol = 1; vol <= 256; vol++)
+		{
+			memcpy(cur, src, sizeof(src));
+			memcpy(old, src, sizeof(src));
+
+			cd_cdda_mix(cur, SAMPLES, vol, 257 - vol, swap);
+			old_mix(old, SAMPLES, vol / 256.0f, (257 - vol) / 256.0f, swap);
+
+			for (int i = 0; i < SAMPLES; i++)
+			{
+				int d = abs(cur[i] - old[i]);
+				if (d > diff) diff = d;
+			}
+		}
+	}
+
+	return diff;
+}
+
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+enum { MIX_OLD, MIX_SCALAR, MIX_CUR };
+
+static double time_mix(int mix, bool swap, int rounds)
+{
+	static int16_t buf[SAMPLES];
+	memcpy(buf, src, sizeof(src));
+
+	double t = now_ns();
+	for (int r = 0; r < rounds; r++)
+	{
+		if (mix == MIX_CUR) cd_cdda_mix(buf, SAMPLES, 200, 180, swap);
+		else if (mix == MIX_SCALAR) cdda_mix_scalar(buf, 0, SAMPLES, 200, 180, swap);
+		else old_mix(buf, SAMPLES, 200 / 256.0f, 180 / 256.0f, swap);
+
+		// keep samples from decaying to zero
+		if (!buf[0]) memcpy(buf, src, sizeof(src));
+	}
+	return (now_ns() - t) / rounds;
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = (argc > 1) ? atoi(argv[1]) : 20000;
+	if (rounds <= 0) rounds = 1;
+
+	fill_src();
+
+	int err = check();
+	printf("NEON vs scalar: %d volume pairs x 2 swap modes, %d mismatches\n", 257 * 257, err);
+	printf("largest difference to former double loop: %d LSB\n", old_diff());
+
+	// NEON column is only meaningful with real NEON, neon_emu.h is a plain loop per lane
+#ifdef __arm__
+	const char *neon = "   NEON";
+#else
+	const char *neon = " NEON (emulated)";
+#endif
+	printf("ns per frame     old  scalar%s\n", neon);
+	printf("volume       %7.0f %7.0f %7.0f\n", time_mix(MIX_OLD, false, rounds), time_mix(MIX_SCALAR, false, rounds), time_mix(MIX_CUR, false, rounds));
+	printf("swap+volume  %7.0f %7.0f %7.0f\n", time_mix(MIX_OLD, true, rounds), time_mix(MIX_SCALAR, true, rounds), time_mix(MIX_CUR, true, rounds));
+
+	return err ? 1 : 0;
+}
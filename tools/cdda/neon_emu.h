@@ -0,0 +1,91 @@
+#ifndef NEON_EMU_H
+#define NEON_EMU_H
+
+// Plain C versions of the NEON intrinsics used by cdda.cpp, so the NEON
+// kernel runs on hosts without NEON. Lane order and rounding follow the ARM
+// definitions. Built with an ARM compiler the test uses <arm_neon.h> instead.
+
+#include <inttypes.h>
+#include <string.h>
+
+struct int16x4_t { int16_t v[4]; };
+struct int16x8_t { int16_t v[8]; };
+struct int32x4_t { int32_t v[4]; };
+struct uint8x16_t { uint8_t v[16]; };
+
+static inline int16x8_t vld1q_s16(const int16_t *p)
+{
+	int16x8_t r;
+	memcpy(r.v, p, sizeof(r.v));
+	return r;
+}
+
+static inline void vst1q_s16(int16_t *p, int16x8_t a)
+{
+	memcpy(p, a.v, sizeof(a.v));
+}
+
+static inline uint8x16_t vreinterpretq_u8_s16(int16x8_t a)
+{
+	uint8x16_t r;
+	memcpy(r.v, a.v, sizeof(r.v));
+	return r;
+}
+
+static inline int16x8_t vreinterpretq_s16_u8(uint8x16_t a)
+{
+	int16x8_t r;
+	memcpy(r.v, a.v, sizeof(r.v));
+	return r;
+}
+
+// reverse bytes in each 16 bit half
+static inline uint8x16_t vrev16q_u8(uint8x16_t a)
+{
+	uint8x16_t r;
+	for (int i = 0; i < 16; i += 2)
+	{
+		r.v[i] = a.v[i + 1];
+		r.v[i + 1] = a.v[i];
+	}
+	return r;
+}
+
+static inline int16x4_t vget_low_s16(int16x8_t a)
+{
+	int16x4_t r;
+	memcpy(r.v, a.v, sizeof(r.v));
+	return r;
+}
+
+static inline int16x4_t vget_high_s16(int16x8_t a)
+{
+	int16x4_t r;
+	memcpy(r.v, a.v + 4, sizeof(r.v));
+	return r;
+}
+
+static inline int16x8_t vcombine_s16(int16x4_t lo, int16x4_t hi)
+{
+	int16x8_t r;
+	memcpy(r.v, lo.v, sizeof(lo.v));
+	memcpy(r.v + 4, hi.v, sizeof(hi.v));
+	return r;
+}
+
+static inline int32x4_t vmull_s16(int16x4_t a, int16x4_t b)
+{
+	int32x4_t r;
+	for (int i = 0; i < 4; i++) r.v[i] = (int32_t)a.v[i] * b.v[i];
+	return r;
+}
+
+// arithmetic shift right and truncate to 16 bits
+static inline int16x4_t vshrn_n_s32(int32x4_t a, int n)
+{
+	int16x4_t r;
+	for (int i = 0; i < 4; i++) r.v[i] = (int16_t)(a.v[i] >> n);
+	return r;
+}
+
+#endif
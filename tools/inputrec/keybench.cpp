@@ -0,0 +1,162 @@
+// Key code translation check and benchmark.
+//
+// input.cpp is included, so its tables and keyrah_trans() are reachable.
+// Every key code is translated by the current lookups and by the former
+// implementation (scan set branch, linear search of kr_fn_table), results
+// must match. Then both are timed over all key codes.
+// make keybench && ./keybench [rounds]
+
+#include "../../input.cpp"
+#include <stdarg.h>
+#include <time.h>
+#include "replay.h"
+
+// replay globals used by stubs.cpp, nothing is replayed here
+uint64_t replay_clock = 1000;
+const char *replay_root = NULL;
+int replay_verbose = 0;
+replay_state_t replay_state;
+
+void replay_trace(const char *, ...) {}
+
+#define KEY_CODES 1024 // past 255 must give NONE
+
+// former implementations
+
+static uint32_t old_ps2_code(uint16_t key)
+{
+	if (key > 255) return NONE;
+	return (ps2_kbd_scan_set == 1) ? ev2ps2_set1[key] : ev2ps2[key];
+}
+
+static uint32_t old_amiga_code(uint16_t key)
+{
+	if (key > 255) return NONE;
+	return ev2amiga[key];
+}
+
+static uint32_t old_archie_code(uint16_t key)
+{
+	if (key > 255) return NONE;
+	return ev2archie[key];
+}
+
+// keyrah_trans() with Fn held
+static int old_keyrah_fn(int key)
+{
+	if (key == KEY_NUMLOCK)    return KEY_F13;
+	if (key == KEY_SCROLLLOCK) return KEY_F14;
+	if (key == KEY_INSERT)     return KEY_F16;
+
+	for (uint32_t n = 0; n < (sizeof(kr_fn_table) / (2 * sizeof(kr_fn_table[0]))); n++)
+	{
+		if ((key & 255) == kr_fn_table[n * 2]) return kr_fn_table[(n * 2) + 1];
+	}
+
+	return key;
+}
+
+static int new_keyrah_fn(int key)
+{
+	return keyrah_trans(key, 1);
+}
+
+typedef uint32_t (*code_fn)(uint16_t key);
+
+static int check_codes(const char *name, code_fn cur, code_fn old)
+{
+	int err = 0;
+	for (int key = 0; key < KEY_CODES; key++)
+	{
+		if (cur(key) != old(key))
+		{
+			printf("%s: key %d gives %X, expected %X\n", name, key, cur(key), old(key));
+			err++;
+		}
+	}
+
+	return err;
+}
+
+static int check_keyrah()
+{
+	int err = 0;
+	for (int key = 0; key < KEY_CODES; key++)
+	{
+		if (key == KEY_102ND) continue;
+		if (new_keyrah_fn(key) != old_keyrah_fn(key))
+		{
+			printf("keyrah: key %d gives %d, expected %d\n", key, new_keyrah_fn(key), old_keyrah_fn(key));
+			err++;
+		}
+	}
+
+	return err;
+}
+
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile uint32_t sink;
+
+static double time_codes(code_fn fn, int rounds)
+{
+	double t = now_ns();
+	for (int r = 0; r < rounds; r++)
+	{
+		uint32_t acc = 0;
+		for (int key = 0; key < 256; key++) acc += fn(key);
+		sink = acc;
+	}
+	return (now_ns() - t) / ((double)rounds * 256);
+}
+
+static double time_keyrah(int (*fn)(int), int rounds)
+{
+	double t = now_ns();
+	for (int r = 0; r < rounds; r++)
+	{
+		uint32_t acc = 0;
+		for (int key = 0; key < 256; key++) if (key != KEY_102ND) acc += fn(key);
+		sink = acc;
+	}
+	return (now_ns() - t) / ((double)rounds * 255);
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = (argc > 1) ? atoi(argv[1]) : 100000;
+	if (rounds <= 0) rounds = 1;
+
+	int err = 0;
+
+	// Fn stays held, keyrah_trans() then translates every key
+	keyrah_trans(KEY_102ND, 1);
+
+	for (int set = 1; set <= 2; set++)
+	{
+		ps2_kbd_scan_set = set;
+		err += check_codes(set == 1 ? "ps2 set1" : "ps2 set2", get_ps2_code, old_ps2_code);
+	}
+	err += check_codes("amiga", get_amiga_code, old_amiga_code);
+	err += check_codes("archie", get_archie_code, old_archie_code);
+	err += check_keyrah();
+
+	printf("%d key codes checked, %d mismatches\n", KEY_CODES, err);
+
+	printf("ns per key         old     new\n");
+	for (int set = 1; set <= 2; set++)
+	{
+		ps2_kbd_scan_set = set;
+		printf("ps2 set%d      %8.2f %7.2f\n", set, time_codes(old_ps2_code, rounds), time_codes(get_ps2_code, rounds));
+	}
+	printf("amiga         %8.2f %7.2f\n", time_codes(old_amiga_code, rounds), time_codes(get_amiga_code, rounds));
+	printf("archie        %8.2f %7.2f\n", time_codes(old_archie_code, rounds), time_codes(get_archie_code, rounds));
+	printf("keyrah Fn     %8.2f %7.2f\n", time_keyrah(old_keyrah_fn, rounds), time_keyrah(new_keyrah_fn, rounds));
+
+	return err ? 1 : 0;
+}
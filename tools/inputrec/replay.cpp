@@ -0,0 +1,811 @@
+// Host replay of recordings made by "input record" (inputrec.cpp).
+//
+// input.cpp is built for the host and runs against the recorded devices.
+// Device nodes, evdev ioctls, inotify, /proc/bus/input/devices and sysfs are
+// emulated here: calls are redirected with the linker --wrap option, so
+// input.cpp itself is not changed. Records are delivered at their recorded
+// time on a virtual clock and input_poll() is called every poll interval of
+// that clock, so replay runs as fast as possible and always gives the same
+// result. Core side (joystick, mouse, keyboard) is captured by stubs.cpp.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/input.h>
+
+#include "../../cfg.h"
+#include "../../input.h"
+#include "../../inputrec.h"
+#include "replay.h"
+
+uint64_t replay_clock = 1000;
+const char *replay_root = NULL;
+int replay_verbose = 0;
+replay_state_t replay_state;
+
+#define MAXDEV      64
+#define FD_INOTIFY  1000
+#define FD_DEV      1001
+
+// data read from the device node
+struct chunk_t
+{
+	chunk_t *next;
+	int      len;
+	int      pos;
+	uint8_t  data[];
+};
+
+struct fake_dev
+{
+	rec_device desc;
+	bool       used;
+	bool       present; // node exists in /dev/input
+	bool       open;
+	bool       ack;     // mouse: ImPS/2 switch is acknowledged by next read
+	chunk_t   *head;
+	chunk_t   *tail;
+};
+
+static fake_dev devs[MAXDEV];
+
+// generation of recorded device open -> fake_dev
+struct gen_map_t
+{
+	uint32_t gen;
+	int      dev;
+};
+
+static gen_map_t *gen_map = NULL;
+static int gen_cnt = 0;
+
+static uint8_t inotify_buf[4096];
+static int inotify_len = 0;
+
+static uint64_t stat_events = 0;
+static uint64_t stat_mouse = 0;
+static uint64_t stat_dropped = 0;
+
+static uint64_t start_clock = 0;
+
+// input.cpp log goes to stdout, trace and report go here
+static FILE *out = stdout;
+
+void replay_trace(const char *fmt, ...)
+{
+	if (!replay_verbose) return;
+
+	uint64_t t = replay_clock - start_clock;
+	fprintf(out, "%6llu.%03llu ", (unsigned long long)(t / 1000), (unsigned long long)(t % 1000));
+
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(out, fmt, args);
+	va_end(args);
+}
+
+static fake_dev *dev_by_fd(int fd)
+{
+	if (fd < FD_DEV || fd >= FD_DEV + MAXDEV) return NULL;
+	fake_dev *dev = &devs[fd - FD_DEV];
+	return dev->open ? dev : NULL;
+}
+
+static void dev_flush(fake_dev *dev)
+{
+	while (dev->head)
+	{
+		chunk_t *c = dev->head;
+		dev->head = c->next;
+		free(c);
+	}
+
+	dev->tail = NULL;
+}
+
+static void dev_push(fake_dev *dev, const void *data, int len)
+{
+	chunk_t *c = (chunk_t *)malloc(sizeof(chunk_t) + len);
+	c->next = NULL;
+	c->len = len;
+	c->pos = 0;
+	memcpy(c->data, data, len);
+
+	if (dev->tail) dev->tail->next = c;
+	else dev->head = c;
+	dev->tail = c;
+}
+
+static void inotify_push(const char *name, uint32_t mask)
+{
+	char buf[sizeof(struct inotify_event) + 16] = {};
+	struct inotify_event *ev = (struct inotify_event *)buf;
+	ev->wd = 1;
+	ev->mask = mask;
+	ev->len = 16;
+	snprintf(ev->name, 16, "%s", name);
+
+	if (inotify_len + (int)sizeof(buf) > (int)sizeof(inotify_buf))
+	{
+		// same as kernel does when queue is full
+		ev->mask = IN_Q_OVERFLOW;
+		ev->len = 0;
+		inotify_len = 0;
+		memcpy(inotify_buf, buf, sizeof(struct inotify_event));
+		inotify_len = sizeof(struct inotify_event);
+		return;
+	}
+
+	memcpy(inotify_buf + inotify_len, buf, sizeof(buf));
+	inotify_len += sizeof(buf);
+}
+
+static void dev_remove(fake_dev *dev, bool notify)
+{
+	dev->present = false;
+	dev_flush(dev);
+	if (notify) inotify_push(dev->desc.node, IN_DELETE);
+}
+
+// current axis values differ between opens of the same device
+static bool desc_same(const rec_device *a, const rec_device *b)
+{
+	static rec_device tmp;
+	tmp = *b;
+	for (int i = 0; i < REC_ABS_CNT; i++) tmp.abs[i].value = a->abs[i].value;
+	return !memcmp(a, &tmp, sizeof(tmp));
+}
+
+static int dev_add(const rec_device *desc, bool notify)
+{
+	int n = -1;
+	for (int i = 0; i < MAXDEV; i++)
+	{
+		if (devs[i].used && devs[i].present && !strcmp(devs[i].desc.node, desc->node))
+		{
+			// reopen of the same node (orphan mouse, full rescan) is the same device
+			if (desc_same(&devs[i].desc, desc)) return i;
+			dev_remove(&devs[i], notify);
+		}
+	}
+
+	// slot can be reused once input.cpp closed it
+	for (int i = 0; i < MAXDEV && n < 0; i++) if (!devs[i].used || (!devs[i].present && !devs[i].open)) n = i;
+	if (n < 0)
+	{
+		printf("replay: too many devices\n");
+		return -1;
+	}
+
+	fake_dev *dev = &devs[n];
+	dev_flush(dev);
+	memset(dev, 0, sizeof(*dev));
+	dev->desc = *desc;
+	dev->used = true;
+	dev->present = true;
+
+	if (notify) inotify_push(desc->node, IN_CREATE);
+	return n;
+}
+
+static void gen_add(uint32_t gen, int dev)
+{
+	for (int i = 0; i < gen_cnt; i++)
+	{
+		if (gen_map[i].gen == gen)
+		{
+			gen_map[i].dev = dev;
+			return;
+		}
+	}
+
+	if (!(gen_cnt & 63)) gen_map = (gen_map_t *)realloc(gen_map, (gen_cnt + 64) * sizeof(gen_map_t));
+	gen_map[gen_cnt].gen = gen;
+	gen_map[gen_cnt].dev = dev;
+	gen_cnt++;
+}
+
+static fake_dev *dev_by_gen(uint32_t gen)
+{
+	for (int i = gen_cnt - 1; i >= 0; i--)
+	{
+		if (gen_map[i].gen == gen) return (gen_map[i].dev >= 0) ? &devs[gen_map[i].dev] : NULL;
+	}
+
+	return NULL;
+}
+
+static fake_dev *dev_by_node(const char *path)
+{
+	if (strncmp(path, "/dev/input/", 11)) return NULL;
+	for (int i = 0; i < MAXDEV; i++)
+	{
+		if (devs[i].used && devs[i].present && !strcmp(devs[i].desc.node, path + 11)) return &devs[i];
+	}
+
+	return NULL;
+}
+
+// /sys/class/input/<node>/device[/attr]
+static fake_dev *dev_by_sysfs(const char *path, const char **attr)
+{
+	if (strncmp(path, "/sys/class/input/", 17)) return NULL;
+
+	const char *node = path + 17;
+	const char *end = strchr(node, '/');
+	if (!end || strncmp(end, "/device", 7) || (end[7] && end[7] != '/')) return NULL;
+
+	*attr = end[7] ? end + 8 : "";
+	for (int i = 0; i < MAXDEV; i++)
+	{
+		if (devs[i].used && devs[i].present && !strncmp(devs[i].desc.node, node, end - node) && !devs[i].desc.node[end - node]) return &devs[i];
+	}
+
+	return NULL;
+}
+
+static FILE *mem_file(const char *str)
+{
+	int len = strlen(str);
+	FILE *f = fmemopen(NULL, len + 1, "w+");
+	if (!f) return NULL;
+
+	fwrite(str, 1, len, f);
+	rewind(f);
+	return f;
+}
+
+// Redirected calls. Anything not emulated goes to the real function.
+
+extern "C" {
+
+int __real_open64(const char *path, int flags, ...);
+int __real_close(int fd);
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_ioctl(int fd, unsigned long req, ...);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+DIR *__real_opendir(const char *name);
+struct dirent64 *__real_readdir64(DIR *dir);
+int __real_closedir(DIR *dir);
+FILE *__real_fopen64(const char *path, const char *mode);
+char *__real_realpath(const char *path, char *resolved);
+int __real_mkfifo(const char *path, mode_t mode);
+int __real_unlink(const char *path);
+
+int __wrap_open64(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	if (flags & O_CREAT)
+	{
+		va_list args;
+		va_start(args, flags);
+		mode = va_arg(args, mode_t);
+		va_end(args);
+	}
+
+	if (!strncmp(path, "/dev/", 5) || !strncmp(path, "/sys/", 5))
+	{
+		fake_dev *dev = dev_by_node(path);
+		if (!dev || dev->open)
+		{
+			errno = dev ? EBUSY : ENOENT;
+			return -1;
+		}
+
+		dev->open = true;
+		dev->ack = false;
+		return FD_DEV + (dev - devs);
+	}
+
+	return __real_open64(path, flags, mode);
+}
+
+int __wrap_close(int fd)
+{
+	if (fd == FD_INOTIFY) return 0;
+
+	fake_dev *dev = dev_by_fd(fd);
+	if (!dev) return __real_close(fd);
+
+	dev->open = false;
+	dev_flush(dev);
+	return 0;
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+	if (fd == FD_INOTIFY)
+	{
+		int len = (inotify_len < (int)count) ? inotify_len : (int)count;
+		memcpy(buf, inotify_buf, len);
+		inotify_len = 0;
+		return len;
+	}
+
+	fake_dev *dev = dev_by_fd(fd);
+	if (!dev) return __real_read(fd, buf, count);
+
+	if (dev->desc.mouse)
+	{
+		if (dev->ack)
+		{
+			dev->ack = false;
+			*(uint8_t *)buf = 0xFA;
+			return 1;
+		}
+
+		// mousedev returns one packet per read
+		chunk_t *c = dev->head;
+		if (!c)
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+
+		int len = (c->len < (int)count) ? c->len : (int)count;
+		memcpy(buf, c->data, len);
+		dev->head = c->next;
+		if (!dev->head) dev->tail = NULL;
+		free(c);
+
+		stat_mouse++;
+		return len;
+	}
+
+	// evdev returns as many events as fit
+	int len = 0;
+	while (dev->head && len + (int)sizeof(struct input_event) <= (int)count)
+	{
+		chunk_t *c = dev->head;
+		struct input_event *ev = (struct input_event *)(c->data + c->pos);
+		memcpy((uint8_t *)buf + len, ev, sizeof(*ev));
+		len += sizeof(*ev);
+
+		if (ev->type == EV_ABS && ev->code < REC_ABS_CNT) dev->desc.abs[ev->code].value = ev->value;
+
+		c->pos += sizeof(*ev);
+		if (c->pos >= c->len)
+		{
+			dev->head = c->next;
+			if (!dev->head) dev->tail = NULL;
+			free(c);
+		}
+	}
+
+	if (!len)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	stat_events += len / sizeof(struct input_event);
+	return len;
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+	fake_dev *dev = dev_by_fd(fd);
+	if (!dev) return __real_write(fd, buf, count);
+
+	// ImPS/2 switch sequence
+	if (dev->desc.mouse && count == 6) dev->ack = true;
+	return count;
+}
+
+int __wrap_ioctl(int fd, unsigned long req, ...)
+{
+	va_list args;
+	va_start(args, req);
+	void *arg = va_arg(args, void *);
+	va_end(args);
+
+	fake_dev *dev = dev_by_fd(fd);
+	if (!dev) return __real_ioctl(fd, req, arg);
+	if (dev->desc.mouse || _IOC_TYPE(req) != 'E')
+	{
+		errno = ENOTTY;
+		return -1;
+	}
+
+	const rec_device *desc = &dev->desc;
+	uint32_t nr = _IOC_NR(req);
+	int size = _IOC_SIZE(req);
+
+	const void *src = NULL;
+	int len = 0;
+
+	if (nr == _IOC_NR(EVIOCGID))
+	{
+		struct input_id id = { desc->bustype, desc->vendor, desc->product, desc->version };
+		memcpy(arg, &id, sizeof(id));
+		return 0;
+	}
+	else if (nr >= _IOC_NR(EVIOCGABS(0)) && nr < _IOC_NR(EVIOCGABS(REC_ABS_CNT)) && (_IOC_DIR(req) & _IOC_READ))
+	{
+		const rec_absinfo *a = &desc->abs[nr - _IOC_NR(EVIOCGABS(0))];
+		struct input_absinfo abs = { a->value, a->minimum, a->maximum, a->fuzz, a->flat, a->resolution };
+		memcpy(arg, &abs, sizeof(abs));
+		return 0;
+	}
+	else if (nr == _IOC_NR(EVIOCGNAME(0))) { src = desc->name; len = strlen(desc->name) + 1; }
+	else if (nr == _IOC_NR(EVIOCGPHYS(0))) { src = desc->phys; len = strlen(desc->phys) + 1; }
+	else if (nr == _IOC_NR(EVIOCGUNIQ(0))) { src = desc->uniq; len = strlen(desc->uniq) + 1; }
+	else if (nr == _IOC_NR(EVIOCGBIT(0, 0))) { src = desc->evbits; len = sizeof(desc->evbits); }
+	else if (nr == _IOC_NR(EVIOCGBIT(EV_KEY, 0))) { src = desc->keybits; len = sizeof(desc->keybits); }
+	else if (nr == _IOC_NR(EVIOCGBIT(EV_REL, 0))) { src = desc->relbits; len = sizeof(desc->relbits); }
+	else if (nr == _IOC_NR(EVIOCGBIT(EV_ABS, 0))) { src = desc->absbits; len = sizeof(desc->absbits); }
+	else if (req == EVIOCGEFFECTS)
+	{
+		// force feedback is not recorded
+		*(int *)arg = 0;
+		return 0;
+	}
+	else if (!(_IOC_DIR(req) & _IOC_READ) || req == (unsigned long)EVIOCSFF)
+	{
+		// grab, clock id, effects and other settings are accepted
+		return 0;
+	}
+
+	// other queries (key/led state, other bits) read as empty
+	if (size) memset(arg, 0, size);
+	if (len > size) len = size;
+	if (src) memcpy(arg, src, len);
+	return len;
+}
+
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	// never blocks, time is advanced by replay loop
+	(void)timeout;
+
+	int cnt = 0;
+	for (nfds_t i = 0; i < nfds; i++)
+	{
+		fds[i].revents = 0;
+		if (fds[i].fd < 0) continue;
+
+		if (fds[i].fd == FD_INOTIFY)
+		{
+			if (inotify_len) fds[i].revents = POLLIN;
+		}
+		else if (fake_dev *dev = dev_by_fd(fds[i].fd))
+		{
+			if (dev->head || dev->ack) fds[i].revents = POLLIN;
+		}
+
+		fds[i].revents &= fds[i].events;
+		if (fds[i].revents) cnt++;
+	}
+
+	return cnt;
+}
+
+int __wrap_inotify_init1(int) { return FD_INOTIFY; }
+int __wrap_inotify_add_watch(int, const char *, uint32_t) { return 1; }
+int __wrap_inotify_rm_watch(int, int) { return 0; }
+
+static DIR *const dev_dir = (DIR *)&dev_dir;
+static int dev_dir_pos = 0;
+
+DIR *__wrap_opendir(const char *name)
+{
+	if (strcmp(name, "/dev/input")) return __real_opendir(name);
+
+	dev_dir_pos = 0;
+	return dev_dir;
+}
+
+struct dirent64 *__wrap_readdir64(DIR *dir)
+{
+	if (dir != dev_dir) return __real_readdir64(dir);
+
+	static struct dirent64 de;
+	while (dev_dir_pos < MAXDEV)
+	{
+		fake_dev *dev = &devs[dev_dir_pos++];
+		if (!dev->used || !dev->present) continue;
+
+		memset(&de, 0, sizeof(de));
+		de.d_type = DT_CHR;
+		snprintf(de.d_name, sizeof(de.d_name), "%s", dev->desc.node);
+		return &de;
+	}
+
+	return NULL;
+}
+
+int __wrap_closedir(DIR *dir)
+{
+	return (dir == dev_dir) ? 0 : __real_closedir(dir);
+}
+
+FILE *__wrap_fopen64(const char *path, const char *mode)
+{
+	if (!strcmp(path, "/proc/bus/input/devices"))
+	{
+		// one handler per block, nodes of one device are matched by phys/uniq
+		static char buf[MAXDEV * 1024];
+		int len = 0;
+		for (int i = 0; i < MAXDEV; i++)
+		{
+			const rec_device *d = &devs[i].desc;
+			if (!devs[i].used || !devs[i].present) continue;
+
+			len += snprintf(buf + len, sizeof(buf) - len,
+				"I: Bus=%04x Vendor=%04x Product=%04x Version=%04x\nN: Name=\"%s\"\nP: Phys=%s\nS: Sysfs=%s\nU: Uniq=%s\nH: Handlers=%s \n\n",
+				d->bustype, d->vendor, d->product, d->version, d->name, d->phys, d->sysfs, d->uniq, d->node);
+		}
+
+		buf[len] = 0;
+		return mem_file(buf);
+	}
+
+	const char *attr;
+	if (fake_dev *dev = dev_by_sysfs(path, &attr))
+	{
+		char buf[300];
+		if (!strcmp(attr, "phys")) snprintf(buf, sizeof(buf), "%s\n", dev->desc.phys);
+		else if (!strcmp(attr, "uniq")) snprintf(buf, sizeof(buf), "%s\n", dev->desc.uniq);
+		else if (!strcmp(attr, "name")) snprintf(buf, sizeof(buf), "%s\n", dev->desc.name);
+		else return NULL;
+
+		return mem_file(buf);
+	}
+
+	// leds, power supply and other device files don't exist
+	if (!strncmp(path, "/sys/", 5) || !strncmp(path, "/proc/", 6) || !strncmp(path, "/dev/", 5))
+	{
+		errno = ENOENT;
+		return NULL;
+	}
+
+	return __real_fopen64(path, mode);
+}
+
+char *__wrap_realpath(const char *path, char *resolved)
+{
+	const char *attr;
+	fake_dev *dev = dev_by_sysfs(path, &attr);
+	if (!dev) return __real_realpath(path, resolved);
+	if (*attr || !dev->desc.sysfs[0]) return NULL;
+
+	static char buf[PATH_MAX];
+	snprintf(resolved ? resolved : buf, PATH_MAX, "/sys%s", dev->desc.sysfs);
+	return resolved ? resolved : strdup(buf);
+}
+
+int __wrap_mkfifo(const char *path, mode_t mode)
+{
+	return strncmp(path, "/dev/", 5) ? __real_mkfifo(path, mode) : -1;
+}
+
+int __wrap_unlink(const char *path)
+{
+	return strncmp(path, "/dev/", 5) ? __real_unlink(path) : -1;
+}
+
+int __wrap_system(const char *cmd)
+{
+	replay_trace("system: %s\n", cmd);
+	return 0;
+}
+
+int __wrap_usleep(useconds_t)
+{
+	return 0;
+}
+
+}
+
+// Replay
+
+static uint64_t wall_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint64_t busy_us = 0;
+static uint64_t polls = 0;
+
+static void poll_input()
+{
+	uint64_t t = wall_us();
+	input_poll(0);
+	busy_us += wall_us() - t;
+	polls++;
+}
+
+static void usage()
+{
+	printf("Usage: inputrec_replay [-v] [-l] [-r <MiSTer root>] [-p <poll ms>] <recording>\n");
+	printf("  -v  print everything sent to the core with virtual time\n");
+	printf("  -l  show input.cpp log\n");
+	printf("  -r  directory with config/ for mappings (copy of /media/fat)\n");
+	printf("  -p  main loop poll interval, default 1 ms\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int poll_ms = 1;
+	const char *name = NULL;
+	bool log = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-v")) replay_verbose = 1;
+		else if (!strcmp(argv[i], "-l")) log = true;
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc) replay_root = argv[++i];
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc) poll_ms = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && !name) name = argv[i];
+		else usage();
+	}
+
+	if (!name || poll_ms <= 0) usage();
+
+	FILE *f = fopen(name, "rb");
+	if (!f)
+	{
+		printf("replay: cannot open %s\n", name);
+		return 1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *file = (uint8_t *)malloc(size);
+	if (!file || fread(file, 1, size, f) != (size_t)size || size < 8 || memcmp(file, REC_MAGIC, 8))
+	{
+		printf("replay: %s is not a recording\n", name);
+		return 1;
+	}
+	fclose(f);
+
+	// the same as cfg.cpp defaults
+	cfg.controller_info = 6;
+	cfg.rumble = 1;
+	cfg.wheel_force = 50;
+
+	if (!log)
+	{
+		fflush(stdout);
+		out = fdopen(dup(1), "w");
+		freopen("/dev/null", "w", stdout);
+	}
+
+	long pos = 8;
+	uint32_t records = 0;
+
+	// devices open when recording has started are found by initial scan
+	while (pos + (long)sizeof(rec_header) <= size)
+	{
+		rec_header *hdr = (rec_header *)(file + pos);
+		if (hdr->kind != REC_DEVICE || hdr->time || hdr->size != sizeof(rec_device)) break;
+
+		gen_add(hdr->gen, dev_add((rec_device *)(hdr + 1), false));
+		pos += sizeof(rec_header) + hdr->size;
+		records++;
+	}
+
+	start_clock = replay_clock;
+	poll_input();
+	uint64_t next_poll = replay_clock + poll_ms;
+
+	while (pos + (long)sizeof(rec_header) <= size)
+	{
+		rec_header *hdr = (rec_header *)(file + pos);
+		uint8_t *data = (uint8_t *)(hdr + 1);
+		if (pos + (long)sizeof(rec_header) + hdr->size > size)
+		{
+			printf("replay: truncated record at %ld\n", pos);
+			break;
+		}
+		pos += sizeof(rec_header) + hdr->size;
+		records++;
+
+		uint64_t t = start_clock + hdr->time / 1000;
+		while (next_poll <= t)
+		{
+			replay_clock = next_poll;
+			poll_input();
+			next_poll += poll_ms;
+		}
+		replay_clock = t;
+
+		fake_dev *dev = dev_by_gen(hdr->gen);
+		switch (hdr->kind)
+		{
+		case REC_DEVICE:
+			if (hdr->size == sizeof(rec_device)) gen_add(hdr->gen, dev_add((rec_device *)data, true));
+			break;
+
+		case REC_REMOVE:
+			if (dev && dev->present) dev_remove(dev, true);
+			break;
+
+		case REC_EVENTS:
+		case REC_MOUSE:
+			if (!dev || !dev->open || !dev->present)
+			{
+				stat_dropped++;
+				break;
+			}
+
+			if (hdr->kind == REC_MOUSE)
+			{
+				dev_push(dev, data, hdr->size);
+				break;
+			}
+			else
+			{
+				int cnt = hdr->size / sizeof(rec_event);
+				struct input_event *ev = (struct input_event *)calloc(cnt, sizeof(struct input_event));
+				rec_event *rev = (rec_event *)data;
+				for (int i = 0; i < cnt; i++)
+				{
+					ev[i].time.tv_sec = rev[i].sec;
+					ev[i].time.tv_usec = rev[i].usec;
+					ev[i].type = rev[i].type;
+					ev[i].code = rev[i].code;
+					ev[i].value = rev[i].value;
+				}
+				dev_push(dev, ev, cnt * sizeof(struct input_event));
+				free(ev);
+			}
+			break;
+
+		default:
+			printf("replay: unknown record %d at %ld\n", hdr->kind, pos);
+			break;
+		}
+	}
+
+	// let timers (autofire, key repeat, mouse emulation) run out
+	uint64_t end = replay_clock + 1000;
+	while (next_poll <= end)
+	{
+		replay_clock = next_poll;
+		poll_input();
+		next_poll += poll_ms;
+	}
+
+	uint64_t duration = replay_clock - start_clock;
+	fprintf(out, "replay: %u records, %llu.%03llu s of input, %llu polls\n", records,
+		(unsigned long long)(duration / 1000), (unsigned long long)(duration % 1000), (unsigned long long)polls);
+	fprintf(out, "replay: %llu events and %llu mouse packets processed in %llu us", (unsigned long long)stat_events,
+		(unsigned long long)stat_mouse, (unsigned long long)busy_us);
+	if (busy_us) fprintf(out, " (%llu events/s)", (unsigned long long)((stat_events + stat_mouse) * 1000000ULL / busy_us));
+	fprintf(out, "\n");
+	if (stat_dropped) fprintf(out, "replay: %llu records for devices not opened by input.cpp\n", (unsigned long long)stat_dropped);
+	fprintf(out, "replay: %u digital, %u analog, %u mouse, %u keyboard and %u menu updates\n",
+		replay_state.digital, replay_state.analog, replay_state.mouse, replay_state.keys, replay_state.menu_keys);
+
+	for (int i = 0; i < REPLAY_MAXJOY; i++)
+	{
+		int8_t (*a)[2] = replay_state.joy_axis[i];
+		if (!replay_state.joy_map[i] && !a[0][0] && !a[0][1] && !a[1][0] && !a[1][1]) continue;
+		fprintf(out, "replay: P%d buttons=%08X left=%d,%d right=%d,%d\n", i + 1, replay_state.joy_map[i], a[0][0], a[0][1], a[1][0], a[1][1]);
+	}
+
+	if (replay_state.mouse)
+	{
+		fprintf(out, "replay: mouse buttons=%02X moved=%lld,%lld wheel=%lld\n", replay_state.mouse_btn,
+			(long long)replay_state.mouse_x, (long long)replay_state.mouse_y, (long long)replay_state.mouse_w);
+	}
+
+	free(file);
+	return 0;
+}
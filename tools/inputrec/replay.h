@@ -0,0 +1,36 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <inttypes.h>
+
+// virtual clock in ms, GetTimer() returns it
+extern uint64_t replay_clock;
+
+// MiSTer root (config/ is used for mappings), NULL - no files
+extern const char *replay_root;
+
+extern int replay_verbose;
+
+// core visible state, updated by user_io stubs
+#define REPLAY_MAXJOY 6
+
+struct replay_state_t
+{
+	uint32_t digital;
+	uint32_t analog;
+	uint32_t mouse;
+	uint32_t keys;
+	uint32_t menu_keys;
+
+	uint32_t joy_map[REPLAY_MAXJOY];
+	int8_t   joy_axis[REPLAY_MAXJOY][2][2];
+	int      mouse_btn;
+	int64_t  mouse_x, mouse_y, mouse_w;
+};
+
+extern replay_state_t replay_state;
+
+// prints trace line prefixed by virtual time
+void replay_trace(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
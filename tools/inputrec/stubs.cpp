@@ -0,0 +1,202 @@
+// MiSTer functions used by input.cpp. Core side calls are captured into
+// replay_state, files are read from the MiSTer root given on command line
+// and never written.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../cfg.h"
+#include "../../hardware.h"
+#include "../../file_io.h"
+#include "../../user_io.h"
+#include "../../menu.h"
+#include "../../input.h"
+#include "../../video.h"
+#include "../../audio.h"
+#include "../../spi.h"
+#include "../../fpga_io.h"
+#include "../../scheduler.h"
+#include "../../inputthread.h"
+#include "../../support/arcade/mra_loader.h"
+#include "../../support/n64/n64_joy_emu.h"
+#include "replay.h"
+
+cfg_t cfg;
+
+unsigned long GetTimer(unsigned long offset)
+{
+	return (unsigned long)(replay_clock + offset);
+}
+
+unsigned long CheckTimer(unsigned long time)
+{
+	if (!time) return 1;
+	return replay_clock >= time;
+}
+
+// files
+
+static int load_file(const char *dir, const char *name, void *buf, int size)
+{
+	if (!replay_root) return 0;
+
+	char path[1024];
+	if (name[0] == '/') snprintf(path, sizeof(path), "%s", name);
+	else snprintf(path, sizeof(path), "%s/%s%s", replay_root, dir, name);
+
+	FILE *f = fopen(path, "rb");
+	if (!f) return 0;
+
+	fseek(f, 0, SEEK_END);
+	int len = (int)ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if (buf)
+	{
+		if (size > 0 && len > size) len = size;
+		len = (int)fread(buf, 1, len, f);
+	}
+
+	fclose(f);
+	return len;
+}
+
+int FileLoad(const char *name, void *pBuffer, int size) { return load_file("", name, pBuffer, size); }
+int FileLoadConfig(const char *name, void *pBuffer, int size) { return load_file("config/", name, pBuffer, size); }
+int FileSave(const char *, void *, int size) { return size; }
+int FileSaveConfig(const char *, void *, int size) { return size; }
+int FileDeleteConfig(const char *) { return 1; }
+
+fileTYPE::fileTYPE() : filp(0), mode(0), type(0), zip(0), vhd(0), size(0), offset(0) { path[0] = 0; name[0] = 0; }
+fileTYPE::~fileTYPE() {}
+int FileOpen(fileTYPE *, const char *, char) { return 0; }
+void FileClose(fileTYPE *) {}
+int FileSeek(fileTYPE *, __off64_t, int) { return 0; }
+int FileReadAdv(fileTYPE *, void *, int, int failres) { return failres; }
+
+fileTextReader::fileTextReader() : size(0), buffer(0), pos(0) {}
+fileTextReader::~fileTextReader() {}
+bool FileOpenTextReader(fileTextReader *, const char *) { return false; }
+const char* FileReadLine(fileTextReader *) { return 0; }
+int isXmlName(const char *) { return 0; }
+
+// core
+
+void user_io_digital_joystick(unsigned char joystick, uint64_t map, int)
+{
+	uint32_t bitmask = (uint32_t)(map) | (uint32_t)(map >> 32);
+	replay_state.digital++;
+	if (joystick < REPLAY_MAXJOY) replay_state.joy_map[joystick] = bitmask;
+	replay_trace("P%d buttons %08X\n", joystick + 1, bitmask);
+}
+
+static void analog(unsigned char joystick, int stick, char valueX, char valueY)
+{
+	replay_state.analog++;
+	if (joystick < REPLAY_MAXJOY)
+	{
+		replay_state.joy_axis[joystick][stick][0] = valueX;
+		replay_state.joy_axis[joystick][stick][1] = valueY;
+	}
+	replay_trace("P%d %s %d,%d\n", joystick + 1, stick ? "right" : "left", valueX, valueY);
+}
+
+void user_io_l_analog_joystick(unsigned char joystick, char valueX, char valueY) { analog(joystick, 0, valueX, valueY); }
+void user_io_r_analog_joystick(unsigned char joystick, char valueX, char valueY) { analog(joystick, 1, valueX, valueY); }
+
+void user_io_mouse(unsigned char b, int16_t x, int16_t y, int16_t w)
+{
+	replay_state.mouse++;
+	replay_state.mouse_btn = b;
+	replay_state.mouse_x += x;
+	replay_state.mouse_y += y;
+	replay_state.mouse_w += w;
+	replay_trace("mouse %02X %d,%d %d\n", b, x, y, w);
+}
+
+void user_io_kbd(uint16_t key, int press)
+{
+	replay_state.keys++;
+	replay_trace("key %d %s\n", key, press == 1 ? "down" : press == 2 ? "repeat" : "up");
+}
+
+void menu_key_set(unsigned int c)
+{
+	replay_state.menu_keys++;
+	replay_trace("menu key %08X\n", c);
+}
+
+void Info(const char *message, int, int, int, int) { replay_trace("info: %s\n", message); }
+void InfoMessage(const char *message, int, const char *) { replay_trace("info: %s\n", message); }
+
+char user_io_osd_is_visible() { return 0; }
+char is_menu() { return 0; }
+char is_n64() { return 0; }
+char is_psx() { return 0; }
+int hasAPI1_5() { return 1; }
+int video_fb_state() { return 0; }
+void video_cmd(char *) {}
+int user_io_get_kbdemu() { return 0; }
+void user_io_check_reset(unsigned short, char) {}
+void user_io_set_ini(int) {}
+void user_io_screenshot_cmd(const char *) {}
+void user_io_read_confstr() {}
+char *user_io_get_confstr(int) { return 0; }
+char *user_io_get_core_name(int) { return (char *)"REPLAY"; }
+int menu_lightgun_cb(int, uint16_t, uint16_t, int) { return 0; }
+int menu_allow_cfg_switch() { return 0; }
+uint16_t spi_uio_cmd(uint16_t) { return 0; }
+void diskled_on() {}
+void set_volume(int) {}
+int fpga_load_rbf(const char *, const char *, const char *) { return 0; }
+int xml_load(const char *) { return 0; }
+
+int substrcpy(char *d, const char *s, char idx)
+{
+	char p = 0;
+	char *b = d;
+
+	while (*s)
+	{
+		if ((p == idx) && *s && (*s != ',')) *d++ = *s;
+
+		if (*s == ',')
+		{
+			if (p == idx) break;
+			p++;
+		}
+
+		s++;
+	}
+
+	*d = 0;
+	return (int)(d - b);
+}
+
+// N64 only, is_n64() is false
+void stick_swap(int num, int stick, int *num2, int *stick2)
+{
+	*num2 = num;
+	*stick2 = stick;
+}
+
+void n64_joy_emu(const int x, const int y, int* x2, int* y2, int, float)
+{
+	*x2 = x;
+	*y2 = y;
+}
+
+// everything runs on the replay thread
+
+void scheduler_watch_fd(int, uint32_t) {}
+void inputthread_watch_fd(int, uint32_t) {}
+bool inputthread_self() { return false; }
+void inputthread_lock() {}
+void inputthread_unlock() {}
+void inputthread_ui_poll() {}
+
+void inputthread_ui_call(inputthread_ui_fn fn, const char *str, int arg1, int arg2)
+{
+	fn(str, arg1, arg2);
+}
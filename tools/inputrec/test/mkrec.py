@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+# Generates basic.rec, the MiSTrec2 fixture of "make check" (format in inputrec.h):
+# X-Box 360 pad with button and stick motion, PS/2 mouse packets, a hotplugged
+# DS4 used and removed again, and a keyboard typing a few keys.
+# python3 mkrec.py [output]
+
+import struct
+import sys
+KEY_BYTES=96; ABS=64
+def desc(node, mouse, bus, vid, pid, ver, name, phys, uniq, sysfs, ev=(), keys=(), rels=(), abss={}):
+    evb=bytearray(4); kb=bytearray(KEY_BYTES); rb=bytearray(2); ab=bytearray(8)
+    for e in ev: evb[e//8]|=1<<(e%8)
+    for k in keys: kb[k//8]|=1<<(k%8)
+    for r in rels: rb[r//8]|=1<<(r%8)
+    absinfo=b''
+    for i in range(ABS):
+        if i in abss:
+            ab[i//8]|=1<<(i%8); mn,mx=abss[i]; absinfo+=struct.pack('<6i',(mn+mx)//2,mn,mx,0,0,0)
+        else: absinfo+=struct.pack('<6i',0,0,0,0,0,0)
+    d=struct.pack('<16sB3x4H128s64s64s256s',node.encode(),mouse,bus,vid,pid,ver,name.encode(),phys.encode(),uniq.encode(),sysfs.encode())
+    return d+bytes(evb)+bytes(kb)+bytes(rb)+bytes(ab)+absinfo
+def rec(kind,dev,gen,t,data=b''):
+    return struct.pack('<HHIIIQ',kind,dev,len(data),gen,0,t)+data
+def evs(t,lst):
+    return b''.join(struct.pack('<IIHHi',t//1000000,t%1000000,ty,c,v) for ty,c,v in lst)
+out=bytearray(b'MiSTrec2')
+pad=desc('event0',0,3,0x045e,0x028e,0x114,'Microsoft X-Box 360 pad','usb-ff540000.usb-1.1/input0','','/devices/platform/soc/ff540000.usb/usb1/1-1/1-1:1.0/input/input0',
+ ev=(0,1,3),keys=(0x130,0x131,0x133,0x134,0x136,0x137,0x13a,0x13b,0x13c,0x13d,0x13e),abss={0:(-32768,32767),1:(-32768,32767),3:(-32768,32767),4:(-32768,32767),2:(0,255),5:(0,255),16:(-1,1),17:(-1,1)})
+out+=rec(1,0,1,0,pad)
+mev=desc('event1',0,3,0x046d,0xc077,0x111,'Logitech USB Optical Mouse','usb-ff540000.usb-1.2/input0','','/devices/platform/soc/ff540000.usb/usb1/1-2/1-2:1.0/input/input1',ev=(0,1,2),keys=(0x110,0x111,0x112),rels=(0,1,8))
+out+=rec(1,1,2,0,mev)
+mm=desc('mouse0',1,0,0,0,0,'Logitech USB Optical Mouse','usb-ff540000.usb-1.2/input0','','/devices/platform/soc/ff540000.usb/usb1/1-2/1-2:1.0/input/input1')
+out+=rec(1,2,3,0,mm)
+t=100000
+for i in range(400):
+    t+=4000
+    b=1 if (i//50)%2 else 0
+    x=int(30000*((i%100)/50-1))
+    out+=rec(3,0,1,t,evs(t,[(1,0x130,b),(3,0,x),(3,1,-x),(0,0,0)]) if i%50==0 else evs(t,[(3,0,x),(3,1,-x),(0,0,0)]))
+    if i%3==0:
+        out+=rec(4,2,3,t+100,bytes([0x08|(1 if i%200<10 else 0), 2, 0xfe & 0xff, 0]))
+# hotplug a second pad, use it, remove it
+kb=desc('event2',0,3,0x054c,0x05c4,0x8111,'Sony Computer Entertainment Wireless Controller','usb-ff540000.usb-1.3/input0','','/devices/platform/soc/ff540000.usb/usb1/1-3/1-3:1.0/input/input2',
+ ev=(0,1,3),keys=(0x130,0x131,0x133,0x134),abss={0:(0,255),1:(0,255),16:(-1,1),17:(-1,1)})
+t+=10000; out+=rec(1,3,4,t,kb)
+for i in range(200):
+    t+=8000
+    out+=rec(3,3,4,t,evs(t,[(3,16,(i//20)%3-1),(1,0x131,(i//10)%2),(0,0,0)]))
+t+=5000; out+=rec(2,3,4,t)
+# keyboard: a, shift+b, held key repeat
+kbd=desc('event4',0,3,0x04d9,0x1603,0x110,'USB Keyboard','usb-ff540000.usb-1.4/input0','','/devices/platform/soc/ff540000.usb/usb1/1-4/1-4:1.0/input/input4',
+ ev=(0,1,4,17,20),keys=tuple(range(1,120)))
+t+=10000; out+=rec(1,4,5,t,kbd)
+for ty,c,v in [(1,30,1),(1,30,0),(1,42,1),(1,48,1),(1,48,0),(1,42,0),(1,57,1),(1,57,2),(1,57,2),(1,57,0)]:
+    t+=50000; out+=rec(3,4,5,t,evs(t,[(ty,c,v),(0,0,0)]))
+t+=5000; out+=rec(2,4,5,t)
+open(sys.argv[1] if len(sys.argv) > 1 else 'basic.rec','wb').write(out)
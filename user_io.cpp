@@ -36,6 +36,8 @@
 #include "ide.h"
 #include "ide_cdrom.h"
 #include "profiling.h"
+#include "scheduler.h"
+#include "iothread.h"
 
 #include "support.h"
 
@@ -1677,6 +1679,7 @@ void user_io_l_analog_joystick(unsigned char joystick, char valueX, char valueY)
 			spi8(valueY);
 		}
 		DisableIO();
+		input_lat_sent();
 	}
 }
 
@@ -1694,6 +1697,7 @@ void user_io_r_analog_joystick(unsigned char joystick, char valueX, char valueY)
 			spi8(valueY);
 		}
 		DisableIO();
+		input_lat_sent();
 	}
 }
 
@@ -1710,6 +1714,7 @@ void user_io_digital_joystick(unsigned char joystick, uint64_t map, int newdir)
 	spi_w(bitmask);
 	if(use32) spi_w(bitmask >> 16);
 	DisableIO();
+	input_lat_sent();
 
 	if (!is_minimig() && joy_transl == 1 && newdir)
 	{
@@ -1833,7 +1838,7 @@ int process_ss(const char *rom_name, int enable)
 
 		for (int i = 0; i < 4; i++)
 		{
-			if (!base[i]) base[i] = shmem_map(map_addr, len);
+			if (!base[i]) base[i] = shmem_acquire(map_addr, len);
 			if (!base[i])
 			{
 				printf("Unable to mmap (0x%X, %d)!\n", map_addr, len);
@@ -1993,6 +1998,8 @@ void user_io_file_info(const char *ext)
 
 int user_io_file_mount(const char *name, unsigned char index, char pre, int pre_size)
 {
+	IoThreadLock io_lock;
+
 	int writable = 0;
 	int ret = 0;
 	int len = strlen(name);
@@ -2036,6 +2043,11 @@ int user_io_file_mount(const char *name, unsigned char index, char pre, int pre_
 			{
 				writable = FileCanWrite(name);
 				ret = FileOpenEx(&sd_image[index], name, writable ? (O_RDWR | O_SYNC) : O_RDONLY);
+				if (ret && !FileMountVHD(&sd_image[index]))
+				{
+					FileClose(&sd_image[index]);
+					ret = 0;
+				}
 				if (ret && len > 4) {
 					if (!strcasecmp(name + len - 4, ".d64")
 						|| !strcasecmp(name + len - 4, ".g64")
@@ -2503,6 +2515,8 @@ int user_io_file_tx_a(const char* name, uint16_t index)
 
 int user_io_file_tx(const char* name, unsigned char index, char opensave, char mute, char composite, uint32_t load_addr)
 {
+	IoThreadLock io_lock;
+
 	fileTYPE f = {};
 	static uint8_t buf[4096];
 
@@ -2900,6 +2914,7 @@ void diskled_on()
 	fpga_set_led(1);
 	diskled_timer = GetTimer(50);
 	diskled_is_on = 1;
+	scheduler_activity();
 }
 
 static void kbd_reply(char code)
@@ -2926,7 +2941,17 @@ static int coldreset_req = 0;
 
 static uint32_t res_timer = 0;
 
-void user_io_poll()
+// set by iothread, menu_save_timer belongs to the main loop
+static bool save_written = false;
+
+void user_io_save_written()
+{
+	__atomic_store_n(&save_written, true, __ATOMIC_RELEASE);
+}
+
+// Disk and CD servicing. Called from user_io_poll() or from iothread.
+// UI side effects are left to user_io_poll().
+void user_io_poll_io()
 {
 	PROFILE_FUNCTION();
 
@@ -2936,8 +2961,6 @@ void user_io_poll()
 		return;  // no user io for the installed core
 	}
 
-	user_io_send_buttons(0);
-
 	if (is_minimig())
 	{
 		//HDD & FDD query
@@ -2958,22 +2981,6 @@ void user_io_poll()
 		ide_io(1, (sd_req >> 3) & 7);
 		if (sd_req & 0x0100) ide_cdda_send_sector();
 		UpdateDriveStatus();
-
-		kbd_fifo_poll();
-
-		if (!rtc_timer || CheckTimer(rtc_timer))
-		{
-			// Update once per minute should be enough
-			rtc_timer = GetTimer(60000);
-			send_rtc(1);
-		}
-
-		minimig_share_poll();
-	}
-
-	if (core_type == CORE_TYPE_8BIT && !is_menu())
-	{
-		check_status_change();
 	}
 
 	// sd card emulation
@@ -3081,7 +3088,7 @@ void user_io_poll()
 			{
 				//printf("SD WR %llu on %d\n", lba, disk);
 
-				if (use_save) menu_process_save();
+				if (use_save) user_io_save_written();
 
 				buffer_lba[disk] = -1;
 
@@ -3249,6 +3256,49 @@ void user_io_poll()
 		}
 	}
 
+	if (is_megacd()) mcd_poll();
+	if (is_pce()) pcecd_poll();
+	if (is_saturn()) saturn_poll();
+	if (is_psx()) psx_poll();
+	if (is_neogeo_cd()) neocd_poll();
+}
+
+void user_io_poll()
+{
+	PROFILE_FUNCTION();
+
+	if ((core_type != CORE_TYPE_SHARPMZ) &&
+		(core_type != CORE_TYPE_8BIT))
+	{
+		return;  // no user io for the installed core
+	}
+
+	user_io_send_buttons(0);
+
+	if (is_minimig())
+	{
+		kbd_fifo_poll();
+
+		if (!rtc_timer || CheckTimer(rtc_timer))
+		{
+			// Update once per minute should be enough
+			rtc_timer = GetTimer(60000);
+			send_rtc(1);
+		}
+
+		minimig_share_poll();
+	}
+
+	if (core_type == CORE_TYPE_8BIT && !is_menu())
+	{
+		check_status_change();
+	}
+
+	if (!iothread_active()) user_io_poll_io();
+
+	if (__atomic_exchange_n(&save_written, false, __ATOMIC_ACQ_REL)) menu_process_save();
+	if (is_st()) tos_poll_button();
+
 	if (is_neogeo() && (!rtc_timer || CheckTimer(rtc_timer)))
 	{
 		// Update once per minute should be enough
@@ -3529,11 +3579,6 @@ void user_io_poll()
 		diskled_is_on = 0;
 	}
 
-	if (is_megacd()) mcd_poll();
-	if (is_pce()) pcecd_poll();
-	if (is_saturn()) saturn_poll();
-	if (is_psx()) psx_poll();
-	if (is_neogeo_cd()) neocd_poll();
 	if (is_n64()) n64_poll();
 	process_ss(0);
 }
@@ -3768,10 +3813,12 @@ void user_io_mouse(unsigned char b, int16_t x, int16_t y, int16_t w)
 			spi8(b & 0x07);
 			spi8((w < -127) ? -127 : (w > 127) ? 127 : w);
 			DisableIO();
+			input_lat_sent();
 		}
 		else if (is_archie())
 		{
 			archie_mouse(b, x, y);
+			input_lat_sent();
 		}
 		else
 		{
@@ -3837,6 +3884,7 @@ void user_io_mouse(unsigned char b, int16_t x, int16_t y, int16_t w)
 				spi_w(ps2_mouse[1] | ((((uint16_t)b) << 5) & 0xF00));
 				spi_w(ps2_mouse[2] | ((((uint16_t)b) << 1) & 0x100));
 				DisableIO();
+				input_lat_sent();
 			}
 		}
 		return;
@@ -3957,7 +4005,11 @@ void user_io_kbd(uint16_t key, int press)
 					if (osd_is_visible) menu_key_set(UPSTROKE | key);
 
 					// these modifiers should be passed to core even if OSD is open or they will get stuck!
-					if (!osd_is_visible || key == KEY_LEFTALT || key == KEY_RIGHTALT || key == KEY_LEFTMETA || key == KEY_RIGHTMETA) send_keycode(key, press);
+					if (!osd_is_visible || key == KEY_LEFTALT || key == KEY_RIGHTALT || key == KEY_LEFTMETA || key == KEY_RIGHTMETA)
+					{
+						send_keycode(key, press);
+						input_lat_sent();
+					}
 				}
 				if (key == KEY_F12) block_F12 = 0;
 			}
@@ -4029,7 +4081,11 @@ void user_io_kbd(uint16_t key, int press)
 					else
 					{
 						if(key == KEY_MENU) key = KEY_F12;
-						if(input_state()) send_keycode(key, press);
+						if (input_state())
+						{
+							send_keycode(key, press);
+							input_lat_sent();
+						}
 					}
 				}
 			}
@@ -165,6 +165,10 @@ void user_io_init(const char *path, const char *xml);
 unsigned char user_io_core_type();
 void user_io_read_core_name();
 void user_io_poll();
+void user_io_poll_io();
+
+// core wrote save data. Menu reacts on it from the main loop, so callable from iothread.
+void user_io_save_written();
 char user_io_menu_button();
 char user_io_user_button();
 void user_io_osd_key_enable(char);
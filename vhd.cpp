@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <byteswap.h>
+
+#include "vhd.h"
+
+#define VHD_TYPE_DYNAMIC     3
+#define VHD_TYPE_DIFFERENCE  4
+#define VHD_BAT_UNUSED       0xFFFFFFFF
+#define VHD_MAX_BLOCK        (256 * 1024 * 1024)
+
+// all fields are big endian
+#pragma pack(push, 1)
+struct vhd_footer_t
+{
+	char     cookie[8];
+	uint32_t features;
+	uint32_t version;
+	uint64_t data_offset;
+	uint32_t timestamp;
+	char     creator_app[4];
+	uint32_t creator_ver;
+	uint32_t creator_os;
+	uint64_t orig_size;
+	uint64_t size;
+	uint32_t geometry;
+	uint32_t type;
+	uint32_t checksum;
+	uint8_t  uuid[16];
+	uint8_t  saved_state;
+	uint8_t  reserved[427];
+};
+
+struct vhd_header_t
+{
+	char     cookie[8];
+	uint64_t data_offset;
+	uint64_t table_offset;
+	uint32_t version;
+	uint32_t max_entries;
+	uint32_t block_size;
+	uint32_t checksum;
+	uint8_t  parent_uuid[16];
+	uint32_t parent_timestamp;
+	uint32_t reserved;
+	uint8_t  parent_name[512];
+	uint8_t  parent_locator[8][24];
+	uint8_t  reserved2[256];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(vhd_footer_t) == 512, "VHD footer size");
+static_assert(sizeof(vhd_header_t) == 1024, "VHD header size");
+
+struct fileVHD
+{
+	int          fd;
+	uint32_t    *bat;         // sector of every block in host order, VHD_BAT_UNUSED if not allocated
+	uint32_t     entries;
+	uint32_t     block_size;
+	uint32_t     bitmap_size; // sector bitmap in front of every block
+	uint8_t     *bitmap;
+	off_t        size;
+	off_t        bat_pos;
+	off_t        end;         // footer position, new blocks are placed here
+	vhd_footer_t footer;
+	uint32_t     allocated;
+
+	pthread_mutex_t lock;
+	bool            lock_init;
+};
+
+static uint32_t vhd_checksum(const void *data, int size, const uint32_t *field)
+{
+	uint32_t sum = 0;
+	const uint8_t *p = (const uint8_t*)data;
+	for (int i = 0; i < size; i++)
+	{
+		if (p + i < (const uint8_t*)field || p + i >= (const uint8_t*)(field + 1)) sum += p[i];
+	}
+
+	return ~sum;
+}
+
+int vhd_open(int fd, off_t file_size, fileVHD **vhd, off_t *disk_size)
+{
+	*vhd = 0;
+	if (file_size < 512 + 1024) return 0;
+
+	vhd_footer_t footer;
+	if (pread(fd, &footer, sizeof(footer), file_size - 512) != sizeof(footer) || memcmp(footer.cookie, "conectix", 8)) return 0;
+
+	uint32_t type = bswap_32(footer.type);
+	if (type == VHD_TYPE_DIFFERENCE)
+	{
+		printf("VHD: differencing images are not supported.\n");
+		return -1;
+	}
+
+	// fixed VHD is a raw image with footer
+	if (type != VHD_TYPE_DYNAMIC) return 0;
+
+	if (vhd_checksum(&footer, sizeof(footer), &footer.checksum) != bswap_32(footer.checksum))
+	{
+		printf("VHD: footer checksum mismatch.\n");
+		return -1;
+	}
+
+	vhd_header_t hdr;
+	if (pread(fd, &hdr, sizeof(hdr), bswap_64(footer.data_offset)) != sizeof(hdr) || memcmp(hdr.cookie, "cxsparse", 8))
+	{
+		printf("VHD: dynamic disk header not found.\n");
+		return -1;
+	}
+
+	uint32_t block_size = bswap_32(hdr.block_size);
+	uint32_t entries = bswap_32(hdr.max_entries);
+	uint64_t size = bswap_64(footer.size);
+	// entries come from the file: table must cover the disk, entries past the disk end are ignored
+	uint64_t needed = (block_size >= 512 && block_size <= VHD_MAX_BLOCK) ? (size + block_size - 1) / block_size : 0;
+	if (!needed || (block_size & 511) || entries < needed || needed > (SIZE_MAX / 4))
+	{
+		printf("VHD: invalid block table (%u blocks of %u bytes).\n", entries, block_size);
+		return -1;
+	}
+	entries = needed;
+
+	fileVHD *v = (fileVHD*)calloc(1, sizeof(fileVHD));
+	if (!v) return -1;
+
+	v->fd = fd;
+	v->entries = entries;
+	v->block_size = block_size;
+	v->bitmap_size = ((block_size / 512 / 8) + 511) & ~511;
+	v->size = size;
+	v->bat_pos = bswap_64(hdr.table_offset);
+	v->end = (file_size - 512 + 511) & ~511;
+	v->footer = footer;
+	size_t bat_size = (size_t)entries * 4;
+	v->bat = (uint32_t*)malloc(bat_size);
+	v->bitmap = (uint8_t*)malloc(v->bitmap_size);
+
+	if (!v->bat || !v->bitmap || pread(fd, v->bat, bat_size, v->bat_pos) != (ssize_t)bat_size)
+	{
+		printf("VHD: cannot read block table.\n");
+		vhd_close(v);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < entries; i++)
+	{
+		v->bat[i] = bswap_32(v->bat[i]);
+		if (v->bat[i] != VHD_BAT_UNUSED) v->allocated++;
+	}
+
+	// blocks are always fully written, so every sector is marked as present
+	memset(v->bitmap, 0xFF, v->bitmap_size);
+	pthread_mutex_init(&v->lock, NULL);
+	v->lock_init = true;
+
+	printf("VHD: dynamic, %llu MB, %u of %u blocks allocated.\n", (unsigned long long)(size >> 20), v->allocated, entries);
+
+	*vhd = v;
+	*disk_size = size;
+	return 1;
+}
+
+void vhd_close(fileVHD *vhd)
+{
+	if (!vhd) return;
+
+	if (vhd->bat) free(vhd->bat);
+	if (vhd->bitmap) free(vhd->bitmap);
+	if (vhd->lock_init) pthread_mutex_destroy(&vhd->lock);
+	free(vhd);
+}
+
+// lock must be held
+static bool vhd_alloc(fileVHD *vhd, uint32_t block)
+{
+	off_t pos = vhd->end;
+	off_t end = pos + vhd->bitmap_size + vhd->block_size;
+
+	// extended part reads as zeros, footer goes first so the image is valid at every step
+	if (ftruncate(vhd->fd, end + 512) < 0 ||
+		pwrite(vhd->fd, &vhd->footer, 512, end) != 512 ||
+		pwrite(vhd->fd, vhd->bitmap, vhd->bitmap_size, pos) != (ssize_t)vhd->bitmap_size)
+	{
+		printf("VHD: cannot allocate block %u (%d).\n", block, errno);
+		return false;
+	}
+
+	uint32_t entry = bswap_32((uint32_t)(pos / 512));
+	if (pwrite(vhd->fd, &entry, 4, vhd->bat_pos + block * 4) != 4)
+	{
+		printf("VHD: cannot update block table (%d).\n", errno);
+		return false;
+	}
+
+	vhd->bat[block] = pos / 512;
+	vhd->end = end;
+	vhd->allocated++;
+	return true;
+}
+
+static bool is_zero(const void *buf, int len)
+{
+	const uint8_t *p = (const uint8_t*)buf;
+	for (int i = 0; i < len; i++) if (p[i]) return false;
+	return true;
+}
+
+int vhd_read(fileVHD *vhd, off_t offset, void *buf, int len)
+{
+	if (offset < 0 || offset >= vhd->size) return 0;
+	if (len > vhd->size - offset) len = vhd->size - offset;
+
+	uint8_t *dst = (uint8_t*)buf;
+	int done = 0;
+	while (done < len)
+	{
+		uint32_t block = offset / vhd->block_size;
+		uint32_t pos = offset % vhd->block_size;
+		int cnt = vhd->block_size - pos;
+		if (cnt > len - done) cnt = len - done;
+
+		pthread_mutex_lock(&vhd->lock);
+		uint32_t sector = vhd->bat[block];
+		pthread_mutex_unlock(&vhd->lock);
+
+		if (sector == VHD_BAT_UNUSED)
+		{
+			memset(dst, 0, cnt);
+		}
+		else if (pread(vhd->fd, dst, cnt, (off_t)sector * 512 + vhd->bitmap_size + pos) != cnt)
+		{
+			return done ? done : -1;
+		}
+
+		dst += cnt;
+		done += cnt;
+		offset += cnt;
+	}
+
+	return done;
+}
+
+int vhd_write(fileVHD *vhd, off_t offset, const void *buf, int len)
+{
+	if (offset < 0 || offset >= vhd->size) return 0;
+	if (len > vhd->size - offset) len = vhd->size - offset;
+
+	const uint8_t *src = (const uint8_t*)buf;
+	int done = 0;
+	while (done < len)
+	{
+		uint32_t block = offset / vhd->block_size;
+		uint32_t pos = offset % vhd->block_size;
+		int cnt = vhd->block_size - pos;
+		if (cnt > len - done) cnt = len - done;
+
+		pthread_mutex_lock(&vhd->lock);
+		uint32_t sector = vhd->bat[block];
+		if (sector == VHD_BAT_UNUSED && !is_zero(src, cnt))
+		{
+			if (!vhd_alloc(vhd, block))
+			{
+				pthread_mutex_unlock(&vhd->lock);
+				return done ? done : -1;
+			}
+			sector = vhd->bat[block];
+		}
+		pthread_mutex_unlock(&vhd->lock);
+
+		// zeros into unallocated block need no space
+		if (sector != VHD_BAT_UNUSED && pwrite(vhd->fd, src, cnt, (off_t)sector * 512 + vhd->bitmap_size + pos) != cnt)
+		{
+			return done ? done : -1;
+		}
+
+		src += cnt;
+		done += cnt;
+		offset += cnt;
+	}
+
+	return done;
+}
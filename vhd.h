@@ -0,0 +1,21 @@
+#ifndef VHD_H
+#define VHD_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+// Dynamic (sparse) VHD images. Only the blocks written so far are stored in
+// the file, unallocated blocks read as zeros and are allocated on first write.
+// The block allocation table is kept in memory.
+
+struct fileVHD;
+
+// returns 1 for dynamic VHD, 0 for any other file, -1 for broken/unsupported VHD
+int vhd_open(int fd, off_t file_size, fileVHD **vhd, off_t *disk_size);
+void vhd_close(fileVHD *vhd);
+
+// return number of bytes transferred or -1 on error
+int vhd_read(fileVHD *vhd, off_t offset, void *buf, int len);
+int vhd_write(fileVHD *vhd, off_t offset, const void *buf, int len);
+
+#endif